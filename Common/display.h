@@ -0,0 +1,76 @@
+/*
+	4 digit LED7 frame without division.
+
+	disp_digits() fills d[0..3] (thousand .. unit) in the shift register
+	format print() sends: low nibble = digit for the BCD decoder, high
+	nibble = digit enable (1<<4 thousand .. 1<<7 unit). Leading zeros are
+	blanked, the unit digit is always on.
+
+	DISP_DEC     0..9999, larger values show 9999
+	DISP_SIGNED  -999..8999, the thousand digit shows DISP_MINUS_DIGIT
+	             for negative values with the zeros after it blanked
+	             (-5 shows "9  5"). Positive values stop below that digit
+	             so a lit 9 always means minus.
+
+	The BCD decoder only has 0..9, so there is no hex mode.
+
+	Decimal goes through a 14 bit double dabble: shifts and nibble
+	compares, no / or %.
+*/
+
+#ifndef DISPLAY_H_
+#define DISPLAY_H_
+
+#include <stdint.h>
+
+#define DISP_DEC 0
+#define DISP_SIGNED 1
+
+#ifndef DISP_MINUS_DIGIT
+#define DISP_MINUS_DIGIT 9
+#endif
+#define DISP_SIGNED_MAX (DISP_MINUS_DIGIT * 1000 - 1)
+
+static inline uint16_t disp_bcd(uint16_t v) /* v <= 9999 -> packed BCD */
+{
+	uint16_t bcd = 0;
+	uint8_t i;
+	
+	for (i = 0; i < 14; i++)
+	{
+		if ((bcd & 0x000f) >= 0x0005) bcd += 0x0003;
+		if ((bcd & 0x00f0) >= 0x0050) bcd += 0x0030;
+		if ((bcd & 0x0f00) >= 0x0500) bcd += 0x0300;
+		bcd = (bcd << 1) | ((v >> 13) & 1);
+		v <<= 1;
+	}
+	return bcd;
+}
+
+static inline void disp_digits(uint16_t v, uint8_t mode, uint8_t d[4])
+{
+	uint16_t n;
+	uint8_t minus = 0;
+	
+	if (mode == DISP_SIGNED)
+	{
+		if ((int16_t)v < 0)
+		{
+			v = ((int16_t)v < -999) ? 999 : (uint16_t)(-(int16_t)v);
+			minus = 1;
+		}
+		else if (v > DISP_SIGNED_MAX) v = DISP_SIGNED_MAX;
+	}
+	n = disp_bcd(v > 9999 ? 9999 : v);
+	
+	d[0] = (n >> 12) & 0x0f;
+	d[1] = (n >> 8) & 0x0f;
+	d[2] = (n >> 4) & 0x0f;
+	d[3] = (1 << 7) | (n & 0x0f);
+	if (d[0]) d[0] |= 1 << 4;
+	if (d[0] || d[1]) d[1] |= 1 << 5;
+	if (d[0] || d[1] || d[2]) d[2] |= 1 << 6;
+	if (minus) d[0] = (1 << 4) | DISP_MINUS_DIGIT; /* magnitude <= 999, d[0] was blank */
+}
+
+#endif /* DISPLAY_H_ */
@@ -0,0 +1,45 @@
+/*
+	Checksummed config blob in eeprom.
+
+	A project keeps everything it calibrates in one struct that starts
+	with a version byte and ends with a uint16_t crc. blob_load() reads it
+	with one eeprom_read_block() and checks the CRC-16 (avr-libc
+	_crc16_update) and the version, the caller falls back to its defaults
+	when it fails. blob_save() sets the crc and writes through
+	eeprom_update_block(), so only bytes that changed are programmed and
+	saving an unchanged config costs no eeprom wear.
+*/
+
+#ifndef EEBLOB_H_
+#define EEBLOB_H_
+
+#include <stdint.h>
+#include "hal.h"
+
+static inline uint16_t blob_crc(const void *blob, uint16_t n) /* n without the crc */
+{
+	const uint8_t *p = (const uint8_t *)blob;
+	uint16_t crc = 0xffff;
+	
+	while (n--) crc = _crc16_update(crc, *p++);
+	return crc;
+}
+
+/* 1 when the eeprom copy has the right version and crc, dst holds it either way */
+static inline uint8_t blob_load(void *dst, const void *ee, uint16_t n, uint8_t version)
+{
+	uint16_t crc;
+	
+	eeprom_busy_wait();
+	eeprom_read_block(dst, ee, n);
+	crc = *(uint16_t *)((uint8_t *)dst + n - 2);
+	return *(uint8_t *)dst == version && crc == blob_crc(dst, n - 2);
+}
+
+static inline void blob_save(void *src, void *ee, uint16_t n)
+{
+	*(uint16_t *)((uint8_t *)src + n - 2) = blob_crc(src, n - 2);
+	eeprom_update_block(src, ee, n);
+}
+
+#endif /* EEBLOB_H_ */
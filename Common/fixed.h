@@ -0,0 +1,66 @@
+/*
+	Fixed-point helpers for the motor path (no soft-float on the ATmega16A).
+
+	q8_8_t  signed 8.8, ratios and gains up to +-127.99
+	q15_t   signed 1.15, fractions in [-1, 1)
+
+	Q8_8() and Q15() are for constants only, they fold at compile time.
+	Products truncate toward zero like the old float -> int conversion and
+	saturate to int16_t.
+*/
+
+#ifndef FIXED_H_
+#define FIXED_H_
+
+#include <stdint.h>
+
+typedef int16_t q8_8_t;
+typedef int16_t q15_t;
+
+#define Q8_8(x) ((q8_8_t)((x) * 256.0 + ((x) >= 0 ? 0.5 : -0.5)))
+#define Q15(x)  ((q15_t)((x) >= 1.0 ? 32767 : (x) * 32768.0 + ((x) >= 0 ? 0.5 : -0.5)))
+
+static inline int16_t sat16(int32_t x)
+{
+	if (x > INT16_MAX) return INT16_MAX;
+	if (x < INT16_MIN) return INT16_MIN;
+	return (int16_t)x;
+}
+
+static inline q8_8_t q8_8_add(q8_8_t a, q8_8_t b)
+{
+	return sat16((int32_t)a + b);
+}
+
+static inline int16_t q8_8_scale(int16_t v, q8_8_t r) /* v * r */
+{
+	return sat16(((int32_t)v * r) / 256);
+}
+
+static inline uint16_t q8_8_scale_u(uint16_t v, q8_8_t r) /* unsigned v, r >= 0 */
+{
+	uint32_t t = ((uint32_t)v * (uint16_t)r) >> 8;
+	return t > UINT16_MAX ? UINT16_MAX : (uint16_t)t;
+}
+
+static inline q8_8_t q8_8_from_pct(int16_t pct) /* 30 -> 0.30 */
+{
+	return sat16(((int32_t)pct * 256 + (pct >= 0 ? 50 : -50)) / 100);
+}
+
+static inline int16_t q8_8_to_pct(q8_8_t r) /* 0.30 -> 30 */
+{
+	return ((int32_t)r * 100 + (r >= 0 ? 128 : -128)) / 256;
+}
+
+static inline int16_t q15_scale(int16_t v, q15_t r) /* v * r */
+{
+	return sat16(((int32_t)v * r) / 32768);
+}
+
+static inline int16_t q15_sub_scaled(int16_t a, int16_t v, q15_t r) /* a - v * r, one truncation */
+{
+	return sat16(((int32_t)a * 32768 - (int32_t)v * r) / 32768);
+}
+
+#endif /* FIXED_H_ */
@@ -0,0 +1,44 @@
+/*
+	Hardware abstraction for the line follower boards (ATmega16A, 16 MHz).
+
+	The control code touches the hardware only through the hal_*() calls
+	below, so the same sources build for the car (hal_avr.h) and as a
+	native program on the PC (HAL_HOST, Host/hal_host.h) for simulation,
+	replay and benchmarks.
+
+	hal_avr.h is the same register access the code used to do inline:
+	every call is inline, always_inline, one register read or
+	write with constant bit numbers, so the generated code is unchanged.
+
+	pins and registers shared by all the boards
+	  servo        OCR1A (Timer1 fast PWM, ICR1 top, 0.5 us counts)
+	  left motor   OCR1B duty, direction pins on PORTD
+	  right motor  OCR2 duty, direction pins on PORTD
+	  buttons      PINB, switches PINC
+	  LED7 + LEDs  SPI shift registers, latch on PB4
+	  encoder      INT0
+	  tick         Timer0 CTC, 1 ms
+
+	hal_idle() goes in every busy-wait loop that only polls RAM set by an
+	ISR. It is empty on the car; on the PC it lets simulated time run to
+	the next interrupt.
+	This file and the other headers in Common/ (fixed.h, display.h,
+	prof.h, sched.h, eeblob.h, sweep_cal.h) are shared by the three firmwares,
+	MCR/XE, ITCarSS6 and Golden; their projects have Common on the
+	include path.
+*/
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#ifdef HAL_HOST
+#include "hal_host.h"
+#else
+#include "hal_avr.h"
+#endif
+
+#endif /* HAL_H_ */
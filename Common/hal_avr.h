@@ -0,0 +1,98 @@
+/*
+	hal.h backend for the car: direct register access.
+*/
+
+#ifndef HAL_AVR_H_
+#define HAL_AVR_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+#define HAL_INLINE inline __attribute__((always_inline)) /* not static: the firmware calls these from its own plain inline functions */
+#define HAL_LATCH 4 /* PB4 */
+
+HAL_INLINE void hal_idle(void) {}
+
+/* buttons and DIP switches, raw port (active low) */
+HAL_INLINE uint8_t hal_buttons(void) { return PINB; }
+HAL_INLINE uint8_t hal_switches(void) { return PINC; }
+
+/* servo and motors */
+HAL_INLINE void hal_servo(uint16_t ocr) { OCR1A = ocr; }
+HAL_INLINE void hal_motor_l(uint16_t ocr) { OCR1B = ocr; }
+HAL_INLINE void hal_motor_r(uint8_t ocr) { OCR2 = ocr; }
+HAL_INLINE uint16_t hal_motor_l_get(void) { return OCR1B; }
+HAL_INLINE uint8_t hal_motor_r_get(void) { return OCR2; }
+HAL_INLINE void hal_dir_set(uint8_t bit) { PORTD |= (1 << bit); }
+HAL_INLINE void hal_dir_clr(uint8_t bit) { PORTD &= ~(1 << bit); }
+
+/* ADC: start a conversion on admux (reference | adlar | channel) */
+HAL_INLINE void hal_adc_start(uint8_t admux) { ADMUX = admux; ADCSRA |= (1 << ADSC); }
+HAL_INLINE uint8_t hal_adc_done(void) { return ADCSRA & (1 << ADIF); }
+HAL_INLINE uint16_t hal_adc10(void) { return ADCW; }
+HAL_INLINE uint8_t hal_adc8(void) { return ADCH; }
+HAL_INLINE void hal_adc_irq_on(void) { ADCSRA |= (1 << ADIE); }
+HAL_INLINE void hal_adc_irq_off(void) { ADCSRA &= ~(1 << ADIE); }
+
+/* LED7 / LED shift registers */
+HAL_INLINE void hal_spi_write(uint8_t b) { SPDR = b; }
+HAL_INLINE void hal_latch_pulse(void) { PORTB |= (1 << HAL_LATCH); PORTB &= ~(1 << HAL_LATCH); }
+
+/* timers: Timer0 = 1 ms tick, Timer1 = servo PWM (0.5 us counts) */
+#define HAL_T1_TOP 20000 /* ICR1, set once in hal_init_timers(), never read back */
+HAL_INLINE uint8_t hal_t0_count(void) { return TCNT0; }
+HAL_INLINE uint8_t hal_t0_pending(void) { return TIFR & (1 << OCF0); }
+HAL_INLINE uint16_t hal_t1_count(void) { return TCNT1; }
+
+/* USART transmit (MCR telemetry) */
+HAL_INLINE void hal_uart_put(uint8_t b) { UDR = b; }
+HAL_INLINE void hal_uart_irq_on(void) { UCSRB |= (1 << UDRIE); }
+HAL_INLINE void hal_uart_irq_off(void) { UCSRB &= ~(1 << UDRIE); }
+
+/* eeprom ready interrupt (MCR black box) */
+HAL_INLINE void hal_ee_irq_on(void) { EECR |= (1 << EERIE); }
+HAL_INLINE void hal_ee_irq_off(void) { EECR &= ~(1 << EERIE); }
+
+/* init */
+HAL_INLINE void hal_init_adc(uint8_t admux, uint8_t adcsra) { ADMUX = admux; ADCSRA = adcsra; }
+HAL_INLINE void hal_init_ports(uint8_t portd)
+{
+	DDRB  = 0b11110001;
+	PORTB = 0b11111111;
+	DDRC  = 0b00000000;
+	PORTC = 0b11111111;
+	DDRD  = 0b11111011;
+	PORTD = portd;
+}
+HAL_INLINE void hal_init_spi(void)
+{
+	SPCR = (1<<SPIE) | (1<<SPE) | (1<<MSTR); /* master, transfer complete interrupt */
+	SPSR = (1<<SPI2X); /* Fosc/2 */
+}
+HAL_INLINE void hal_init_timers(void)
+{
+	TCCR0 = (1<<WGM01) | (1<<CS02); /* CTC, /256 */
+	OCR0 = 62; /* 1 ms */
+	TIMSK = (1<<OCIE0);
+	TCCR1A = (1<<COM1A1) | (1<<COM1B1) | (1<<WGM11); /* mode 14 fast PWM, non-inverting A and B */
+	TCCR1B = (1<<WGM13) | (1<<WGM12) | (1<<CS11); /* /8 */
+	ICR1 = HAL_T1_TOP; /* 10 ms */
+	TCCR2 = (1<<WGM20) | (1<<WGM21) | (1<<COM21) | (1<<CS22) | (1<<CS21) | (1<<CS20); /* fast PWM, non-inverting, /1024 */
+	OCR2 = 0;
+}
+HAL_INLINE void hal_init_encoder(uint8_t isc) { MCUCR |= isc; GICR |= (1<<INT0); }
+HAL_INLINE void hal_init_uart(uint8_t ubrr)
+{
+	UBRRH = 0;
+	UBRRL = ubrr;
+	UCSRA = (1<<U2X);
+	UCSRC = (1<<URSEL) | (1<<UCSZ1) | (1<<UCSZ0); /* 8N1 */
+	UCSRB = (1<<TXEN);
+}
+
+#endif /* HAL_AVR_H_ */
@@ -0,0 +1,114 @@
+/*
+	Section profiler on Timer1.
+
+	Timer1 runs the servo PWM at clk/8, so one count is 0.5 us (8 cycles)
+	and it wraps at ICR1 every 10 ms. PROF_BEGIN(id) / PROF_END(id) around
+	a section keep count, min, max and sum per id in prof_tab; sections
+	must be shorter than 10 ms and an id must not nest with itself. In an
+	ISR the measured part is the body, not the register save/restore.
+
+	Built only with PROFILE defined (Debug configuration). Without it the
+	macros are empty and nothing here is compiled in, so race (Release)
+	builds carry no profiler code or RAM.
+
+	Before the include the firmware defines
+	PROF_DISPLAY(v, leds)  show v on the LED7 and leds on the 8 LEDs
+	PROF_NEXT()            true when the "next page" button is pressed
+	prof_show() pages through every section id: LEDs = id in bits 0..4,
+	bit 6 = min, bit 7 = max, neither = mean, value in us.
+*/
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#ifdef PROFILE
+
+#ifndef PROF_SECTIONS
+#define PROF_SECTIONS 8
+#endif
+
+typedef struct Prof
+{
+	uint16_t n, min, max;
+	uint32_t sum;
+} prof_t;
+
+prof_t prof_tab[PROF_SECTIONS];
+uint16_t prof_t0[PROF_SECTIONS];
+
+static inline uint16_t prof_now(void) /* TCNT1 read must not interleave with an ISR reading it */
+{
+	uint16_t t;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		t = hal_t1_count();
+	}
+	return t;
+}
+
+static inline void prof_end(uint8_t id)
+{
+	uint16_t t = prof_now(), d;
+	prof_t *p = &prof_tab[id];
+	
+	d = (t >= prof_t0[id]) ? t - prof_t0[id] : t + HAL_T1_TOP + 1 - prof_t0[id];
+	if (p->n == 0 || d < p->min) p->min = d;
+	if (d > p->max) p->max = d;
+	p->sum += d;
+	if (++p->n == 0xffff) /* keep the mean, drop half the weight */
+	{
+		p->n >>= 1;
+		p->sum >>= 1;
+	}
+}
+
+#define PROF_BEGIN(id) (prof_t0[id] = prof_now())
+#define PROF_END(id) prof_end(id)
+
+void prof_reset(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for (uint8_t i = 0; i < PROF_SECTIONS; i++)
+		{
+			prof_tab[i].n = prof_tab[i].min = prof_tab[i].max = 0;
+			prof_tab[i].sum = 0;
+		}
+	}
+}
+
+uint16_t prof_us(uint8_t id, uint8_t stat) /* stat 0 mean, 1 min, 2 max */
+{
+	prof_t p;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		p = prof_tab[id];
+	}
+	if (stat == 1) return p.min / 2;
+	if (stat == 2) return p.max / 2;
+	return p.n ? (uint16_t)(p.sum / p.n / 2) : 0;
+}
+
+#ifdef PROF_DISPLAY
+void prof_show(void)
+{
+	uint8_t page = 0;
+	
+	while (1)
+	{
+		if (PROF_NEXT()) page = (page + 1) % (PROF_SECTIONS * 3);
+		PROF_DISPLAY(prof_us(page / 3, page % 3), (page / 3) | ((page % 3 == 1) << 6) | ((page % 3 == 2) << 7));
+	}
+}
+#endif
+
+#else
+
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+
+#endif /* PROFILE */
+
+#endif /* PROF_H_ */
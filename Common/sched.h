@@ -0,0 +1,174 @@
+/*
+	Fixed-period task release from TIMER0_COMP_vect.
+
+	TIMER0 ticks every SCHED_TICK_COUNTS counts of 16 us (about 1 ms).
+	sched_isr() releases each task every SCHED_<task>_TICKS ticks and the
+	main loop runs only released tasks, so the control period does not
+	depend on which state branch ran last.
+
+	SCHED_CONTROL  sense + steer + motor speed, every 2 ms
+	SCHED_DISPLAY  LED data update, every 50 ms (MCR; ITCarSS6 and
+	               Golden set the LEDs from the pattern and ignore it)
+	(print() stays in the ISR, the display multiplex needs every tick)
+
+	The main loop:
+		run = sched_wait();
+		if (run & (1 << SCHED_CONTROL)) { sched_begin(); ...; sched_end(); }
+
+	Statistics, in 16 us timer counts, kept until sched_stats_reset():
+	lat_max     worst delay from release to task start
+	run_max     worst control task run time
+	jitter_max  worst |start to start - nominal period| of the control task
+	overrun     control releases that came before the last one was taken
+	Blocking manoeuvres call sched_skip() first so they are not counted.
+
+	Before the include the firmware defines
+	SCHED_SHOW(v, leds)  show v on the LED7 and leds on the 8 LEDs
+	SCHED_NEXT()         true when the "next page" button is pressed
+	SCHED_PROF()         true when the profiler button is pressed
+	sched_show() pages through lat, run, jitter (us, 9999 = longer) and
+	overruns, LEDs = 1 << page. With PROFILE, SCHED_PROF() moves on to
+	the profiler pages (prof.h, included first).
+*/
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#define SCHED_TICK_COUNTS 63 /* OCR0 + 1 */
+#ifndef SCHED_CONTROL_TICKS
+#define SCHED_CONTROL_TICKS 2
+#endif
+#ifndef SCHED_DISPLAY_TICKS
+#define SCHED_DISPLAY_TICKS 50
+#endif
+
+#define SCHED_CONTROL 0
+#define SCHED_DISPLAY 1
+#define SCHED_TASKS 2
+
+typedef struct Sched_stats
+{
+	uint16_t lat_max, run_max, jitter_max;
+	uint16_t overrun;
+} sched_stats_t;
+
+volatile uint16_t sched_tick = 0;
+volatile uint8_t sched_ready = 0; /* released task bits */
+volatile uint16_t sched_release[SCHED_TASKS]; /* tick of the last release */
+uint8_t sched_cnt[SCHED_TASKS];
+sched_stats_t sched_stats;
+uint16_t sched_start, sched_last_start, sched_taken; /* sched_taken: release tick of the control task being run */
+volatile uint8_t sched_skipped = 1;
+
+static inline void sched_isr(void) /* from TIMER0_COMP_vect */
+{
+	sched_tick += 1;
+	if (++sched_cnt[SCHED_CONTROL] >= SCHED_CONTROL_TICKS)
+	{
+		sched_cnt[SCHED_CONTROL] = 0;
+		if ((sched_ready & (1 << SCHED_CONTROL)) && !sched_skipped && sched_stats.overrun != 0xffff) sched_stats.overrun += 1;
+		sched_release[SCHED_CONTROL] = sched_tick;
+		sched_ready |= 1 << SCHED_CONTROL;
+	}
+	if (++sched_cnt[SCHED_DISPLAY] >= SCHED_DISPLAY_TICKS)
+	{
+		sched_cnt[SCHED_DISPLAY] = 0;
+		sched_release[SCHED_DISPLAY] = sched_tick;
+		sched_ready |= 1 << SCHED_DISPLAY;
+	}
+}
+
+static inline uint16_t sched_now(void) /* 16 us counts, wraps every ~1 s */
+{
+	uint16_t t;
+	uint8_t c;
+	
+	cli();
+	t = sched_tick;
+	c = hal_t0_count();
+	if (hal_t0_pending() && c < SCHED_TICK_COUNTS / 2) t += 1; /* compare hit, ISR still pending */
+	sei();
+	return t * SCHED_TICK_COUNTS + c;
+}
+
+static inline uint16_t sched_us(uint16_t counts) /* 9999 for anything the LED7 cannot show */
+{
+	return counts > 9999 / 16 ? 9999 : counts * 16;
+}
+
+void sched_stats_reset(void)
+{
+	cli();
+	sched_stats.lat_max = sched_stats.run_max = sched_stats.jitter_max = 0;
+	sched_stats.overrun = 0;
+	sched_ready = 0;
+	sched_skipped = 1;
+	sched_cnt[SCHED_CONTROL] = sched_cnt[SCHED_DISPLAY] = 0;
+	sei();
+}
+
+static inline uint8_t sched_wait(void) /* sleep until a task is released, returns and clears the released bits */
+{
+	uint8_t r;
+	
+	while (sched_ready == 0) hal_idle();
+	cli();
+	r = sched_ready;
+	sched_ready = 0;
+	sched_taken = sched_release[SCHED_CONTROL];
+	sei();
+	return r;
+}
+
+static inline void sched_begin(void) /* start of the control task */
+{
+	uint16_t lat, period;
+	
+	sched_start = sched_now();
+	if (!sched_skipped)
+	{
+		lat = sched_start - sched_taken * SCHED_TICK_COUNTS;
+		if (lat > sched_stats.lat_max) sched_stats.lat_max = lat;
+		period = sched_start - sched_last_start;
+		period = (period > SCHED_CONTROL_TICKS * SCHED_TICK_COUNTS) ? period - SCHED_CONTROL_TICKS * SCHED_TICK_COUNTS : SCHED_CONTROL_TICKS * SCHED_TICK_COUNTS - period;
+		if (period > sched_stats.jitter_max) sched_stats.jitter_max = period;
+	}
+	sched_last_start = sched_start;
+	sched_skipped = 0;
+}
+
+static inline void sched_end(void) /* end of the control task */
+{
+	uint16_t run = sched_now() - sched_start;
+	
+	if (!sched_skipped && run > sched_stats.run_max) sched_stats.run_max = run;
+}
+
+static inline void sched_skip(void) /* call before a blocking manoeuvre, this period is left out of the statistics */
+{
+	sched_skipped = 1;
+}
+
+void sched_show(void) /* after a run, never returns */
+{
+	uint8_t idx = 0;
+	uint16_t v;
+	
+	while (1)
+	{
+#ifdef PROFILE
+		if (SCHED_PROF()) prof_show();
+#endif
+		if (SCHED_NEXT()) idx = (idx + 1) & 3;
+		switch (idx)
+		{
+			case 0: v = sched_us(sched_stats.lat_max); break;
+			case 1: v = sched_us(sched_stats.run_max); break;
+			case 2: v = sched_us(sched_stats.jitter_max); break;
+			default: v = sched_stats.overrun; break;
+		}
+		SCHED_SHOW(v, 1 << idx);
+	}
+}
+
+#endif /* SCHED_H_ */
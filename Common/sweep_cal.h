@@ -0,0 +1,102 @@
+/*
+	Automatic sensor calibration with the steering servo.
+
+	The sensor bar turns with the servo, so with the car parked across the
+	line the servo can sweep every channel over the line and the floor:
+	  rest    SWEEP_REST_FRAMES frames at centre, per channel peak to peak
+	          = noise
+	  sweep   centre -> -SWEEP_RANGE -> +SWEEP_RANGE -> centre, one servo
+	          unit every SWEEP_FRAMES_PER_STEP frames, with SWEEP_DWELL
+	          steps at both ends for the servo to catch up
+	Per channel lo = min (line, white) and hi = max (floor), the caller's
+	normalisation and threshold come from these. With 10 bit frames
+	(~0.83 ms) the whole run is about 0.65 s.
+
+	A channel is bad when hi - lo is under SWEEP_MIN_SPAN or under
+	SWEEP_SNR times its noise; sweep_cal() returns the bad channel bits,
+	0 = all good.
+
+	Before the include the firmware defines
+	SWEEP_SERVO(pos)  steer to pos, -SWEEP_RANGE..SWEEP_RANGE
+	SWEEP_FRAME(v)    fill adc_t v[8] with a new raw frame
+	and optionally SWEEP_FRAMES_PER_STEP (faster ADC profiles need more).
+*/
+
+#ifndef SWEEP_CAL_H_
+#define SWEEP_CAL_H_
+
+#ifndef SWEEP_RANGE
+#define SWEEP_RANGE 150
+#endif
+#ifndef SWEEP_FRAMES_PER_STEP
+#define SWEEP_FRAMES_PER_STEP 1
+#endif
+#define SWEEP_REST_FRAMES 32
+#define SWEEP_DWELL 40
+#define SWEEP_MIN_SPAN (ADC_MAX / 10)
+#define SWEEP_SNR 8
+
+static void sweep_reset(adc_t lo[8], adc_t hi[8])
+{
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		lo[i] = ADC_MAX;
+		hi[i] = 0;
+	}
+}
+
+static void sweep_sample(adc_t lo[8], adc_t hi[8])
+{
+	adc_t v[8];
+	uint8_t i;
+
+	SWEEP_FRAME(v);
+	for (i = 0; i < 8; i++)
+	{
+		if (v[i] < lo[i]) lo[i] = v[i];
+		if (v[i] > hi[i]) hi[i] = v[i];
+	}
+}
+
+static void sweep_move(int16_t from, int16_t to, adc_t lo[8], adc_t hi[8])
+{
+	int16_t pos = from;
+	int8_t dir = (to > from) ? 1 : -1;
+	uint8_t k;
+
+	while (1)
+	{
+		SWEEP_SERVO(pos);
+		for (k = 0; k < SWEEP_FRAMES_PER_STEP; k++) sweep_sample(lo, hi);
+		if (pos == to) break;
+		pos += dir;
+	}
+	for (k = 0; k < SWEEP_DWELL * SWEEP_FRAMES_PER_STEP; k++) sweep_sample(lo, hi);
+}
+
+/* motors must be stopped; lo, hi and noise get the per channel results */
+uint8_t sweep_cal(adc_t lo[8], adc_t hi[8], adc_t noise[8])
+{
+	uint8_t i, bad = 0;
+
+	SWEEP_SERVO(0);
+	sweep_reset(lo, hi);
+	for (i = 0; i < SWEEP_DWELL * SWEEP_FRAMES_PER_STEP; i++) sweep_sample(lo, hi); /* let the servo settle, not counted */
+	sweep_reset(lo, hi);
+	for (i = 0; i < SWEEP_REST_FRAMES; i++) sweep_sample(lo, hi);
+	for (i = 0; i < 8; i++) noise[i] = hi[i] - lo[i];
+	sweep_reset(lo, hi);
+
+	sweep_move(0, -SWEEP_RANGE, lo, hi);
+	sweep_move(-SWEEP_RANGE, SWEEP_RANGE, lo, hi);
+	sweep_move(SWEEP_RANGE, 0, lo, hi);
+
+	for (i = 0; i < 8; i++)
+	{
+		adc_t span = hi[i] - lo[i];
+		if (span < SWEEP_MIN_SPAN || span < (uint16_t)noise[i] * SWEEP_SNR) bad |= 1 << i;
+	}
+	return bad;
+}
+
+#endif /* SWEEP_CAL_H_ */
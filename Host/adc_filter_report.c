@@ -0,0 +1,130 @@
+/*
+	adc_filter_report: noise reduction vs. group delay of the sensor filters
+	in MCR/XE/adc_filter.h, against the old two-conversion average.
+
+	usage: adc_filter_report [noise_sigma_lsb] [rho]
+
+	Input is a constant level plus gaussian noise (sigma LSB). rho is the
+	correlation between two back to back conversions of the same channel,
+	which is what the old (read_adc(i) + read_adc(i)) / 2 averaged.
+	Group delay is the DC group delay measured on a noiseless step, in frames.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../MCR/XE/adc_filter.h"
+
+#define LEVEL 512
+#define SETTLE 64
+#define SAMPLES 200000
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static double uniform(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return ((rng >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double gauss(void) {
+	return sqrt(-2.0 * log(uniform())) * cos(6.283185307179586 * uniform());
+}
+
+static uint16_t quantize(double v) {
+	if (v < 0) return 0;
+	if (v > 1023) return 1023;
+	return (uint16_t)(v + 0.5);
+}
+
+enum { F_OLD, F_NONE, F_IIR, F_BOX };
+
+typedef struct {
+	const char *name;
+	int kind;
+	uint8_t param; //shift or log2(taps)
+} filter_t;
+
+typedef struct {
+	int kind;
+	uint8_t param;
+	uint16_t iir;
+	adc_boxcar_t box;
+} state_t;
+
+static void reset(state_t *s, const filter_t *f) {
+	s->kind = f->kind;
+	s->param = f->param;
+	s->iir = 0xffff;
+	s->box.idx = 0xff;
+}
+
+/* one frame: a and b are two conversions of the same channel */
+static uint16_t step(state_t *s, uint16_t a, uint16_t b) {
+	switch (s->kind) {
+		case F_OLD: return (a + b) / 2;
+		case F_IIR: return adc_iir_step(&s->iir, a, s->param);
+		case F_BOX: return adc_boxcar_step(&s->box, a, 1 << s->param, s->param);
+		default: return a;
+	}
+}
+
+static double noise_std(const filter_t *f, double sigma, double rho) {
+	state_t s;
+	double sum = 0, sum2 = 0;
+	
+	reset(&s, f);
+	for (int n = 0; n < SETTLE + SAMPLES; n++) {
+		double common = gauss() * sigma * sqrt(rho);
+		double na = gauss() * sigma * sqrt(1 - rho);
+		double nb = gauss() * sigma * sqrt(1 - rho);
+		uint16_t y = step(&s, quantize(LEVEL + common + na), quantize(LEVEL + common + nb));
+		if (n >= SETTLE) {
+			sum += y;
+			sum2 += (double)y * y;
+		}
+	}
+	sum /= SAMPLES;
+	return sqrt(sum2 / SAMPLES - sum * sum);
+}
+
+static double group_delay(const filter_t *f) {
+	state_t s;
+	double delay = 0;
+	const uint16_t lo = 256, hi = 768;
+	
+	reset(&s, f);
+	for (int n = 0; n < SETTLE; n++) step(&s, lo, lo);
+	for (int n = 0; n < SETTLE * 4; n++) {
+		uint16_t y = step(&s, hi, hi);
+		delay += 1.0 - (double)(y - lo) / (hi - lo);
+	}
+	return delay;
+}
+
+int main(int argc, char **argv) {
+	double sigma = argc > 1 ? atof(argv[1]) : 6.0;
+	double rho = argc > 2 ? atof(argv[2]) : 0.5;
+	const filter_t filters[] = {
+		{ "raw (1 conversion)",           F_NONE, 0 },
+		{ "old (x1 + x2) / 2",            F_OLD,  0 },
+		{ "IIR shift 1",                  F_IIR,  1 },
+		{ "IIR shift 2",                  F_IIR,  2 },
+		{ "IIR shift 3",                  F_IIR,  3 },
+		{ "boxcar 2",                     F_BOX,  1 },
+		{ "boxcar 4",                     F_BOX,  2 },
+		{ "boxcar 8",                     F_BOX,  3 },
+	};
+	double raw = 0;
+	
+	printf("input: level %d, noise sigma %.2f LSB, back to back correlation %.2f\n\n", LEVEL, sigma, rho);
+	printf("%-22s %12s %10s %12s %14s\n", "filter", "conv/frame", "std LSB", "noise red.", "delay frames");
+	for (unsigned i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+		double sd = noise_std(&filters[i], sigma, rho);
+		if (i == 0) raw = sd;
+		printf("%-22s %12d %10.3f %11.2fx %14.2f\n", filters[i].name, filters[i].kind == F_OLD ? 2 : 1,
+			sd, raw / sd, group_delay(&filters[i]));
+	}
+	return 0;
+}
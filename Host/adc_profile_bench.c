@@ -0,0 +1,283 @@
+/*
+	adc_profile_bench: 10 bit vs. fast 8 bit ADC profile (ADC_8BIT in
+	XE_V3/function.h and MCR/XE/helper.h).
+
+	usage: adc_profile_bench [-b baseline] [recording] [extra_noise_lsb]
+
+	Scan time: a conversion is 13 ADC clocks, plus the CPU time per
+	frame measured by avr_bench (-b, default avr_bench.baseline): MCR
+	read_sensor() is a whole polled frame (cases mcr and mcr8), ITCar
+	ADC_vect runs once per channel (itcar and itcar8, the longest run,
+	plus the 4 cycle interrupt response) before it starts the next
+	conversion.
+
+	Misclassification: every frame of the recording is thresholded the way
+	the firmware does it (threshold = (white + black) / 2 * vach_xam from
+	the min/max of the recording) once at 10 bit and once at 8 bit
+	(ADCH = raw >> 2, calibration at 8 bit). extra_noise_lsb adds gaussian
+	noise (in 10 bit LSB) to the 8 bit conversion for the accuracy loss of
+	the faster ADC clock. The default, 1.5 LSB, is the datasheet's step
+	from 1.5 LSB absolute accuracy at a 200 kHz ADC clock to 3 LSB at
+	1 MHz, all of it at the 500 kHz of /32: on the safe side.
+
+	The recording is either a trace from the MCR car (MCR/XE/trace.h, 10
+	bit build; every frame of every run is used) or text, one frame per
+	line, 8 raw 10 bit values separated by blanks or commas ('#' starts a
+	comment). Without a file a synthetic sweep of the line across the bar
+	is used and the report says so.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#define F_CPU 16000000UL
+#define VACH_XAM_NUM 19
+#define VACH_XAM_DEN 20
+#define CONV_CLOCKS 13
+#define ISR_RESPONSE 4 //cycles from the flag to the vector, not in avr_bench's ADC_vect
+#define EXTRA_NOISE 1.5 //10 bit LSB, see above
+
+//trace records, as in trace_replay.c
+#define TRACE_SYNC 0x5A
+#define CONFIG_SIZE 37 //helper.h config_t
+#define TUNE_SIZE 16 //tune.h tune_t
+#define H_LEN (3 + 2 + CONFIG_SIZE + TUNE_SIZE + 1)
+#define D_LEN (3 + 7 + 1)
+#define F_LEN(adc8) (3 + 2 + 1 + ((adc8) ? 8 : 10) + 1)
+
+typedef struct {
+	uint16_t v[8];
+} frame_t;
+
+static frame_t *frames;
+static size_t n_frames, cap_frames;
+
+static void add_frame(const frame_t *f) {
+	if (n_frames == cap_frames) {
+		cap_frames = cap_frames ? cap_frames * 2 : 4096;
+		frames = realloc(frames, cap_frames * sizeof(frame_t));
+		if (!frames) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	frames[n_frames++] = *f;
+}
+
+static uint64_t rng = 0x2545f4914f6cdd1dULL;
+
+static double uniform(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return ((rng >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double gauss(void) {
+	return sqrt(-2.0 * log(uniform())) * cos(6.283185307179586 * uniform());
+}
+
+static int clamp10(double v) {
+	if (v < 0) return 0;
+	if (v > 1023) return 1023;
+	return (int)(v + 0.5);
+}
+
+static uint8_t sum(const uint8_t *p, int n) {
+	uint8_t s = 0;
+	
+	for (n -= 2; n > 0; n--) s += *++p; //every byte after the sync, the sum byte not
+	return s;
+}
+
+//the F records of every 10 bit run; -1 when there is no trace header
+static int load_trace(const uint8_t *buf, long n) {
+	int runs = 0, adc8 = 0;
+	long skipped = 0;
+	
+	for (long p = 0; p < n; ) {
+		int len = 0;
+		
+		if (buf[p] == TRACE_SYNC && p + 3 < n) {
+			if (buf[p + 1] == 'H') len = H_LEN;
+			else if (runs && buf[p + 1] == 'F') len = F_LEN(adc8);
+			else if (runs && buf[p + 1] == 'D') len = D_LEN;
+			if (len && (p + len > n || sum(buf + p, len) != buf[p + len - 1])) len = 0;
+		}
+		if (!len) { //resync on the next sync byte
+			p++;
+			continue;
+		}
+		if (buf[p + 1] == 'H') {
+			runs++;
+			adc8 = buf[p + 3] & 1;
+		} else if (buf[p + 1] == 'F' && adc8) {
+			skipped++;
+		} else if (buf[p + 1] == 'F') {
+			const uint8_t *r = buf + p + 3;
+			uint16_t hi = r[11] | r[12] << 8;
+			frame_t f;
+			for (int i = 0; i < 8; i++) f.v[i] = r[3 + i] | (hi >> (2 * i) & 3) << 8;
+			add_frame(&f);
+		}
+		p += len;
+	}
+	if (skipped)
+		printf("%ld frames of ADC_8BIT runs skipped, they have no 10 bit conversion to compare with\n", skipped);
+	return runs ? 0 : -1;
+}
+
+static int load(const char *path) {
+	FILE *fp = fopen(path, "rb");
+	uint8_t *buf;
+	char *line, *next;
+	long n;
+	
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	n = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	buf = malloc(n + 1);
+	if (!buf || fread(buf, 1, n, fp) != (size_t)n) {
+		perror(path);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	if (load_trace(buf, n) == 0) {
+		free(buf);
+		return 0;
+	}
+	buf[n] = 0;
+	for (line = (char *)buf; *line; line = next) {
+		frame_t f;
+		char *p = line, *end;
+		int n = 0;
+		
+		next = line + strcspn(line, "\n");
+		if (*next) *next++ = 0;
+		if ((end = strchr(line, '#')) != NULL) *end = 0;
+		while (n < 8) {
+			long v;
+			while (*p == ' ' || *p == '\t' || *p == ',') p++;
+			v = strtol(p, &end, 10);
+			if (end == p) break;
+			f.v[n++] = (uint16_t)(v < 0 ? 0 : v > 1023 ? 1023 : v);
+			p = end;
+		}
+		if (n == 8) add_frame(&f);
+	}
+	free(buf);
+	return 0;
+}
+
+//cycles of one avr_bench case, -1 when the baseline does not have it
+static long bench_cycles(const char *path, const char *fw, const char *name) {
+	char line[160], f[16], c[48];
+	long cycles = -1, v;
+	FILE *fp = fopen(path, "r");
+	
+	if (!fp) return -1;
+	while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "%15s %47s %ld", f, c, &v) == 3 && !strcmp(f, fw) && !strcmp(c, name)) cycles = v;
+	fclose(fp);
+	return cycles;
+}
+
+/* white line (low adc) about one sensor pitch wide sweeping across the bar */
+static void synthesize(void) {
+	const double white = 180, black = 820, sigma = 6;
+	
+	for (int n = 0; n < 20000; n++) {
+		frame_t f;
+		double pos = 4.5 * sin(n * 0.0021) + 0.3 * sin(n * 0.037);
+		for (int i = 0; i < 8; i++) {
+			double d = (i - 3.5) - pos;
+			double cover = exp(-d * d / (2 * 0.45 * 0.45));
+			f.v[i] = clamp10(black - (black - white) * cover + gauss() * sigma);
+		}
+		add_frame(&f);
+	}
+}
+
+static void thresholds(int shift, uint16_t thr[8]) {
+	for (int i = 0; i < 8; i++) {
+		uint16_t lo = 0xffff, hi = 0;
+		for (size_t n = 0; n < n_frames; n++) {
+			uint16_t v = frames[n].v[i] >> shift;
+			if (v < lo) lo = v;
+			if (v > hi) hi = v;
+		}
+		thr[i] = (uint16_t)((lo + hi) / 2 * VACH_XAM_NUM / VACH_XAM_DEN);
+	}
+}
+
+static void scan_time(const char *baseline, const char *name, const char *fw, const char *bench_case,
+	int prescaler, int per_channel) {
+	long cycles = bench_cycles(baseline, fw, bench_case);
+	long conv = CONV_CLOCKS * prescaler, frame;
+	
+	if (cycles < 0) {
+		printf("  %-36s no %s %s in %s (make avr_bench_baseline)\n", name, fw, bench_case, baseline);
+		return;
+	}
+	frame = per_channel ? 8 * (conv + cycles + ISR_RESPONSE) : cycles;
+	printf("  %-36s ADC %4lu kHz  %6.1f us/conv  %5ld CPU cycles  %7.1f us/frame\n", name,
+		F_CPU / prescaler / 1000, conv / (F_CPU / 1e6), frame - 8 * conv, frame / (F_CPU / 1e6));
+}
+
+int main(int argc, char **argv) {
+	const char *baseline = "avr_bench.baseline";
+	double extra_noise;
+	uint16_t thr10[8], thr8[8];
+	size_t bits = 0, wrong = 0, wrong_frames = 0;
+	
+	if (argc > 2 && !strcmp(argv[1], "-b")) {
+		baseline = argv[2];
+		argv += 2;
+		argc -= 2;
+	}
+	extra_noise = argc > 2 ? atof(argv[2]) : EXTRA_NOISE;
+	if (argc > 1) {
+		if (load(argv[1]) < 0) return 1;
+		printf("recording: %s, %zu frames\n", argv[1], n_frames);
+	} else {
+		synthesize();
+		printf("recording: none given, SYNTHETIC sweep, %zu frames\n", n_frames);
+	}
+	if (n_frames == 0) {
+		fprintf(stderr, "no frames\n");
+		return 1;
+	}
+	
+	printf("\nscan time per 8 channel frame, CPU cycles from %s\n", baseline);
+	scan_time(baseline, "MCR read_sensor(), 10 bit, /128", "mcr", "read_sensor()", 128, 0);
+	scan_time(baseline, "MCR read_sensor(), 8 bit ADCH, /32", "mcr8", "read_sensor()", 32, 0);
+	scan_time(baseline, "ITCar ADC_vect, 10 bit, /128", "itcar", "ADC_vect", 128, 1);
+	scan_time(baseline, "ITCar ADC_vect, 8 bit ADCH, /32", "itcar8", "ADC_vect", 32, 1);
+	
+	thresholds(0, thr10);
+	thresholds(2, thr8);
+	for (size_t n = 0; n < n_frames; n++) {
+		uint8_t b10 = 0, b8 = 0;
+		for (int i = 0; i < 8; i++) {
+			uint16_t raw = frames[n].v[i];
+			uint16_t raw8 = (uint16_t)clamp10(raw + (extra_noise > 0 ? gauss() * extra_noise : 0)) >> 2;
+			if (raw < thr10[i]) b10 |= 1 << i;
+			if (raw8 < thr8[i]) b8 |= 1 << i;
+		}
+		for (uint8_t d = b10 ^ b8; d; d &= d - 1) wrong++;
+		if (b10 != b8) wrong_frames++;
+		bits += 8;
+	}
+	printf("\nthreshold misclassification, 8 bit vs 10 bit (extra noise %.2f LSB)\n", extra_noise);
+	printf("  bits   %zu / %zu  (%.4f %%)\n", wrong, bits, 100.0 * wrong / bits);
+	printf("  frames %zu / %zu  (%.4f %%)\n", wrong_frames, n_frames, 100.0 * wrong_frames / n_frames);
+	return 0;
+}
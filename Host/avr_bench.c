@@ -0,0 +1,403 @@
+/*
+	avr_bench: cycles, stack depth and flash size of the firmware hot paths
+	on the ATmega16(A), from the bench_* harnesses run under simavr.
+
+	A harness is a firmware built as for the race (its Release flags)
+	with its own main(): the firmware's init, interrupts off, then each
+	case between bench_begin("name") and bench_end() (avr_bench.h). The
+	runner steps the simulated AVR one instruction at a time. From the
+	entry of bench_begin() to the entry of bench_end() it counts cycles
+	and keeps the lowest stack pointer, and it takes the function's size
+	from the ELF symbol table (the case name up to '('). The marker calls
+	themselves are measured by the empty first case and taken off.
+
+	cycles  the call through the function pointer, the argument setup
+	        and the whole function with its callees, exact to the cycle
+	stack   bytes below the caller's stack pointer, return address
+	        included
+	flash   bytes of the function's own code, callees not included; an
+	        inline function is its out of line copy
+
+	Interrupts taken outside the cases (bench_interrupts() in the
+	harness) are cases too, one per vector, named after it
+	("TIMER0_COMP_vect"): the longest run from the vector to the end of
+	reti, the 4 cycle interrupt response not included, the deepest stack
+	from the interrupted code's stack pointer down, and the size of the
+	handler (__vector_N).
+
+	ADC inputs for the whole run: the line under sensors 3 and 4
+	(channels 3 and 4 at 0.8 V, the others at 4 V, AVCC 5 V).
+
+	usage: avr_bench [-b baseline] [-u] [-m mcu] bench_mcr.elf...
+	  -b file  baseline (default avr_bench.baseline)
+	  -u       write the results into the baseline
+	  -m mcu   simavr core (default from the ELF, else atmega16)
+
+	Every result is printed next to its baseline; exit status 1 when a
+	number went up. The simulator is exact, so any difference is real:
+	the commit that makes it updates the baseline with -u.
+
+	The baseline keeps the compiler of each firmware (the ELF's .comment,
+	"# mcr built with ..."). Another compiler's code is not compared, its
+	cases print "other compiler" and never fail the run; -u takes them.
+	No baseline is committed yet: the first make avr_bench_baseline with
+	avr-gcc and simavr records it. Until then every case is "new" and
+	the run says on stderr that nothing was compared.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gelf.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_adc.h>
+
+#define MAX_CASES 256
+#define NAME_LEN 48
+#define CC_LEN 64
+#define F_CPU_HZ 16000000
+#define RUN_CYCLES (F_CPU_HZ * 10ULL) /* a harness still running after 10 s is stuck in a wait loop */
+#define VECTORS 21 /* ATmega16, reset included, 2 words each */
+
+typedef struct Result {
+	char fw[16], name[NAME_LEN], cc[CC_LEN];
+	uint32_t cycles, stack, flash;
+} result_t;
+
+typedef struct Sym {
+	char *name;
+	uint32_t addr, size;
+} sym_t;
+
+static const uint32_t adc_mv[8] = { 4000, 4000, 4000, 800, 800, 4000, 4000, 4000 };
+
+static const char *const vector_name[VECTORS] = {
+	"RESET", "INT0", "INT1", "TIMER2_COMP", "TIMER2_OVF", "TIMER1_CAPT", "TIMER1_COMPA",
+	"TIMER1_COMPB", "TIMER1_OVF", "TIMER0_OVF", "SPI_STC", "USART_RXC", "USART_UDRE",
+	"USART_TXC", "ADC", "EE_RDY", "ANA_COMP", "TWI", "INT2", "TIMER0_COMP", "SPM_RDY"
+};
+
+static result_t res[MAX_CASES], base[MAX_CASES];
+static int n_res, n_base;
+static sym_t *sym;
+static int n_sym;
+static char cc[CC_LEN];
+
+/* the compiler's string in .comment, the linker's ("Linker: ...") skipped */
+static void get_cc(Elf_Data *d)
+{
+	const char *p = d->d_buf, *end = p + d->d_size;
+
+	for (; p < end; p += strlen(p) + 1)
+		if (*p && strncmp(p, "Linker:", 7)) {
+			snprintf(cc, sizeof cc, "%s", p);
+			return;
+		}
+}
+
+/* function symbols and compiler of the ELF */
+static int load_syms(const char *file)
+{
+	Elf *e;
+	Elf_Scn *scn = NULL;
+	GElf_Shdr sh;
+	size_t shstr;
+	int fd, i, n;
+
+	n_sym = 0;
+	snprintf(cc, sizeof cc, "unknown");
+	elf_version(EV_CURRENT);
+	if ((fd = open(file, O_RDONLY)) < 0) return -1;
+	if (!(e = elf_begin(fd, ELF_C_READ, NULL)) || elf_getshdrstrndx(e, &shstr)) {
+		if (e) elf_end(e);
+		close(fd);
+		return -1;
+	}
+	while ((scn = elf_nextscn(e, scn))) {
+		Elf_Data *d;
+
+		gelf_getshdr(scn, &sh);
+		if (sh.sh_type == SHT_PROGBITS && !strcmp(elf_strptr(e, shstr, sh.sh_name), ".comment"))
+			get_cc(elf_getdata(scn, NULL));
+		if (sh.sh_type != SHT_SYMTAB) continue;
+		d = elf_getdata(scn, NULL);
+		n = sh.sh_size / sh.sh_entsize;
+		sym = realloc(sym, sizeof(sym_t) * (n_sym + n));
+		for (i = 0; i < n; i++) {
+			GElf_Sym s;
+
+			gelf_getsym(d, i, &s);
+			if (GELF_ST_TYPE(s.st_info) != STT_FUNC) continue;
+			sym[n_sym].name = strdup(elf_strptr(e, sh.sh_link, s.st_name));
+			sym[n_sym].addr = s.st_value;
+			sym[n_sym].size = s.st_size;
+			n_sym++;
+		}
+	}
+	elf_end(e);
+	close(fd);
+	return 0;
+}
+
+/* by C name, or its C++ mangled name: _Z<len><name><parameters> */
+static const sym_t *find_sym(const char *name, int len)
+{
+	char z[NAME_LEN + 8];
+	int i;
+
+	snprintf(z, sizeof z, "_Z%d%.*s", len, len, name);
+	for (i = 0; i < n_sym; i++)
+		if (((int)strlen(sym[i].name) == len && !strncmp(sym[i].name, name, len)) || !strncmp(sym[i].name, z, strlen(z)))
+			return &sym[i];
+	return NULL;
+}
+
+static int bench(const char *file, const char *mcu)
+{
+	elf_firmware_t fw;
+	avr_t *avr;
+	const sym_t *b, *e, *f;
+	const char *p;
+	char fw_name[16], name[NAME_LEN];
+	uint64_t c0 = 0, overhead = 0;
+	uint16_t sp, sp0 = 0, sp_min = 0, isp0 = 0;
+	uint32_t isr_cycles[VECTORS] = { 0 }, isr_stack[VECTORS] = { 0 };
+	uint64_t i0 = 0;
+	int in = 0, isr = 0, state, i;
+
+	p = strrchr(file, '/');
+	p = p ? p + 1 : file;
+	if (!strncmp(p, "bench_", 6)) p += 6;
+	snprintf(fw_name, sizeof fw_name, "%.*s", (int)strcspn(p, "."), p);
+
+	memset(&fw, 0, sizeof fw);
+	if (elf_read_firmware(file, &fw) || load_syms(file)) {
+		fprintf(stderr, "avr_bench: cannot read %s\n", file);
+		return -1;
+	}
+	if (!(b = find_sym("bench_begin", 11)) || !(e = find_sym("bench_end", 9))) {
+		fprintf(stderr, "avr_bench: %s has no bench_begin()/bench_end()\n", file);
+		return -1;
+	}
+	if (!mcu) mcu = fw.mmcu[0] ? fw.mmcu : "atmega16";
+	if (!(avr = avr_make_mcu_by_name(mcu)) && !(avr = avr_make_mcu_by_name("atmega16"))) {
+		fprintf(stderr, "avr_bench: no simavr core for %s\n", mcu);
+		return -1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &fw);
+	avr->frequency = F_CPU_HZ;
+	avr->vcc = avr->avcc = avr->aref = 5000;
+	for (i = 0; i < 8; i++) avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0 + i), adc_mv[i]);
+
+	do {
+		state = avr_run(avr);
+		sp = avr->data[R_SPL] | avr->data[R_SPH] << 8;
+		if (avr->pc == b->addr) {
+			uint16_t a = avr->data[24] | avr->data[25] << 8; /* name_P, flash address */
+
+			for (i = 0; i < NAME_LEN - 1 && (name[i] = avr->flash[a + i]); i++);
+			name[i] = 0;
+			c0 = avr->cycle;
+			sp0 = sp_min = sp + 2; /* the caller's, bench_begin()'s return address off */
+			in = 1;
+		} else if (avr->pc == e->addr && in) {
+			result_t *r = &res[n_res];
+
+			in = 0;
+			if (!name[0]) {
+				overhead = avr->cycle - c0;
+				continue;
+			}
+			if (n_res == MAX_CASES) break;
+			snprintf(r->fw, sizeof r->fw, "%s", fw_name);
+			snprintf(r->name, sizeof r->name, "%s", name);
+			snprintf(r->cc, sizeof r->cc, "%s", cc);
+			r->cycles = avr->cycle - c0 - overhead;
+			r->stack = sp0 - sp_min;
+			f = find_sym(name, strcspn(name, "("));
+			r->flash = f ? f->size : 0;
+			n_res++;
+		} else if (in && sp < sp_min) {
+			sp_min = sp;
+		} else if (!in && !isr && avr->pc && avr->pc < VECTORS * 4 && !(avr->pc & 3)) {
+			/* only an interrupt lands on a vector */
+			isr = avr->pc / 4;
+			i0 = avr->cycle;
+			isp0 = sp_min = sp + 2; /* the interrupted code's */
+		} else if (isr && sp == isp0) {
+			if (avr->cycle - i0 > isr_cycles[isr]) isr_cycles[isr] = avr->cycle - i0;
+			if ((uint32_t)(isp0 - sp_min) > isr_stack[isr]) isr_stack[isr] = isp0 - sp_min;
+			isr = 0;
+		} else if (isr && sp < sp_min) {
+			sp_min = sp;
+		}
+	} while (state != cpu_Done && state != cpu_Crashed && avr->cycle < RUN_CYCLES);
+
+	for (i = 1; i < VECTORS && n_res < MAX_CASES; i++) {
+		result_t *r = &res[n_res];
+		char vec[16];
+
+		if (!isr_cycles[i]) continue;
+		snprintf(r->fw, sizeof r->fw, "%s", fw_name);
+		snprintf(r->name, sizeof r->name, "%s_vect", vector_name[i]);
+		snprintf(r->cc, sizeof r->cc, "%s", cc);
+		r->cycles = isr_cycles[i];
+		r->stack = isr_stack[i];
+		snprintf(vec, sizeof vec, "__vector_%d", i);
+		f = find_sym(vec, strlen(vec));
+		r->flash = f ? f->size : 0;
+		n_res++;
+	}
+
+	if (state == cpu_Crashed || avr->cycle >= RUN_CYCLES) {
+		fprintf(stderr, "avr_bench: %s %s at pc %04x in case \"%s\"\n", file,
+			state == cpu_Crashed ? "crashed" : "did not finish", (unsigned)avr->pc, in ? name : "");
+		avr_terminate(avr);
+		return -1;
+	}
+	avr_terminate(avr);
+	return 0;
+}
+
+static int load_baseline(const char *file)
+{
+	char line[160], fw[16], built[8][16 + CC_LEN];
+	FILE *f;
+	int n_built = 0, i, j, k;
+
+	if (!(f = fopen(file, "r"))) return -1;
+	while (fgets(line, sizeof line, f) && n_base < MAX_CASES) {
+		result_t *r = &base[n_base];
+
+		line[strcspn(line, "\n")] = 0;
+		if (line[0] == '#') {
+			k = 0;
+			if (n_built < 8 && sscanf(line, "# %15s built with %n", fw, &k) == 1 && k)
+				snprintf(built[n_built++], sizeof built[0], "%s %s", fw, line + k);
+			continue;
+		}
+		if (sscanf(line, "%15s %47s %u %u %u", r->fw, r->name, &r->cycles, &r->stack, &r->flash) == 5) n_base++;
+	}
+	fclose(f);
+	for (i = 0; i < n_base; i++) {
+		snprintf(base[i].cc, sizeof base[i].cc, "unknown");
+		for (j = 0; j < n_built; j++) {
+			k = strlen(base[i].fw);
+			if (!strncmp(built[j], base[i].fw, k) && built[j][k] == ' ')
+				snprintf(base[i].cc, sizeof base[i].cc, "%s", built[j] + k + 1);
+		}
+	}
+	return 0;
+}
+
+static const result_t *find_base(const result_t *r)
+{
+	int i;
+
+	for (i = 0; i < n_base; i++)
+		if (!strcmp(base[i].fw, r->fw) && !strcmp(base[i].name, r->name)) return &base[i];
+	return NULL;
+}
+
+/* results replace their baseline entries, the other firmwares' stay */
+static int save_baseline(const char *file)
+{
+	FILE *f;
+	int i, j;
+
+	if (!(f = fopen(file, "w"))) {
+		perror(file);
+		return -1;
+	}
+	fprintf(f, "# avr_bench baseline: firmware case cycles stack flash\n");
+	for (i = 0; i < n_base; i++) {
+		for (j = 0; j < n_res; j++)
+			if (!strcmp(base[i].fw, res[j].fw)) break;
+		if (j == n_res && (!i || strcmp(base[i].fw, base[i - 1].fw)))
+			fprintf(f, "# %s built with %s\n", base[i].fw, base[i].cc);
+	}
+	for (j = 0; j < n_res; j++)
+		if (!j || strcmp(res[j].fw, res[j - 1].fw)) fprintf(f, "# %s built with %s\n", res[j].fw, res[j].cc);
+	for (i = 0; i < n_base; i++) {
+		for (j = 0; j < n_res; j++)
+			if (!strcmp(base[i].fw, res[j].fw)) break;
+		if (j == n_res)
+			fprintf(f, "%s %s %u %u %u\n", base[i].fw, base[i].name, base[i].cycles, base[i].stack, base[i].flash);
+	}
+	for (j = 0; j < n_res; j++)
+		fprintf(f, "%s %s %u %u %u\n", res[j].fw, res[j].name, res[j].cycles, res[j].stack, res[j].flash);
+	fclose(f);
+	return 0;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: avr_bench [-b baseline] [-u] [-m mcu] bench.elf...\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	const char *base_file = "avr_bench.baseline", *mcu = NULL;
+	int i, update = 0, worse = 0, files = 0;
+
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+
+		if (a[0] != '-') {
+			files++;
+			continue;
+		}
+		if (a[1] == 'u') { update = 1; continue; }
+		if (i + 1 >= argc) return usage();
+		switch (a[1]) {
+		case 'b': base_file = argv[++i]; break;
+		case 'm': mcu = argv[++i]; break;
+		default: return usage();
+		}
+	}
+	if (!files) return usage();
+
+	if (load_baseline(base_file) && !update)
+		fprintf(stderr, "avr_bench: no baseline %s, nothing compared (make avr_bench_baseline records one)\n", base_file);
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] != '-') {
+			if (bench(argv[i], mcu)) return 2;
+			continue;
+		}
+		if (argv[i][1] != 'u') i++;
+	}
+
+	printf("%-8s %-24s %8s %6s %6s   %s\n", "fw", "case", "cycles", "stack", "flash", "against the baseline");
+	for (i = 0; i < n_res; i++) {
+		const result_t *r = &res[i], *o = find_base(r);
+
+		printf("%-8s %-24s %8u %6u %6u   ", r->fw, r->name, r->cycles, r->stack, r->flash);
+		if (!o) {
+			printf("new\n");
+			continue;
+		}
+		if (strcmp(r->cc, o->cc)) {
+			printf("other compiler\n");
+			continue;
+		}
+		if (r->cycles == o->cycles && r->stack == o->stack && r->flash == o->flash) {
+			printf("=\n");
+			continue;
+		}
+		printf("%+d cycles %+d stack %+d flash\n", (int)(r->cycles - o->cycles), (int)(r->stack - o->stack), (int)(r->flash - o->flash));
+		if (r->cycles > o->cycles || r->stack > o->stack || r->flash > o->flash) worse = 1;
+	}
+	for (i = 0; i < n_res; i++) {
+		const result_t *o = find_base(&res[i]);
+
+		if (o && strcmp(res[i].cc, o->cc) && (!i || strcmp(res[i].fw, res[i - 1].fw)))
+			printf("%s: baseline built with %s, this ELF with %s\n", res[i].fw, o->cc, res[i].cc);
+	}
+	if (update) return save_baseline(base_file) ? 2 : 0;
+	return worse;
+}
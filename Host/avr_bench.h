@@ -0,0 +1,56 @@
+/*
+	Markers for avr_bench.c, included by the bench_* harnesses (AVR side,
+	never by the firmware).
+
+	BENCH("name(args)", call) runs call between bench_begin() and
+	bench_end(); the runner stops on their entries and counts cycles and
+	stack in between. The name lives in flash, the part up to '(' is the
+	function whose size is looked up. The hot functions are called through
+	volatile pointers (BENCH_FN) so the harness cannot inline or constant
+	fold them: what is measured is the function's own body with the inputs
+	the case gives it.
+*/
+
+#ifndef AVR_BENCH_H_
+#define AVR_BENCH_H_
+
+#include <stdint.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void __attribute__((noinline, noclone, used)) bench_begin(const char *name_P)
+{
+	__asm__ volatile ("" :: "r" (name_P));
+}
+
+void __attribute__((noinline, noclone, used)) bench_end(void)
+{
+	__asm__ volatile ("");
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+volatile int16_t bench_sink; /* results land here so no call is dropped */
+
+#define BENCH_FN(ret, fn, args) static ret (*volatile bench_##fn) args = fn
+#define BENCH(name, call) do { bench_begin(PSTR(name)); call; bench_end(); } while (0)
+
+/* the empty case first, the runner takes its cycles off every other case */
+#define bench_start() BENCH("", )
+
+/* the firmware's interrupts on for ms milliseconds, its timers as init()
+   set them; the runner times every interrupt taken (needs util/delay.h,
+   which the firmware includes) */
+#define bench_interrupts(ms) do { sei(); _delay_ms(ms); cli(); } while (0)
+
+/* sleep with interrupts off: simavr ends the run */
+#define bench_done() do { cli(); sleep_enable(); sleep_cpu(); } while (0)
+
+#endif /* AVR_BENCH_H_ */
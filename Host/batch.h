@@ -0,0 +1,109 @@
+/*
+	Batch simulator core: many MCR cars on one track at once.
+
+	Every car is a structure of arrays entry, one array per field, and
+	batch_kernel.c steps W of them as lanes with the same instructions:
+	W = 8 in the AVX2 build, 1 in the scalar build. Both builds run the same operation
+	sequence on IEEE floats and exact integers and give the same results
+	bit for bit. The world is track_sim.c's (car model, sensors, encoder,
+	off track and lap rules) with the track prepared as grids (below). The
+	firmware is a port of the MCR control task: each lane runs its own
+	profile through the pattern state machine, the analog line position,
+	calc_cte(), pid_Controller(), calc_motor_speed() and fwd(), with the
+	blocking manoeuvres of special_cases.h as states of their own.
+
+	Differences from sim_mcr, which runs the firmware itself:
+	- the control task reads its frame every second tick (sched.h runs it
+	  every 2 ms), the manoeuvres one frame a tick (0.83 ms on the car);
+	  all 8 channels at the pose of the tick
+	- the run starts at pid_start(): no power-on menus, and the calibration
+	  is the one the servo sweep would find (lo/hi = line/floor level
+	  -/+ 2 noise sigma, LINE their mean)
+	- the track is a grid of the nearest path segment (BATCH_SEG_CELL)
+	  and one of line cover (BATCH_COVER_CELL, bilinear), so a track that
+	  crosses itself is not supported
+*/
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdint.h>
+
+#define BATCH_DT 0.001f
+#define BATCH_SEG_CELL 4.0f /* mm */
+#define BATCH_COVER_CELL 2.0f
+#define BATCH_BAND 460.0f /* segment grid reaches this far from the path, past LOST_MM */
+
+#define BATCH_RUNNING 0
+#define BATCH_DONE 1
+#define BATCH_LOST 2
+#define BATCH_STOPPED 3
+#define BATCH_LIMIT 4
+
+/* per lane: float fields, int32 fields, 8 channel fields */
+#define BATCH_F(X) \
+	X(x) X(y) X(h) /* rear axle mm, heading rad (left positive) */ \
+	X(vl) X(vr) X(delta) /* wheel speeds m/s, steering degrees (right positive) */ \
+	X(enc_frac) /* wheel travel since the last encoder edge, mm */ \
+	X(ax) X(ay) X(asin) X(acos) /* sensor arm centre and direction */ \
+	X(s) X(err) /* rear axle path position (unwrapped), arm distance from the path */ \
+	X(t_lap) X(lap_sum) X(stall_t) X(max_err) X(sum_err) X(t_end)
+#define BATCH_I(X) \
+	X(rng) X(line) X(ready) X(enc) /* noise, LINE, calibration good for line_pos, encoder */ \
+	X(state) X(last_cte) X(off_lane) X(switch_lane) X(turn90) X(no_line) \
+	X(confirm_start) X(confirm_len) X(timeout) X(line_pos) \
+	X(pid_sum) X(pid_last) X(servo) X(spd_l) X(spd_r) X(ocr_l) X(ocr_r) \
+	X(mspeed) X(m) X(kp) X(ki) X(kd) X(max_error) X(max_sum) X(sl_angle) X(nl_angle) \
+	X(tick) X(started) X(laps) X(off) X(lane) X(off_events) X(err_n) X(end)
+#define BATCH_FC(X) X(gain)
+#define BATCH_IC(X) X(iir) X(lo) X(hi) X(lgain)
+
+typedef struct Batch_car {
+	float wheelbase, track, arm, spacing; /* mm */
+	float vmax, tau; /* m/s at 100 % duty, s */
+	float servo_max, servo_rate; /* degrees at servo(150), degrees/s */
+	float slip, pivot;
+	float enc_mm;
+	float floor_adc, line_adc, noise; /* 10 bit */
+} batch_car_t;
+
+typedef struct Batch_track {
+	float x0, y0; /* grid origin, mm */
+	int seg_nx, seg_ny;
+	int32_t *seg; /* nearest segment per BATCH_SEG_CELL cell, -1 past BATCH_BAND */
+	int cover_nx, cover_ny;
+	uint8_t *cover; /* line under a sensor footprint, 0..255, 3 bytes of padding for gathers */
+	int nseg;
+	float *sx, *sy, *sux, *suy, *slen, *ss; /* segments as in track.h */
+	int32_t *skind;
+	float len;
+	int closed;
+} batch_track_t;
+
+typedef struct Batch {
+	int n; /* cars */
+#define X(f) float *f;
+	BATCH_F(X)
+#undef X
+#define X(f) int32_t *f;
+	BATCH_I(X)
+#undef X
+#define X(f) float *f[8];
+	BATCH_FC(X)
+#undef X
+#define X(f) int32_t *f[8];
+	BATCH_IC(X)
+#undef X
+	const batch_track_t *trk;
+	batch_car_t car;
+	int laps_wanted;
+	float off_mm;
+	uint32_t limit_ms;
+} batch_t;
+
+/* every car from its start to the end of its run: W lanes, a lane takes
+   the next car as soon as its own is done */
+void batch_run_scalar(batch_t *b);
+void batch_run_avx2(batch_t *b);
+
+#endif /* BATCH_H_ */
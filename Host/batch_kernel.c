@@ -0,0 +1,764 @@
+/*
+	batch_kernel: the lane step of batch.h, built twice by the Makefile,
+	plain (W = 1, batch_run_scalar) and with -mavx2 -DBATCH_AVX2 (W = 8,
+	batch_run_avx2). Everything below the lane operations is written once
+	for both: a branch of the firmware becomes a lane mask, every lane
+	computes both sides and keeps its own.
+
+	Floats are IEEE single without contraction (-ffp-contract=off), sin
+	and cos are the same polynomial in both builds and the integer
+	divisions are exact (float quotient, then corrected), so the two
+	builds give the same results bit for bit.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "batch.h"
+
+#ifdef BATCH_AVX2
+#include <immintrin.h>
+
+#define W 8
+#define batch_run batch_run_avx2
+
+typedef __m256 vf;
+typedef __m256i vi; /* int32 lanes; masks are 0 or -1 */
+
+static inline vf f_set(float a) { return _mm256_set1_ps(a); }
+static inline vf f_load(const float *p) { return _mm256_loadu_ps(p); }
+static inline void f_store(float *p, vf a) { _mm256_storeu_ps(p, a); }
+static inline vf f_add(vf a, vf b) { return _mm256_add_ps(a, b); }
+static inline vf f_sub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+static inline vf f_mul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+static inline vf f_div(vf a, vf b) { return _mm256_div_ps(a, b); }
+static inline vf f_min(vf a, vf b) { return _mm256_min_ps(a, b); }
+static inline vf f_max(vf a, vf b) { return _mm256_max_ps(a, b); }
+static inline vf f_floor(vf a) { return _mm256_floor_ps(a); }
+static inline vf f_abs(vf a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline vi f_lt(vf a, vf b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+static inline vi f_le(vf a, vf b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+static inline vf f_sel(vi m, vf a, vf b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(m)); }
+static inline vf f_from_i(vi a) { return _mm256_cvtepi32_ps(a); }
+static inline vi i_from_f(vf a) { return _mm256_cvttps_epi32(a); }
+static inline vf f_gather(const float *p, vi i) { return _mm256_i32gather_ps(p, i, 4); }
+
+static inline vi i_set(int32_t a) { return _mm256_set1_epi32(a); }
+static inline vi i_load(const int32_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline void i_store(int32_t *p, vi a) { _mm256_storeu_si256((__m256i *)p, a); }
+static inline vi i_add(vi a, vi b) { return _mm256_add_epi32(a, b); }
+static inline vi i_sub(vi a, vi b) { return _mm256_sub_epi32(a, b); }
+static inline vi i_mul(vi a, vi b) { return _mm256_mullo_epi32(a, b); }
+static inline vi i_and(vi a, vi b) { return _mm256_and_si256(a, b); }
+static inline vi i_or(vi a, vi b) { return _mm256_or_si256(a, b); }
+static inline vi i_xor(vi a, vi b) { return _mm256_xor_si256(a, b); }
+static inline vi i_andnot(vi a, vi b) { return _mm256_andnot_si256(b, a); } /* a & ~b */
+static inline vi i_shl(vi a, int n) { return _mm256_slli_epi32(a, n); }
+static inline vi i_shr(vi a, int n) { return _mm256_srli_epi32(a, n); }
+static inline vi i_sar(vi a, int n) { return _mm256_srai_epi32(a, n); }
+static inline vi i_eq(vi a, vi b) { return _mm256_cmpeq_epi32(a, b); }
+static inline vi i_gt(vi a, vi b) { return _mm256_cmpgt_epi32(a, b); }
+static inline vi i_min(vi a, vi b) { return _mm256_min_epi32(a, b); }
+static inline vi i_max(vi a, vi b) { return _mm256_max_epi32(a, b); }
+static inline vi i_sel(vi m, vi a, vi b) { return _mm256_blendv_epi8(b, a, m); }
+static inline vi i_gather(const int32_t *p, vi i) { return _mm256_i32gather_epi32((const int *)p, i, 4); }
+static inline vi i_gather4(const uint8_t *p, vi i) { return _mm256_i32gather_epi32((const int *)p, i, 1); } /* bytes i .. i + 3 */
+static inline int i_any(vi m) { return !_mm256_testz_si256(m, m); }
+
+#else
+
+#define W 1
+#define batch_run batch_run_scalar
+
+typedef float vf;
+typedef int32_t vi;
+
+static inline vf f_set(float a) { return a; }
+static inline vf f_load(const float *p) { return *p; }
+static inline void f_store(float *p, vf a) { *p = a; }
+static inline vf f_add(vf a, vf b) { return a + b; }
+static inline vf f_sub(vf a, vf b) { return a - b; }
+static inline vf f_mul(vf a, vf b) { return a * b; }
+static inline vf f_div(vf a, vf b) { return a / b; }
+static inline vf f_min(vf a, vf b) { return a < b ? a : b; } /* minps: b unless a < b */
+static inline vf f_max(vf a, vf b) { return a > b ? a : b; }
+static inline vf f_floor(vf a) { return __builtin_floorf(a); }
+static inline vf f_abs(vf a) { return __builtin_fabsf(a); }
+static inline vi f_lt(vf a, vf b) { return -(a < b); }
+static inline vi f_le(vf a, vf b) { return -(a <= b); }
+static inline vf f_sel(vi m, vf a, vf b) { return m ? a : b; }
+static inline vf f_from_i(vi a) { return (float)a; }
+static inline vi i_from_f(vf a) { return (int32_t)a; }
+static inline vf f_gather(const float *p, vi i) { return p[i]; }
+
+static inline vi i_set(int32_t a) { return a; }
+static inline vi i_load(const int32_t *p) { return *p; }
+static inline void i_store(int32_t *p, vi a) { *p = a; }
+static inline vi i_add(vi a, vi b) { return (int32_t)((uint32_t)a + (uint32_t)b); }
+static inline vi i_sub(vi a, vi b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+static inline vi i_mul(vi a, vi b) { return (int32_t)((uint32_t)a * (uint32_t)b); }
+static inline vi i_and(vi a, vi b) { return a & b; }
+static inline vi i_or(vi a, vi b) { return a | b; }
+static inline vi i_xor(vi a, vi b) { return a ^ b; }
+static inline vi i_andnot(vi a, vi b) { return a & ~b; }
+static inline vi i_shl(vi a, int n) { return (int32_t)((uint32_t)a << n); }
+static inline vi i_shr(vi a, int n) { return (int32_t)((uint32_t)a >> n); }
+static inline vi i_sar(vi a, int n) { return a >> n; }
+static inline vi i_eq(vi a, vi b) { return -(a == b); }
+static inline vi i_gt(vi a, vi b) { return -(a > b); }
+static inline vi i_min(vi a, vi b) { return a < b ? a : b; }
+static inline vi i_max(vi a, vi b) { return a > b ? a : b; }
+static inline vi i_sel(vi m, vi a, vi b) { return m ? a : b; }
+static inline vi i_gather(const int32_t *p, vi i) { return p[i]; }
+static inline vi i_gather4(const uint8_t *p, vi i) { int32_t v; memcpy(&v, p + i, 4); return v; }
+static inline int i_any(vi m) { return m != 0; }
+
+#endif
+
+/* ---- shared on top of the lane operations ---- */
+
+static inline vf f_neg(vf a) { return f_sub(f_set(0), a); }
+static inline vf f_clamp(vf a, float lo, float hi) { return f_min(f_max(a, f_set(lo)), f_set(hi)); }
+static inline vi i_not(vi a) { return i_xor(a, i_set(-1)); }
+static inline vi i_lt(vi a, vi b) { return i_gt(b, a); }
+static inline vi i_ge(vi a, vi b) { return i_not(i_gt(b, a)); }
+static inline vi i_le(vi a, vi b) { return i_not(i_gt(a, b)); }
+static inline vi i_ne(vi a, vi b) { return i_not(i_eq(a, b)); }
+static inline vi i_eqc(vi a, int32_t c) { return i_eq(a, i_set(c)); }
+static inline vi i_nz(vi a) { return i_ne(a, i_set(0)); }
+static inline vi i_neg(vi a) { return i_sub(i_set(0), a); }
+static inline vi i_abs(vi a) { return i_sel(i_lt(a, i_set(0)), i_neg(a), a); }
+static inline vi i_clamp(vi a, int32_t lo, int32_t hi) { return i_min(i_max(a, i_set(lo)), i_set(hi)); }
+static inline vi i_s16(vi a) { return i_sar(i_shl(a, 16), 16); } /* (int16_t) */
+static inline vi i_u16(vi a) { return i_and(a, i_set(0xffff)); } /* (uint16_t) */
+
+/* a / b truncated like C, b > 0, |a| < 2^24: the float quotient is off by at most one */
+static inline vi i_div(vi a, vi b)
+{
+	vi neg = i_lt(a, i_set(0)), u = i_abs(a), q, r;
+
+	q = i_from_f(f_div(f_from_i(u), f_from_i(b)));
+	r = i_sub(u, i_mul(q, b));
+	q = i_sel(i_lt(r, i_set(0)), i_sub(q, i_set(1)), q);
+	r = i_sub(u, i_mul(q, b));
+	q = i_sel(i_ge(r, b), i_add(q, i_set(1)), q);
+	return i_sel(neg, i_neg(q), q);
+}
+
+static inline vi i_divc(vi a, int32_t b) { return i_div(a, i_set(b)); }
+
+/* a / 2^n truncated like C, any a */
+static inline vi i_div2n(vi a, int n)
+{
+	return i_sar(i_add(a, i_and(i_sar(a, 31), i_set((1 << n) - 1))), n);
+}
+
+/* Cody-Waite reduction by pi/2 and the Cephes single precision polynomials */
+static void f_sincos(vf x, vf *s, vf *c)
+{
+	vf q = f_floor(f_add(f_mul(x, f_set(0.636619772f)), f_set(0.5f))), r, z, ps, pc;
+	vi qi = i_from_f(q), swap = i_nz(i_and(qi, i_set(1)));
+
+	r = f_sub(f_sub(f_sub(x, f_mul(q, f_set(1.5703125f))), f_mul(q, f_set(4.837512969970703125e-4f))),
+		f_mul(q, f_set(7.54978995489188216e-8f)));
+	z = f_mul(r, r);
+	ps = f_add(f_mul(f_mul(f_add(f_mul(f_add(f_mul(z, f_set(-1.9515295891e-4f)), f_set(8.3321608736e-3f)), z),
+		f_set(-1.6666654611e-1f)), z), r), r);
+	pc = f_add(f_sub(f_set(1), f_mul(z, f_set(0.5f))), f_mul(f_mul(z, z),
+		f_add(f_mul(f_add(f_mul(z, f_set(2.443315711809948e-5f)), f_set(-1.388731625493765e-3f)), z),
+		f_set(4.166664568298827e-2f))));
+	*s = f_sel(swap, pc, ps);
+	*c = f_sel(swap, ps, pc);
+	*s = f_sel(i_nz(i_and(qi, i_set(2))), f_neg(*s), *s);
+	*c = f_sel(i_nz(i_and(i_add(qi, i_set(1)), i_set(2))), f_neg(*c), *c);
+}
+
+/* ---- lanes ---- */
+
+#define ST_TRACE 0 /* control_task() states */
+#define ST_LEFT 1
+#define ST_RIGHT 2
+#define ST_CROSS 3
+#define ST_NOLINE 10
+#define ST_SWITCH 20 /* do_switch_lane() waiting for the next lane */
+#define ST_SEARCH 21 /* do_noline() */
+#define ST_TURN_L 22 /* do_90_left_turn(), waiting for the end of the line */
+#define ST_TURN_R 23
+#define ST_TURN_LB 24 /* turning, waiting for 0b00011000 */
+#define ST_TURN_RB 25
+#define ST_PARKED 30 /* f_timeout(), loop4ever() */
+
+#define MANOEUVRE_FRAMES 1000 /* TIMEOUT_CONST */
+#define HALFLINE_PULSES 60 /* distance.h */
+#define CROSSLINE_PULSES 120
+#define MAX_CTE 300
+#define PID_SPEED_RATIO 9830 /* Q15(0.3) */
+#define MAX_I_TERM (INT32_MAX / 2)
+#define LINE_MIN_WEIGHT 128 /* line_pos.h */
+#define LINE_FLOOR 32
+#define LINE_CTE_DIV 149
+#define SERVO_LOCK 900.0f /* servo(150) */
+#define LOST_MM 400.0f
+#define STALL_S 2.0f
+
+typedef struct Lanes {
+#define X(f) vf f;
+	BATCH_F(X)
+#undef X
+#define X(f) vi f;
+	BATCH_I(X)
+#undef X
+#define X(f) vf f[8];
+	BATCH_FC(X)
+#undef X
+#define X(f) vi f[8];
+	BATCH_IC(X)
+#undef X
+} lanes_t;
+
+typedef struct Frame {
+	vi bits; /* read_sensor() */
+	vi num, den, peak; /* calc_line_pos() sums */
+} frame_t;
+
+static vi rng_next(vi *r)
+{
+	vi x = *r;
+
+	x = i_xor(x, i_shl(x, 13));
+	x = i_xor(x, i_shr(x, 17));
+	x = i_xor(x, i_shl(x, 5));
+	*r = x;
+	return x;
+}
+
+static vf rnd(vi *r) /* uniform 0..1 */
+{
+	return f_mul(f_from_i(i_and(rng_next(r), i_set(0xffffff))), f_set(1.0f / 0x1000000));
+}
+
+/* line cover under the sensor footprint at (px, py), bilinear */
+static vf cover_at(const batch_track_t *t, vf px, vf py)
+{
+	vf gx = f_sub(f_div(f_sub(px, f_set(t->x0)), f_set(BATCH_COVER_CELL)), f_set(0.5f));
+	vf gy = f_sub(f_div(f_sub(py, f_set(t->y0)), f_set(BATCH_COVER_CELL)), f_set(0.5f));
+	vf fx = f_floor(gx), fy = f_floor(gy), c0, c1;
+	vi ix = i_from_f(fx), iy = i_from_f(fy), in, i, a, b;
+
+	in = i_and(i_and(i_ge(ix, i_set(0)), i_lt(ix, i_set(t->cover_nx - 1))),
+		i_and(i_ge(iy, i_set(0)), i_lt(iy, i_set(t->cover_ny - 1))));
+	i = i_and(i_add(i_mul(iy, i_set(t->cover_nx)), ix), in);
+	a = i_and(i_gather4(t->cover, i), in);
+	b = i_and(i_gather4(t->cover, i_add(i, i_set(t->cover_nx))), in);
+	fx = f_sub(gx, fx);
+	fy = f_sub(gy, fy);
+	c0 = f_add(f_from_i(i_and(a, i_set(0xff))),
+		f_mul(f_sub(f_from_i(i_and(i_shr(a, 8), i_set(0xff))), f_from_i(i_and(a, i_set(0xff)))), fx));
+	c1 = f_add(f_from_i(i_and(b, i_set(0xff))),
+		f_mul(f_sub(f_from_i(i_and(i_shr(b, 8), i_set(0xff))), f_from_i(i_and(b, i_set(0xff)))), fx));
+	return f_mul(f_add(c0, f_mul(f_sub(c1, c0), fy)), f_set(1.0f / 255));
+}
+
+/* projection on the nearest segment: s, n (left positive), kind; found = 0 past BATCH_BAND */
+static vi locate(const batch_track_t *t, vf px, vf py, vf *s, vf *n, vi *kind)
+{
+	vi ix = i_from_f(f_floor(f_div(f_sub(px, f_set(t->x0)), f_set(BATCH_SEG_CELL))));
+	vi iy = i_from_f(f_floor(f_div(f_sub(py, f_set(t->y0)), f_set(BATCH_SEG_CELL))));
+	vi in = i_and(i_and(i_ge(ix, i_set(0)), i_lt(ix, i_set(t->seg_nx))), i_and(i_ge(iy, i_set(0)), i_lt(iy, i_set(t->seg_ny))));
+	vi g = i_sel(in, i_gather(t->seg, i_and(i_add(i_mul(iy, i_set(t->seg_nx)), ix), in)), i_set(-1)), found;
+	vf rx, ry, ux, uy, f;
+
+	found = i_ge(g, i_set(0));
+	g = i_and(g, found);
+	rx = f_sub(px, f_gather(t->sx, g));
+	ry = f_sub(py, f_gather(t->sy, g));
+	ux = f_gather(t->sux, g);
+	uy = f_gather(t->suy, g);
+	f = f_add(f_mul(rx, ux), f_mul(ry, uy));
+	*n = f_sub(f_mul(ux, ry), f_mul(uy, rx));
+	f = f_min(f_max(f, f_set(0)), f_gather(t->slen, g));
+	*s = f_add(f_gather(t->ss, g), f);
+	*kind = i_gather(t->skind, g);
+	return found;
+}
+
+/* one read_sensor(): the conversions of lanes in m go through the filter */
+static void sense(const batch_t *b, lanes_t *L, vi m, frame_t *fr)
+{
+	const batch_car_t *c = &b->car;
+	vf level = f_sub(f_set(c->floor_adc), f_set(c->line_adc));
+	vi rng = L->rng;
+
+	fr->bits = fr->num = fr->den = fr->peak = i_set(0);
+	for (int k = 0; k < 8; k++) {
+		vf lat = f_set((k - 3.5f) * c->spacing), v, nz;
+		vf px = f_sub(L->ax, f_mul(L->asin, lat)), py = f_add(L->ay, f_mul(L->acos, lat));
+		vi x, st, raw, wt;
+
+		v = f_mul(f_sub(f_set(c->floor_adc), f_mul(cover_at(b->trk, px, py), level)), L->gain[k]);
+		nz = f_add(f_add(f_add(rnd(&rng), rnd(&rng)), rnd(&rng)), rnd(&rng));
+		v = f_add(v, f_mul(f_mul(f_set(c->noise), f_sub(nz, f_set(2))), f_set(1.73f)));
+		x = i_from_f(f_clamp(v, 0, 1023));
+
+		/* adc_iir_step(), shift 1 */
+		st = L->iir[k];
+		st = i_sel(i_eqc(st, 0xffff), i_shl(x, 1), i_u16(i_add(st, i_sub(x, i_shr(st, 1)))));
+		L->iir[k] = i_sel(m, st, L->iir[k]);
+		raw = i_shr(st, 1);
+		fr->bits = i_or(fr->bits, i_and(i_lt(raw, L->line), i_set(1 << k)));
+
+		/* line_weight() */
+		wt = i_min(i_shr(i_mul(i_sub(L->hi[k], raw), L->lgain[k]), 8), i_set(255));
+		wt = i_andnot(wt, i_lt(wt, i_set(LINE_FLOOR)));
+		wt = i_sel(i_le(raw, L->lo[k]), i_set(255), wt);
+		wt = i_andnot(wt, i_ge(raw, L->hi[k]));
+		fr->num = i_add(fr->num, i_mul(wt, i_set(2 * k - 7)));
+		fr->den = i_add(fr->den, wt);
+		fr->peak = i_max(fr->peak, wt);
+	}
+	L->rng = i_sel(m, rng, L->rng);
+}
+
+static void servo(lanes_t *L, vi m, vi pos)
+{
+	L->servo = i_sel(m, i_clamp(pos, -150, 150), L->servo);
+}
+
+/* fwd(): q8_8_scale_u() by the motor ratios, then the PWM registers */
+static void fwd(lanes_t *L, vi m, vi l, vi r)
+{
+	l = i_min(i_shr(i_mul(l, i_set(179)), 8), i_set(65535));
+	r = i_min(i_shr(i_mul(r, i_set(128)), 8), i_set(65535));
+	L->ocr_l = i_sel(m, i_u16(i_mul(l, i_set(200))), L->ocr_l);
+	L->ocr_r = i_sel(m, i_and(i_divc(i_mul(r, i_set(255)), 100), i_set(0xff)), L->ocr_r);
+}
+
+static vi confirm_begin(lanes_t *L, vi m, int pulses)
+{
+	L->confirm_start = i_sel(m, L->enc, L->confirm_start);
+	L->confirm_len = i_sel(m, i_set(pulses), L->confirm_len);
+	return m;
+}
+
+static vi msb_first(lanes_t *L, vi v) { return i_sel(i_nz(i_and(v, i_set(4))), i_mul(L->m, i_set(3)), i_sel(i_nz(i_and(v, i_set(2))), i_add(L->m, L->m), L->m)); }
+static vi lsb_first(lanes_t *L, vi v) { return i_neg(i_sel(i_nz(i_and(v, i_set(1))), i_mul(L->m, i_set(3)), i_sel(i_nz(i_and(v, i_set(2))), i_add(L->m, L->m), L->m))); }
+
+/* calc_cte(), last_cte of the lanes in m */
+static vi calc_cte(lanes_t *L, vi m, vi s)
+{
+	vi hi3 = i_and(i_shr(s, 5), i_set(7)), lo3 = i_and(s, i_set(7)), m3 = i_mul(L->m, i_set(3)), last = L->last_cte;
+	vi r1 = msb_first(L, hi3), l1 = lsb_first(L, hi3), r2 = lsb_first(L, lo3), l2 = msb_first(L, lo3);
+	vi right = i_nz(hi3), left = i_nz(lo3), cte, nl, sp;
+
+	/* case 3, then 1 and 2 over it, then the centre frames */
+	cte = i_sel(i_gt(last, i_set(0)), i_add(last, L->m), i_sel(i_lt(last, i_set(0)), i_sub(last, L->m), last));
+	nl = last;
+	sp = i_andnot(right, left);
+	cte = i_sel(sp, i_sel(i_ge(last, i_set(0)), r1, i_sub(l1, m3)), cte);
+	nl = i_sel(sp, i_sel(i_ge(last, i_set(0)), r1, l1), nl);
+	sp = i_andnot(left, right);
+	cte = i_sel(sp, i_sel(i_le(last, i_set(0)), r2, i_add(l2, m3)), cte);
+	nl = i_sel(sp, i_sel(i_le(last, i_set(0)), r2, l2), nl);
+	sp = i_not(i_or(left, right));
+	cte = i_andnot(cte, sp);
+	sp = i_eqc(s, 0x18);
+	cte = i_andnot(cte, sp);
+	nl = i_andnot(nl, sp);
+	sp = i_eqc(s, 0x10);
+	cte = i_sel(sp, i_set(25), cte);
+	nl = i_sel(sp, i_set(25), nl);
+	sp = i_eqc(s, 0x08);
+	cte = i_sel(sp, i_set(-25), cte);
+	nl = i_sel(sp, i_set(-25), nl);
+	L->last_cte = i_sel(m, nl, last);
+	return i_s16(cte);
+}
+
+/* pid_Controller(0, cte) */
+static vi pid(lanes_t *L, vi m, vi cte)
+{
+	vi err = i_s16(i_neg(cte)), p, i, d, sum, ret;
+
+	p = i_s16(i_mul(L->kp, err));
+	p = i_sel(i_gt(err, L->max_error), i_set(32767), p);
+	p = i_sel(i_lt(err, i_neg(L->max_error)), i_set(-32767), p);
+	sum = i_add(L->pid_sum, err);
+	i = i_mul(L->ki, sum);
+	i = i_sel(i_gt(sum, L->max_sum), i_set(MAX_I_TERM), i);
+	i = i_sel(i_lt(sum, i_neg(L->max_sum)), i_set(-MAX_I_TERM), i);
+	sum = i_min(i_max(sum, i_neg(L->max_sum)), L->max_sum);
+	d = i_s16(i_mul(L->kd, i_sub(L->pid_last, cte)));
+	L->pid_sum = i_sel(m, sum, L->pid_sum);
+	L->pid_last = i_sel(m, cte, L->pid_last);
+	ret = i_div2n(i_add(i_add(p, i), d), 7);
+	return i_clamp(ret, -32767, 32767);
+}
+
+/* calc_motor_speed() into spd_l, spd_r */
+static void motor_speed(lanes_t *L, vi m, vi cte)
+{
+	vi ms = L->mspeed, t, d5, l, r;
+
+	t = i_s16(i_divc(i_mul(ms, i_sub(i_set(MAX_CTE), i_abs(cte))), MAX_CTE));
+	t = i_div2n(i_sub(i_shl(ms, 15), i_mul(t, i_set(PID_SPEED_RATIO))), 15);
+	t = i_clamp(t, INT16_MIN, INT16_MAX);
+	d5 = i_divc(cte, 5);
+	l = i_u16(i_sub(t, d5));
+	r = i_u16(i_add(t, d5));
+	l = i_sel(i_eqc(cte, 0), ms, l);
+	r = i_sel(i_eqc(cte, 0), ms, r);
+	l = i_sel(i_eqc(cte, -MAX_CTE), ms, i_andnot(l, i_eqc(cte, MAX_CTE)));
+	r = i_sel(i_eqc(cte, MAX_CTE), ms, i_andnot(r, i_eqc(cte, -MAX_CTE)));
+	l = i_sel(L->turn90, i_divc(ms, 3), l);
+	r = i_sel(L->turn90, i_divc(ms, 3), r);
+	L->spd_l = i_sel(m, l, L->spd_l);
+	L->spd_r = i_sel(m, r, L->spd_r);
+}
+
+/* trace_step() for the lanes in m */
+static void trace_step(lanes_t *L, vi m, const frame_t *fr)
+{
+	vi has = i_ge(fr->den, i_set(LINE_MIN_WEIGHT)), conf, cte;
+
+	L->line_pos = i_sel(i_and(m, has), i_div(i_shl(fr->num, 6), i_max(fr->den, i_set(1))), L->line_pos);
+	conf = i_and(fr->peak, has);
+	conf = i_and(L->ready, i_nz(conf));
+	cte = calc_cte(L, i_andnot(m, conf), fr->bits);
+	cte = i_sel(conf, i_s16(i_divc(i_mul(L->line_pos, L->m), LINE_CTE_DIV)), cte);
+	L->last_cte = i_sel(i_and(m, conf), cte, L->last_cte);
+	servo(L, m, i_div2n(pid(L, m, cte), 1));
+	motor_speed(L, m, cte);
+	fwd(L, m, L->spd_l, L->spd_r);
+}
+
+static void park(lanes_t *L, vi m)
+{
+	fwd(L, m, i_set(0), i_set(0));
+	L->state = i_sel(m, i_set(ST_PARKED), L->state);
+}
+
+static vi in_state(lanes_t *L, vi m, int st) { return i_and(m, i_eqc(L->state, st)); }
+
+/* one frame through control_task() and the manoeuvre loops, lanes in rd */
+static void control(lanes_t *L, vi rd, const frame_t *fr)
+{
+	vi s = fr->bits, ns = L->state;
+	vi cross = i_eqc(s, 0xff), none = i_eqc(s, 0);
+	vi left = i_or(i_or(i_eqc(s, 0xfc), i_eqc(s, 0xf8)), i_eqc(s, 0xf0));
+	vi right = i_or(i_or(i_eqc(s, 0x3f), i_eqc(s, 0x1f)), i_eqc(s, 0x0f));
+	vi edge_clear = i_eqc(i_and(s, i_set(0x81)), 0);
+	vi confirmed = i_ge(i_u16(i_sub(L->enc, L->confirm_start)), L->confirm_len);
+	vi centre = i_or(i_or(i_eqc(s, 0x18), i_eqc(s, 0x10)), i_eqc(s, 0x08));
+	vi ms = L->mspeed, ms2 = i_shr(ms, 1), zero = i_set(0), one = i_set(1);
+	vi m, a, k, trace, to, prk;
+
+	/* the PID step first, the states below touch other lanes */
+	m = in_state(L, rd, ST_TRACE);
+	prk = i_and(m, i_eqc(L->off_lane, 100));
+	m = i_andnot(m, prk);
+	trace = i_andnot(m, i_or(i_or(cross, left), i_or(right, none)));
+	a = i_or(in_state(L, rd, ST_LEFT), in_state(L, rd, ST_RIGHT));
+	trace = i_or(trace, i_and(i_and(a, i_not(cross)), edge_clear));
+	trace = i_or(trace, i_and(in_state(L, rd, ST_CROSS), edge_clear));
+	trace_step(L, trace, fr);
+
+	/* 0: normal trace */
+	a = i_and(m, cross);
+	L->off_lane = i_sel(a, i_add(L->off_lane, one), L->off_lane);
+	ns = i_sel(confirm_begin(L, a, CROSSLINE_PULSES), i_set(ST_CROSS), ns);
+	a = i_andnot(i_and(m, left), cross);
+	ns = i_sel(confirm_begin(L, a, HALFLINE_PULSES), i_set(ST_LEFT), ns);
+	a = i_andnot(i_andnot(i_and(m, right), cross), left);
+	ns = i_sel(confirm_begin(L, a, HALFLINE_PULSES), i_set(ST_RIGHT), ns);
+	a = i_and(m, none);
+	ns = i_sel(a, i_set(ST_NOLINE), ns);
+
+	/* 10: no line, a manoeuvre or back to the trace */
+	m = in_state(L, rd, ST_NOLINE);
+	ns = i_sel(m, i_set(ST_TRACE), ns);
+	a = i_and(m, i_nz(L->switch_lane));
+	k = i_eqc(L->switch_lane, 1);
+	fwd(L, a, i_sel(k, ms, ms2), i_sel(k, ms2, ms));
+	servo(L, a, i_sel(k, L->sl_angle, i_neg(L->sl_angle)));
+	L->timeout = i_andnot(L->timeout, a);
+	ns = i_sel(a, i_set(ST_SWITCH), ns);
+	m = i_andnot(m, a);
+	a = i_and(m, L->turn90);
+	L->turn90 = i_andnot(L->turn90, a);
+	m = i_andnot(m, a);
+	a = i_and(m, L->no_line);
+	L->last_cte = i_andnot(L->last_cte, a);
+	fwd(L, a, ms2, ms2);
+	L->timeout = i_andnot(L->timeout, a);
+	ns = i_sel(a, i_set(ST_SEARCH), ns);
+
+	/* 1 and 2: half line, confirmed after HALFLINE_PULSES */
+	for (int side = 0; side < 2; side++) {
+		m = in_state(L, rd, side ? ST_RIGHT : ST_LEFT);
+		a = i_and(m, cross);
+		ns = i_sel(confirm_begin(L, a, CROSSLINE_PULSES), i_set(ST_CROSS), ns);
+		m = i_and(i_andnot(m, cross), confirmed);
+		a = i_and(m, i_nz(i_and(s, i_set(side ? 0x80 : 0x01)))); /* the full line after all */
+		ns = i_sel(confirm_begin(L, a, CROSSLINE_PULSES), i_set(ST_CROSS), ns);
+		m = i_andnot(m, a);
+		a = i_andnot(m, L->turn90);
+		L->switch_lane = i_sel(a, i_set(side ? 1 : 2), L->switch_lane);
+		ns = i_sel(a, i_set(ST_TRACE), ns);
+		a = i_and(m, L->turn90);
+		L->no_line = i_andnot(L->no_line, a);
+		ns = i_sel(a, i_set(side ? ST_TURN_R : ST_TURN_L), ns);
+	}
+
+	/* 3: crossline, ride over it */
+	m = i_and(in_state(L, rd, ST_CROSS), confirmed);
+	L->turn90 = i_sel(m, i_set(-1), L->turn90);
+	L->no_line = i_sel(m, i_set(-1), L->no_line);
+	L->switch_lane = i_andnot(L->switch_lane, m);
+	ns = i_sel(m, i_set(ST_TRACE), ns);
+
+	/* do_switch_lane(): until the inner sensors see the next lane */
+	m = in_state(L, rd, ST_SWITCH);
+	a = i_and(m, i_nz(i_and(s, i_sel(i_eqc(L->switch_lane, 1), i_set(0x78), i_set(0x1e)))));
+	L->switch_lane = i_andnot(L->switch_lane, a);
+	ns = i_sel(a, i_set(ST_TRACE), ns);
+	to = i_andnot(m, a);
+
+	/* do_noline(): the timeout counts before the frame is looked at */
+	m = in_state(L, rd, ST_SEARCH);
+	L->timeout = i_sel(m, i_add(L->timeout, one), L->timeout);
+	prk = i_or(prk, i_and(m, i_eqc(L->timeout, MANOEUVRE_FRAMES)));
+	m = i_andnot(m, prk);
+	servo(L, i_and(m, none), zero);
+	servo(L, i_and(m, i_or(i_eqc(s, 0x80), i_eqc(s, 0xc0))), i_neg(L->nl_angle));
+	servo(L, i_and(m, i_or(i_eqc(s, 0x01), i_eqc(s, 0x03))), L->nl_angle);
+	a = i_and(m, centre);
+	L->no_line = i_andnot(L->no_line, a);
+	ns = i_sel(a, i_set(ST_TRACE), ns);
+
+	/* do_90_*_turn(): off the end of the line, then turn onto the new one */
+	for (int side = 0; side < 2; side++) {
+		m = i_and(in_state(L, rd, side ? ST_TURN_R : ST_TURN_L), none);
+		fwd(L, m, side ? ms : zero, side ? zero : ms);
+		servo(L, m, i_set(side ? 150 : -150));
+		L->timeout = i_andnot(L->timeout, m);
+		ns = i_sel(m, i_set(side ? ST_TURN_RB : ST_TURN_LB), ns);
+		m = in_state(L, rd, side ? ST_TURN_RB : ST_TURN_LB);
+		a = i_and(m, i_eqc(s, 0x18));
+		L->last_cte = i_andnot(L->last_cte, a);
+		L->turn90 = i_andnot(L->turn90, a);
+		fwd(L, a, ms, ms);
+		ns = i_sel(a, i_set(ST_TRACE), ns);
+		to = i_or(to, i_andnot(m, a));
+	}
+
+	/* the waits that saw nothing count to TIMEOUT_CONST */
+	L->timeout = i_sel(to, i_add(L->timeout, one), L->timeout);
+	prk = i_or(prk, i_and(to, i_eqc(L->timeout, MANOEUVRE_FRAMES)));
+	L->state = i_sel(rd, ns, L->state);
+	park(L, prk);
+}
+
+/* arm centre and direction from the rear axle pose, heading sin/cos given */
+static void arm_pose(const batch_car_t *c, lanes_t *L, vf sh, vf ch)
+{
+	vf as, ac;
+
+	f_sincos(f_sub(L->h, f_mul(L->delta, f_set((float)(3.14159265358979323846 / 180)))), &as, &ac);
+	L->ax = f_add(f_add(L->x, f_mul(ch, f_set(c->wheelbase))), f_mul(ac, f_set(c->arm)));
+	L->ay = f_add(f_add(L->y, f_mul(sh, f_set(c->wheelbase))), f_mul(as, f_set(c->arm)));
+	L->asin = as;
+	L->acos = ac;
+}
+
+/* wheel() for a motor with the direction pin clear */
+static vf wheel(const batch_car_t *c, vf v, vf duty)
+{
+	return f_add(v, f_div(f_mul(f_sub(f_mul(duty, f_set(c->vmax)), v), f_set(BATCH_DT)), f_set(c->tau)));
+}
+
+/* car i of b into lane j, and back */
+static __attribute__((noinline)) void lane_load(lanes_t *L, int j, const batch_t *b, int i)
+{
+	float f[W];
+	int32_t v[W];
+
+#define X(F) f_store(f, L->F); f[j] = b->F[i]; L->F = f_load(f);
+	BATCH_F(X)
+#undef X
+#define X(F) i_store(v, L->F); v[j] = b->F[i]; L->F = i_load(v);
+	BATCH_I(X)
+#undef X
+#define X(F) for (int k = 0; k < 8; k++) { f_store(f, L->F[k]); f[j] = b->F[k][i]; L->F[k] = f_load(f); }
+	BATCH_FC(X)
+#undef X
+#define X(F) for (int k = 0; k < 8; k++) { i_store(v, L->F[k]); v[j] = b->F[k][i]; L->F[k] = i_load(v); }
+	BATCH_IC(X)
+#undef X
+}
+
+static __attribute__((noinline)) void lane_save(const lanes_t *L, int j, batch_t *b, int i)
+{
+	float f[W];
+	int32_t v[W];
+
+#define X(F) f_store(f, L->F); b->F[i] = f[j];
+	BATCH_F(X)
+#undef X
+#define X(F) i_store(v, L->F); b->F[i] = v[j];
+	BATCH_I(X)
+#undef X
+#define X(F) for (int k = 0; k < 8; k++) { f_store(f, L->F[k]); b->F[k][i] = f[j]; }
+	BATCH_FC(X)
+#undef X
+#define X(F) for (int k = 0; k < 8; k++) { i_store(v, L->F[k]); b->F[k][i] = v[j]; }
+	BATCH_IC(X)
+#undef X
+}
+
+void batch_run(batch_t *b)
+{
+	const batch_car_t *c = &b->car;
+	const batch_track_t *t = b->trk;
+	const vf rad = f_set((float)(3.14159265358979323846 / 180)), dt = f_set(BATCH_DT);
+	int slot[W], next = 0;
+	uint32_t g;
+	lanes_t L;
+	vi busy;
+	vf sh, ch;
+
+	if (b->n == 0) return;
+	memset(&L, 0, sizeof L);
+	for (int j = 0; j < W; j++) { /* lanes without a car hold a copy of car 0, ended */
+		int32_t end[W];
+
+		lane_load(&L, j, b, next < b->n ? next : 0);
+		slot[j] = next < b->n ? next++ : -1;
+		i_store(end, L.end);
+		if (slot[j] < 0) end[j] = BATCH_LIMIT;
+		L.end = i_load(end);
+	}
+	busy = i_eqc(L.end, BATCH_RUNNING);
+	f_sincos(L.h, &sh, &ch);
+	arm_pose(c, &L, sh, ch);
+	for (g = 1;; g++) {
+		vi act = i_eqc(L.end, BATCH_RUNNING), rd, bk, a, k, found, kind, lost, stalled, done;
+		vf tm, target, dh, v, wv, sn, cs, n, ls, ds;
+		frame_t fr;
+
+		L.tick = i_sub(L.tick, act);
+		tm = f_mul(f_from_i(L.tick), f_set(0.001f));
+
+		/* firmware: the control task on even ticks, the manoeuvres every tick */
+		rd = i_and(act, i_ne(L.state, i_set(ST_PARKED)));
+		rd = i_and(rd, i_or(i_eqc(i_and(L.tick, i_set(1)), 0), i_ge(L.state, i_set(ST_SWITCH))));
+		if (i_any(rd)) {
+			sense(b, &L, rd, &fr);
+			control(&L, rd, &fr);
+		}
+
+		/* servo */
+		target = f_div(f_mul(f_from_i(i_mul(L.servo, i_set(6))), f_set(c->servo_max)), f_set(SERVO_LOCK));
+		target = f_clamp(target, -c->servo_max, c->servo_max);
+		dh = f_clamp(f_sub(target, L.delta), -c->servo_rate * BATCH_DT, c->servo_rate * BATCH_DT);
+		L.delta = f_add(L.delta, dh);
+
+		/* motors, then the bicycle model of sim_ms() */
+		L.vl = wheel(c, L.vl, f_min(f_div(f_from_i(L.ocr_l), f_set(20000)), f_set(1)));
+		L.vr = wheel(c, L.vr, f_min(f_div(f_from_i(L.ocr_r), f_set(255)), f_set(1)));
+		v = f_div(f_add(L.vl, L.vr), f_set(2));
+		L.x = f_add(L.x, f_mul(f_mul(f_mul(ch, v), f_set(1000)), dt));
+		L.y = f_add(L.y, f_mul(f_mul(f_mul(sh, v), f_set(1000)), dt));
+		f_sincos(f_mul(L.delta, rad), &sn, &cs);
+		L.h = f_sub(L.h, f_mul(f_div(f_mul(f_mul(v, f_set(1000)), f_div(sn, cs)), f_set(c->wheelbase)), dt));
+		k = f_lt(f_mul(L.vl, L.vr), f_set(0));
+		L.h = f_add(L.h, f_mul(f_div(f_mul(f_mul(f_sel(k, f_set(c->pivot), f_set(c->slip)), f_sub(L.vr, L.vl)),
+			f_set(1000)), f_set(c->track)), dt));
+		wv = f_div(f_add(f_abs(L.vl), f_abs(L.vr)), f_set(2));
+		L.enc_frac = f_add(L.enc_frac, f_mul(f_mul(wv, f_set(1000)), dt));
+		k = i_from_f(f_div(L.enc_frac, f_set(c->enc_mm)));
+		L.enc = i_add(L.enc, k);
+		L.enc_frac = f_sub(L.enc_frac, f_mul(f_from_i(k), f_set(c->enc_mm)));
+		f_sincos(L.h, &sh, &ch);
+		arm_pose(c, &L, sh, ch);
+
+		/* where on the track */
+		found = locate(t, L.x, L.y, &ls, &n, &kind);
+		ds = f_sub(ls, L.s);
+		if (t->closed) {
+			vf len = f_set(t->len), sm = f_sub(L.s, f_mul(f_from_i(i_from_f(f_div(L.s, len))), len));
+
+			sm = f_sel(f_lt(L.s, f_set(0)), f_add(sm, len), sm);
+			ds = f_sub(ls, sm);
+			ds = f_sub(ds, f_mul(f_floor(f_add(f_div(ds, len), f_set(0.5f))), len));
+		}
+		L.s = f_sel(i_and(act, found), f_add(L.s, ds), L.s);
+		found = locate(t, L.ax, L.ay, &ls, &n, &kind);
+		L.err = f_sel(found, f_abs(n), f_set(1e9f));
+		kind = i_sel(found, kind, i_set(0));
+		k = i_eqc(kind, 2); /* SEG_LANE */
+		L.lane = i_sel(k, i_set(-1), i_andnot(L.lane, f_lt(L.err, f_set(b->off_mm / 2))));
+
+		/* run bookkeeping */
+		bk = i_and(act, L.started);
+		k = i_andnot(i_and(act, f_lt(f_set(0.05f), f_abs(v))), L.started);
+		L.started = i_or(L.started, k);
+		L.t_lap = f_sel(k, tm, L.t_lap);
+		L.s = f_sel(k, f_set(0), L.s);
+
+		k = i_andnot(bk, L.lane);
+		L.max_err = f_sel(k, f_max(L.err, L.max_err), L.max_err);
+		L.sum_err = f_sel(k, f_add(L.sum_err, L.err), L.sum_err);
+		L.err_n = i_sel(k, i_add(L.err_n, i_set(1)), L.err_n);
+		a = i_and(i_andnot(k, L.off), f_lt(f_set(b->off_mm), L.err));
+		L.off_events = i_sub(L.off_events, a);
+		L.off = i_or(L.off, a);
+		L.off = i_andnot(L.off, i_and(k, f_lt(L.err, f_set(b->off_mm / 2))));
+		lost = i_and(k, f_lt(f_set(LOST_MM), L.err));
+
+		k = f_lt(f_abs(v), f_set(0.02f));
+		L.stall_t = f_sel(bk, f_sel(k, f_add(L.stall_t, dt), f_set(0)), L.stall_t);
+		stalled = i_and(bk, f_lt(f_set(STALL_S), L.stall_t));
+
+		if (t->closed) {
+			k = i_and(bk, f_le(f_mul(f_from_i(i_add(L.laps, i_set(1))), f_set(t->len)), L.s));
+			L.lap_sum = f_sel(k, f_add(L.lap_sum, f_sub(tm, L.t_lap)), L.lap_sum);
+			L.t_lap = f_sel(k, tm, L.t_lap);
+			L.laps = i_sel(k, i_add(L.laps, i_set(1)), L.laps);
+			done = i_and(k, i_ge(L.laps, i_set(b->laps_wanted)));
+		} else {
+			done = i_and(bk, f_le(f_set(t->len - c->wheelbase), L.s));
+			L.lap_sum = f_sel(done, f_sub(tm, L.t_lap), L.lap_sum);
+			L.laps = i_sel(done, i_set(1), L.laps);
+		}
+		L.end = i_sel(done, i_set(BATCH_DONE), L.end);
+		L.end = i_sel(stalled, i_set(BATCH_STOPPED), L.end);
+		L.end = i_sel(lost, i_set(BATCH_LOST), L.end);
+		L.t_end = f_sel(i_or(i_or(done, stalled), lost), tm, L.t_end);
+		k = i_and(i_eqc(L.end, BATCH_RUNNING), i_ge(L.tick, i_set(b->limit_ms)));
+		L.end = i_sel(k, i_set(BATCH_LIMIT), L.end);
+		L.t_end = f_sel(k, f_set(b->limit_ms * 0.001f), L.t_end);
+
+		/* a lane whose car is done takes the next one, on even ticks so
+		   every car's ticks stay in step with the control task parity */
+		if (!(g & 1) && i_any(i_andnot(busy, i_eqc(L.end, BATCH_RUNNING)))) {
+			int32_t end[W], run[W], n_run = 0;
+
+			i_store(end, L.end);
+			for (int j = 0; j < W; j++) {
+				if (slot[j] >= 0 && end[j] != BATCH_RUNNING) {
+					lane_save(&L, j, b, slot[j]);
+					slot[j] = -1;
+					if (next < b->n) {
+						lane_load(&L, j, b, next);
+						slot[j] = next++;
+					}
+				}
+				run[j] = slot[j] >= 0 ? -1 : 0;
+				n_run += slot[j] >= 0;
+			}
+			if (!n_run) break;
+			busy = i_load(run);
+			f_sincos(L.h, &sh, &ch);
+			arm_pose(c, &L, sh, ch);
+		}
+	}
+}
@@ -0,0 +1,561 @@
+/*
+	batch_sim: many MCR cars round a track at once, for parameter sweeps
+	that want cars per second more than one car's detail.
+
+	The cars are the lanes of batch.h, stepped together by batch_kernel.c,
+	eight at a time with AVX2 when the CPU has it, one at a time without.
+	Each car has its own profile (the MCR tune.h fields) and noise seed.
+	The world is track_sim.c's; batch.h lists what the port leaves out.
+	Times count from pid_start(), lap times as in track_sim.
+
+	usage: batch_sim [options]
+	  -k file   track description (track_sim.c format, default: the
+	            built-in loop)
+	  -n cars   cars with the tune_defaults() profile, seeds -S, -S + 1 ...
+	            (default 64)
+	  -p file   one car per line instead: speed m kp ki kd switch_lane
+	            noline [seed], '#' comments, seed -S + line without one
+	  -l n      laps (default 2)
+	  -t ms     simulated time limit per car (default 60000)
+	  -S seed   first sensor noise seed (default 1)
+	  -V mps    top speed at 100 % duty (default 3.0)
+	  -O mm     off track distance (default 100)
+	  -c core   scalar or avx2 (default avx2 when the CPU has it)
+	  -q        the summary only, no line per car
+	  -B        benchmark on this core: the cars with the scalar and the
+	            AVX2 kernel (results compared), then -N of them one at a
+	            time through -x with -R, cars per second for each
+	  -x sim    one car simulator for -B (default ./sim_mcr)
+	  -N runs   -x runs for -B (default 8)
+
+	A line per car, the track_sim -R fields after "result":
+	  car 0 speed=80 m=50 kp=95 ki=2 kd=1 switch_lane=95 noline=100 seed=1
+	  result laps=2 want=2 time=15.851 off=0 err=8.2 progress=1.000 end=done
+
+	Exact integer steps need speed <= 1000; kp, ki, kd <= 32767, m <= 255
+	and the angles -128..127 as the firmware's types hold them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "track.h"
+#include "batch.h"
+
+#define MAX_CARS 65536
+#define LINE_MIN_SPAN 40 /* line_pos.h LINE_POS_MIN_SPAN */
+
+typedef struct Profile {
+	int speed, m, kp, ki, kd, switch_lane, noline;
+	uint32_t seed;
+} profile_t;
+
+static const profile_t profile_default = { 80, 50, 95, 2, 1, 95, 100, 0 }; /* tune_defaults() */
+
+static const char *const end_name[] = { "running", "done", "lost", "stopped", "limit" };
+
+static batch_car_t car = {
+	180, 150, 120, 16,
+	3.0f, 0.15f,
+	45, 600,
+	0.03f, 0.1f,
+	1.0f,
+	880, 120, 6,
+};
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void *alloc(size_t n)
+{
+	void *p = calloc(1, n);
+
+	if (!p) {
+		fprintf(stderr, "batch_sim: out of memory\n");
+		exit(2);
+	}
+	return p;
+}
+
+/* ---- track grids ---- */
+
+static double clamp01(double v) { return v < 0 ? 0 : v > 1 ? 1 : v; }
+
+/* squared distance of (px, py) from segment g */
+static double seg_dist2(const seg_t *g, double px, double py)
+{
+	double rx = px - g->x, ry = py - g->y, f = rx * g->ux + ry * g->uy;
+
+	if (f < 0) f = 0;
+	if (f > g->len) f = g->len;
+	rx -= g->ux * f;
+	ry -= g->uy * f;
+	return rx * rx + ry * ry;
+}
+
+/* cells of a grid (origin x0, y0, cell size) within r of the segment */
+static void seg_cells(const seg_t *g, double x0, double y0, double cell, int nx, int ny, double r, int *i0, int *i1, int *j0, int *j1)
+{
+	double ex = g->x + g->ux * g->len, ey = g->y + g->uy * g->len;
+
+	*i0 = (int)floor((fmin(g->x, ex) - r - x0) / cell);
+	*i1 = (int)floor((fmax(g->x, ex) + r - x0) / cell);
+	*j0 = (int)floor((fmin(g->y, ey) - r - y0) / cell);
+	*j1 = (int)floor((fmax(g->y, ey) + r - y0) / cell);
+	if (*i0 < 0) *i0 = 0;
+	if (*j0 < 0) *j0 = 0;
+	if (*i1 > nx - 1) *i1 = nx - 1;
+	if (*j1 > ny - 1) *j1 = ny - 1;
+}
+
+static void build_grids(batch_track_t *bt, const track_t *t)
+{
+	double x0 = 1e18, y0 = 1e18, x1 = -1e18, y1 = -1e18, r = 4, d;
+	float *best;
+	int i, j, k;
+
+	for (k = 0; k < t->nseg; k++) {
+		const seg_t *g = &t->seg[k];
+
+		x0 = fmin(x0, fmin(g->x, g->x + g->ux * g->len));
+		x1 = fmax(x1, fmax(g->x, g->x + g->ux * g->len));
+		y0 = fmin(y0, fmin(g->y, g->y + g->uy * g->len));
+		y1 = fmax(y1, fmax(g->y, g->y + g->uy * g->len));
+	}
+	bt->x0 = x0 - BATCH_BAND - BATCH_SEG_CELL;
+	bt->y0 = y0 - BATCH_BAND - BATCH_SEG_CELL;
+	x1 += BATCH_BAND + BATCH_SEG_CELL;
+	y1 += BATCH_BAND + BATCH_SEG_CELL;
+
+	/* segments, as floats */
+	bt->nseg = t->nseg;
+	bt->sx = alloc(t->nseg * sizeof(float));
+	bt->sy = alloc(t->nseg * sizeof(float));
+	bt->sux = alloc(t->nseg * sizeof(float));
+	bt->suy = alloc(t->nseg * sizeof(float));
+	bt->slen = alloc(t->nseg * sizeof(float));
+	bt->ss = alloc(t->nseg * sizeof(float));
+	bt->skind = alloc(t->nseg * sizeof(int32_t));
+	for (k = 0; k < t->nseg; k++) {
+		bt->sx[k] = t->seg[k].x;
+		bt->sy[k] = t->seg[k].y;
+		bt->sux[k] = t->seg[k].ux;
+		bt->suy[k] = t->seg[k].uy;
+		bt->slen[k] = t->seg[k].len;
+		bt->ss[k] = t->seg[k].s;
+		bt->skind[k] = t->seg[k].kind;
+	}
+	bt->len = t->len;
+	bt->closed = t->closed;
+
+	/* nearest segment of every cell centre within BATCH_BAND */
+	bt->seg_nx = (int)ceil((x1 - bt->x0) / BATCH_SEG_CELL);
+	bt->seg_ny = (int)ceil((y1 - bt->y0) / BATCH_SEG_CELL);
+	bt->seg = alloc((size_t)bt->seg_nx * bt->seg_ny * sizeof(int32_t));
+	best = alloc((size_t)bt->seg_nx * bt->seg_ny * sizeof(float));
+	for (i = 0; i < bt->seg_nx * bt->seg_ny; i++) {
+		bt->seg[i] = -1;
+		best[i] = BATCH_BAND * BATCH_BAND;
+	}
+	for (k = 0; k < t->nseg; k++) {
+		int i0, i1, j0, j1;
+
+		seg_cells(&t->seg[k], bt->x0, bt->y0, BATCH_SEG_CELL, bt->seg_nx, bt->seg_ny, BATCH_BAND, &i0, &i1, &j0, &j1);
+		for (j = j0; j <= j1; j++)
+			for (i = i0; i <= i1; i++) {
+				size_t c = (size_t)j * bt->seg_nx + i;
+
+				d = seg_dist2(&t->seg[k], bt->x0 + (i + 0.5) * BATCH_SEG_CELL, bt->y0 + (j + 0.5) * BATCH_SEG_CELL);
+				if (d < best[c]) {
+					best[c] = d;
+					bt->seg[c] = k;
+				}
+			}
+	}
+	free(best);
+
+	/* line cover as sim_adc() sees it: the line, then the marks over it */
+	bt->cover_nx = (int)ceil((x1 - bt->x0) / BATCH_COVER_CELL);
+	bt->cover_ny = (int)ceil((y1 - bt->y0) / BATCH_COVER_CELL);
+	bt->cover = alloc((size_t)bt->cover_nx * bt->cover_ny + 3);
+	for (k = 0; k < t->nseg; k++) {
+		int i0, i1, j0, j1;
+
+		if (t->seg[k].kind != SEG_LINE) continue;
+		seg_cells(&t->seg[k], bt->x0, bt->y0, BATCH_COVER_CELL, bt->cover_nx, bt->cover_ny, t->line_w / 2 + r + 2, &i0, &i1, &j0, &j1);
+		for (j = j0; j <= j1; j++)
+			for (i = i0; i <= i1; i++) {
+				uint8_t *c = &bt->cover[(size_t)j * bt->cover_nx + i];
+				int v;
+
+				d = sqrt(seg_dist2(&t->seg[k], bt->x0 + (i + 0.5) * BATCH_COVER_CELL, bt->y0 + (j + 0.5) * BATCH_COVER_CELL));
+				v = (int)(clamp01((t->line_w / 2 + r - d) / (2 * r)) * 255 + 0.5);
+				if (v > *c) *c = v;
+			}
+	}
+	for (int mk = 0; mk < t->nmark; mk++) {
+		const mark_t *m = &t->mark[mk];
+		int a = track_index(t, m->s0 - 200), b = track_index(t, m->s1 + 200), na = b - a;
+
+		if (na < 0) na += t->nseg;
+		for (k = 0; k <= na; k++) {
+			const seg_t *g = &t->seg[(a + k) % t->nseg];
+			int i0, i1, j0, j1;
+
+			if (g->s + g->len < m->s0 - r - SEG_MM || g->s > m->s1 + r + SEG_MM) continue;
+			seg_cells(g, bt->x0, bt->y0, BATCH_COVER_CELL, bt->cover_nx, bt->cover_ny, MARK_HALF + r + 2, &i0, &i1, &j0, &j1);
+			for (j = j0; j <= j1; j++)
+				for (i = i0; i <= i1; i++) {
+					uint8_t *c = &bt->cover[(size_t)j * bt->cover_nx + i];
+					double fs, fn;
+					loc_t l;
+					int v;
+
+					track_locate(t, bt->x0 + (i + 0.5) * BATCH_COVER_CELL, bt->y0 + (j + 0.5) * BATCH_COVER_CELL,
+						(m->s0 + m->s1) / 2, (m->s1 - m->s0) / 2 + 200, (m->s1 - m->s0) / 2 + 200, &l);
+					fs = clamp01((fmin(l.s - m->s0, m->s1 - l.s) + r) / (2 * r));
+					fn = clamp01((fmin(l.n - m->n0, m->n1 - l.n) + r) / (2 * r));
+					v = (int)(fmin(fs, fn) * 255 + 0.5);
+					if (v > *c) *c = v;
+				}
+		}
+	}
+}
+
+/* ---- cars ---- */
+
+static void batch_alloc(batch_t *b, int n)
+{
+	b->n = n;
+#define X(f) b->f = alloc(n * sizeof(float));
+	BATCH_F(X)
+#undef X
+#define X(f) b->f = alloc(n * sizeof(int32_t));
+	BATCH_I(X)
+#undef X
+#define X(f) for (int k = 0; k < 8; k++) b->f[k] = alloc(n * sizeof(float));
+	BATCH_FC(X)
+#undef X
+#define X(f) for (int k = 0; k < 8; k++) b->f[k] = alloc(n * sizeof(int32_t));
+	BATCH_IC(X)
+#undef X
+}
+
+static double rnd(uint32_t *r) /* track_sim.c rnd() */
+{
+	*r ^= *r << 13;
+	*r ^= *r >> 17;
+	*r ^= *r << 5;
+	return (*r & 0xffffff) / (double)0x1000000;
+}
+
+static int32_t fwd_ocr_l(int32_t v) { uint32_t l = ((uint32_t)v * 179) >> 8; return (uint16_t)((l > 65535 ? 65535 : l) * 200); }
+static int32_t fwd_ocr_r(int32_t v) { uint32_t r = ((uint32_t)v * 128) >> 8; return (uint8_t)((r > 65535 ? 65535 : r) * 255 / 100); }
+
+/* lane i on the start, calibrated, at pid_start() */
+static void car_init(batch_t *b, int i, const track_t *t, const profile_t *p)
+{
+	uint32_t rng = p->seed * 2654435761u | 1;
+	int32_t sum = 0, ready = -1;
+
+	b->x[i] = t->seg[0].x;
+	b->y[i] = t->seg[0].y;
+	b->h[i] = atan2(t->seg[0].uy, t->seg[0].ux);
+	for (int k = 0; k < 8; k++) {
+		double gain = 0.95 + 0.1 * rnd(&rng);
+		int32_t lo = (int32_t)(car.line_adc * gain - 2 * car.noise), hi = (int32_t)(car.floor_adc * gain + 2 * car.noise);
+
+		if (lo < 0) lo = 0;
+		if (hi > 1023) hi = 1023;
+		b->gain[k][i] = gain;
+		b->lo[k][i] = lo;
+		b->hi[k][i] = hi;
+		b->iir[k][i] = 0xffff;
+		sum += (lo + hi) / 2;
+		if (hi > lo + LINE_MIN_SPAN) b->lgain[k][i] = (255 << 8) / (hi - lo);
+		else ready = 0;
+	}
+	b->rng[i] = rng;
+	b->line[i] = sum / 8;
+	b->ready[i] = ready;
+	b->mspeed[i] = p->speed;
+	b->m[i] = p->m;
+	b->kp[i] = p->kp;
+	b->ki[i] = p->ki;
+	b->kd[i] = p->kd;
+	b->max_error[i] = INT16_MAX / (p->kp + 1);
+	b->max_sum[i] = (INT32_MAX / 2) / (p->ki + 1);
+	b->sl_angle[i] = p->switch_lane;
+	b->nl_angle[i] = p->noline;
+	b->spd_l[i] = b->spd_r[i] = p->speed;
+	b->ocr_l[i] = fwd_ocr_l(p->speed);
+	b->ocr_r[i] = fwd_ocr_r(p->speed);
+}
+
+static int read_profiles(const char *file, profile_t **out, uint32_t seed)
+{
+	char line[256];
+	profile_t *p = NULL;
+	int n = 0, no = 0;
+	FILE *f;
+
+	if (!(f = fopen(file, "r"))) {
+		perror(file);
+		return -1;
+	}
+	while (fgets(line, sizeof line, f)) {
+		profile_t q = profile_default;
+		int k;
+
+		no++;
+		if (strchr(line, '#')) *strchr(line, '#') = 0;
+		k = sscanf(line, "%d %d %d %d %d %d %d %u", &q.speed, &q.m, &q.kp, &q.ki, &q.kd, &q.switch_lane, &q.noline, &q.seed);
+		if (k <= 0) continue;
+		if (k < 7 || q.speed < 0 || q.speed > 1000 || q.m < 0 || q.m > 255 || q.kp < 0 || q.kp > 32767 ||
+			q.ki < 0 || q.ki > 32767 || q.kd < 0 || q.kd > 32767 || q.switch_lane < -128 || q.switch_lane > 127 ||
+			q.noline < -128 || q.noline > 127) {
+			fprintf(stderr, "%s:%d: not a profile: speed m kp ki kd switch_lane noline [seed]\n", file, no);
+			fclose(f);
+			return -1;
+		}
+		if (k == 7) q.seed = seed + n;
+		if (n == MAX_CARS) break;
+		p = realloc(p, (n + 1) * sizeof(profile_t));
+		p[n++] = q;
+	}
+	fclose(f);
+	*out = p;
+	return n;
+}
+
+typedef void (*kernel_t)(batch_t *);
+
+static double run(batch_t *b, kernel_t k)
+{
+	double t0 = now();
+
+	k(b);
+	return now() - t0;
+}
+
+static void batch_start(batch_t *b, const track_t *t, const profile_t *p)
+{
+	for (int i = 0; i < b->n; i++) car_init(b, i, t, &p[i]);
+}
+
+static double sim_seconds(const batch_t *b, int cars)
+{
+	double s = 0;
+
+	for (int i = 0; i < cars; i++) s += b->t_end[i];
+	return s;
+}
+
+/* cars whose results differ; the rest of a lane runs on in a wider kernel until its group is done */
+static int differ(const batch_t *a, const batch_t *b, int cars)
+{
+	int diff = 0;
+
+	for (int i = 0; i < cars; i++) {
+		int d = 0;
+#define X(f) d |= memcmp(&a->f[i], &b->f[i], sizeof(float)) != 0;
+		X(s) X(t_lap) X(lap_sum) X(max_err) X(sum_err) X(t_end)
+#undef X
+#define X(f) d |= a->f[i] != b->f[i];
+		X(laps) X(off_events) X(err_n) X(end)
+#undef X
+		diff += d;
+	}
+	return diff;
+}
+
+static void result_line(const batch_t *b, const profile_t *p, int i)
+{
+	double want = b->trk->closed ? b->laps_wanted * b->trk->len : b->trk->len - car.wheelbase;
+
+	printf("car %d speed=%d m=%d kp=%d ki=%d kd=%d switch_lane=%d noline=%d seed=%u "
+		"result laps=%d want=%d time=%.3f off=%d err=%.1f progress=%.3f end=%s\n",
+		i, p->speed, p->m, p->kp, p->ki, p->kd, p->switch_lane, p->noline, p->seed,
+		b->laps[i], b->trk->closed ? b->laps_wanted : 1, b->lap_sum[i], b->off_events[i],
+		b->err_n[i] ? b->sum_err[i] / b->err_n[i] : 0,
+		b->s[i] > 0 ? (b->s[i] < want ? b->s[i] / want : 1.0) : 0.0, end_name[b->end[i]]);
+}
+
+/* -N runs of the one car simulator, the first -N seeds of the profiles */
+static int bench_sim(const char *sim, const char *track_file, const batch_t *b, const profile_t *p, int runs, double *host, double *sim_s, double *lap)
+{
+	char cmd[1024], line[512];
+	double t0 = now(), t, at;
+	int laps, n = 0;
+
+	*sim_s = *lap = 0;
+	for (int i = 0; i < runs; i++) {
+		FILE *f;
+
+		/* the default profile only: the -P blob layout is tune_sweep's business */
+		snprintf(cmd, sizeof cmd, "%s -R -S %u -l %d -t %u -V %g -O %g%s%s", sim, p[i].seed, b->laps_wanted,
+			b->limit_ms + 8000, car.vmax, b->off_mm, track_file ? " -k " : "", track_file ? track_file : "");
+		if (!(f = popen(cmd, "r"))) {
+			perror(sim);
+			return -1;
+		}
+		while (fgets(line, sizeof line, f)) {
+			char *e = strstr(line, "  end: ");
+
+			if (e && (e = strstr(e, " at ")) && sscanf(e, " at %lf", &at) == 1) *sim_s += at;
+			if (sscanf(line, "result laps=%d want=%*d time=%lf", &laps, &t) == 2 && laps) {
+				*lap += t / laps;
+				n++;
+			}
+		}
+		if (pclose(f) < 0 || !*sim_s) {
+			fprintf(stderr, "batch_sim: no result from %s\n", cmd);
+			return -1;
+		}
+	}
+	*host = now() - t0;
+	*lap = n ? *lap / n : 0;
+	return 0;
+}
+
+static double mean_lap(const batch_t *b, int cars)
+{
+	double s = 0;
+	int n = 0;
+
+	for (int i = 0; i < cars; i++)
+		if (b->laps[i]) {
+			s += b->lap_sum[i] / b->laps[i];
+			n++;
+		}
+	return n ? s / n : 0;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: batch_sim [-k track] [-n cars | -p profiles] [-l laps] [-t ms] [-S seed] [-V mps] [-O mm] [-c scalar|avx2] [-q] [-B [-x sim] [-N runs]]\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	const char *track_file = NULL, *profile_file = NULL, *core = NULL, *sim = "./sim_mcr";
+	int i, cars = 64, quiet = 0, bench = 0, runs = 8, avx2 = __builtin_cpu_supports("avx2");
+	uint32_t seed = 1;
+	track_t track;
+	batch_track_t bt;
+	batch_t b;
+	profile_t *p;
+	double t0, host;
+	int count[5] = { 0 };
+
+	memset(&b, 0, sizeof b);
+	b.laps_wanted = 2;
+	b.limit_ms = 60000;
+	b.off_mm = 100;
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+
+		if (a[0] != '-' || !a[1]) return usage();
+		if (a[1] == 'q') { quiet = 1; continue; }
+		if (a[1] == 'B') { bench = 1; continue; }
+		if (i + 1 >= argc) return usage();
+		a = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 'k': track_file = a; break;
+		case 'n': cars = atoi(a); break;
+		case 'p': profile_file = a; break;
+		case 'l': b.laps_wanted = atoi(a); break;
+		case 't': b.limit_ms = strtoul(a, NULL, 0); break;
+		case 'S': seed = strtoul(a, NULL, 0); break;
+		case 'V': car.vmax = atof(a); break;
+		case 'O': b.off_mm = atof(a); break;
+		case 'c': core = a; break;
+		case 'x': sim = a; break;
+		case 'N': runs = atoi(a); break;
+		default: return usage();
+		}
+	}
+	if (core && strcmp(core, "scalar") && strcmp(core, "avx2")) return usage();
+	if (core && !strcmp(core, "avx2") && !avx2) {
+		fprintf(stderr, "batch_sim: this CPU has no AVX2\n");
+		return 2;
+	}
+	if (core) avx2 = !strcmp(core, "avx2");
+	if (profile_file) {
+		if ((cars = read_profiles(profile_file, &p, seed)) <= 0) {
+			if (!cars) fprintf(stderr, "%s: no profiles\n", profile_file);
+			return 2;
+		}
+	} else {
+		if (cars < 1 || cars > MAX_CARS) return usage();
+		p = malloc(cars * sizeof(profile_t));
+		for (i = 0; i < cars; i++) {
+			p[i] = profile_default;
+			p[i].seed = seed + i;
+		}
+	}
+	if (track_load(&track, track_file) < 0) return 1;
+
+	t0 = now();
+	memset(&bt, 0, sizeof bt);
+	build_grids(&bt, &track);
+	b.trk = &bt;
+	b.car = car;
+	batch_alloc(&b, cars);
+	batch_start(&b, &track, p);
+	printf("%d cars on %s: %.0f mm, %s, grids %.2f s\n", cars, track_file ? track_file : "built-in track", track.len,
+		track.closed ? "loop" : "open", now() - t0);
+
+	if (bench) {
+		batch_t ref;
+		double host_s, host_v = 0, sim_host, sim_s, lap;
+		int diff = 0;
+
+		host_s = run(&b, batch_run_scalar);
+		printf("  scalar   %6d cars %8.3f s %9.1f cars/s %9.0f simulated s/s  lap %.3f s\n",
+			cars, host_s, cars / host_s, sim_seconds(&b, cars) / host_s, mean_lap(&b, cars));
+		if (avx2) {
+			ref = b;
+			memset(&b, 0, sizeof b);
+			b.trk = ref.trk;
+			b.car = ref.car;
+			b.laps_wanted = ref.laps_wanted;
+			b.limit_ms = ref.limit_ms;
+			b.off_mm = ref.off_mm;
+			batch_alloc(&b, ref.n);
+			batch_start(&b, &track, p);
+			host_v = run(&b, batch_run_avx2);
+			diff = differ(&ref, &b, cars);
+			printf("  avx2     %6d cars %8.3f s %9.1f cars/s %9.0f simulated s/s  lap %.3f s\n",
+				cars, host_v, cars / host_v, sim_seconds(&b, cars) / host_v, mean_lap(&b, cars));
+		}
+		if (runs > cars) runs = cars;
+		if (runs > 0 && bench_sim(sim, track_file, &b, p, runs, &sim_host, &sim_s, &lap) == 0)
+			printf("  %-8s %6d cars %8.3f s %9.1f cars/s %9.0f simulated s/s  lap %.3f s (power-on sequence included)\n",
+				sim, runs, sim_host, runs / sim_host, sim_s / sim_host, lap);
+		else runs = 0;
+		if (avx2) printf("  avx2 %.1fx scalar, results %s\n", host_s / host_v, diff ? "DIFFER" : "identical");
+		if (runs) printf("  %s %.0fx %s in cars/s\n", avx2 ? "avx2" : "scalar", (cars / (avx2 ? host_v : host_s)) / (runs / sim_host), sim);
+		if (diff) printf("  %d cars differ between the kernels\n", diff);
+		return diff != 0;
+	}
+
+	host = run(&b, avx2 ? batch_run_avx2 : batch_run_scalar);
+	for (i = 0; i < cars; i++) {
+		count[b.end[i]] += 1;
+		if (!quiet) result_line(&b, &p[i], i);
+	}
+	printf("%s kernel: %d done, %d lost, %d stopped, %d limit; %.3f s, %.1f cars/s, %.0f simulated s/s\n",
+		avx2 ? "avx2" : "scalar", count[BATCH_DONE], count[BATCH_LOST], count[BATCH_STOPPED], count[BATCH_LIMIT],
+		host, cars / host, sim_seconds(&b, cars) / host);
+	return 0;
+}
@@ -0,0 +1,51 @@
+/*
+	avr_bench harness for MyCar Golden: the firmware with its main()
+	renamed, INIT() as on the car, interrupts off, then every hot function
+	on fixed inputs, then 20 ms of its interrupts. Built for the atmega16
+	with the Release flags (Host/Makefile bench_golden.elf), run by
+	avr_bench. The ADC inputs come from the runner: the line under
+	sensors 3 and 4.
+*/
+
+#include "avr_bench.h"
+
+#define main fw_main
+#include "main.cpp"
+#undef main
+
+BENCH_FN(uint8_t, sensor_cmp, (void));
+BENCH_FN(void, cal_ratio, (void));
+BENCH_FN(void, handle, (int));
+BENCH_FN(void, speed, (int, int));
+BENCH_FN(void, led7, (unsigned int));
+BENCH_FN(void, print, (void));
+
+int main(void)
+{
+	INIT();
+	cli(); /* no timer, encoder or SPI interrupt inside a measured call */
+	for (uint8_t i = 0; i < 8; i++) ADC_average[i] = 512;
+	adc_read(0); /* the first conversion after ADEN is 25 ADC clocks, on the car only the first frame has it */
+	ratio = ratio_base = Q8_8(0.8);
+	velocity = 15;
+	pulse_ratio = 12;
+
+	bench_start();
+	BENCH("sensor_cmp()", bench_sink = bench_sensor_cmp());
+	cnt_ratio = 0;
+	BENCH("cal_ratio()", bench_cal_ratio()); /* counting */
+	cnt_ratio = SPEED_PERIOD_MS - 1;
+	BENCH("cal_ratio(step)", bench_cal_ratio()); /* speed PI step */
+	BENCH("handle(40)", bench_handle(40));
+	BENCH("speed(60,60)", bench_speed(60, 60));
+	BENCH("speed(-30,60)", bench_speed(-30, 60));
+	led7_last = 0xffff;
+	BENCH("led7(1234)", bench_led7(1234));
+	BENCH("led7(same)", bench_led7(1234)); /* unchanged, skipped */
+	spi_left = 0;
+	BENCH("print()", bench_print());
+	BENCH("print(busy)", bench_print());
+	bench_interrupts(20); /* 20 timer ticks, each with print() and its SPI_STC_vect pair */
+	bench_done();
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+	avr_bench harness for ITCarSS6 XE_V3: the firmware with its main()
+	renamed, INIT() as on the car, interrupts off, then every hot function
+	on fixed inputs, then 20 ms of its interrupts. Built for the atmega16a
+	with the Release flags (Host/Makefile bench_itcar.elf,
+	bench_itcar8.elf with ADC_8BIT), run by avr_bench.
+*/
+
+#include "avr_bench.h"
+
+#define main fw_main
+#include "XE.c"
+#undef main
+
+BENCH_FN(uint8_t, sensor_cmp, (uint8_t));
+BENCH_FN(void, cal_ratio, (void));
+BENCH_FN(void, handle, (int));
+BENCH_FN(void, speed, (int, int));
+BENCH_FN(void, led7, (unsigned int));
+BENCH_FN(void, print, (void));
+
+int main(void)
+{
+	INIT();
+	cli(); /* no timer, ADC, encoder or SPI interrupt inside a measured call */
+	adc_sensor = 0x18;
+	ratio = ratio_base = Q8_8(0.8);
+
+	bench_start();
+	BENCH("sensor_cmp(0xff)", bench_sink = bench_sensor_cmp(0xff));
+	BENCH("cal_ratio()", bench_cal_ratio());
+	BENCH("handle(40)", bench_handle(40));
+	BENCH("handle(200)", bench_handle(200)); /* clamped */
+	BENCH("speed(60,60)", bench_speed(60, 60));
+	BENCH("speed(-30,60)", bench_speed(-30, 60));
+	led7_last = 0xffff;
+	BENCH("led7(1234)", bench_led7(1234));
+	BENCH("led7(same)", bench_led7(1234)); /* unchanged, skipped */
+	spi_left = 0;
+	BENCH("print()", bench_print());
+	BENCH("print(busy)", bench_print());
+	bench_interrupts(20); /* 20 timer ticks, each with print() and its SPI_STC_vect pair */
+	bench_done();
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+	avr_bench harness for MCR/XE: the firmware with its main() renamed,
+	set up like main() does, interrupts off, then every hot function on
+	fixed inputs, then 20 ms of its interrupts. Built for the atmega16a
+	with the Release flags (Host/Makefile bench_mcr.elf, bench_mcr8.elf
+	with ADC_8BIT), run by avr_bench. The ADC inputs come from the
+	runner: the line under sensors 3 and 4.
+*/
+
+#include "avr_bench.h"
+
+#define main fw_main
+#include "XE.c"
+#undef main
+
+BENCH_FN(uint8_t, read_sensor, (void));
+BENCH_FN(int16_t, calc_cte, (uint8_t));
+BENCH_FN(int16_t, pid_Controller, (int16_t, int16_t, struct PID_DATA *));
+BENCH_FN(void, servo, (int));
+BENCH_FN(void, fwd, (uint16_t, uint16_t));
+BENCH_FN(void, set_led_data, (uint32_t));
+BENCH_FN(void, print, (void));
+
+int main(void)
+{
+	init();
+	cli(); //no timer, encoder or SPI interrupt inside a measured call
+	config_load();
+	tune_load(0);
+	pid_Init(K_P, K_I, K_D, &steer);
+	led_data.sensor_debug_output = 0x18;
+	set_led_data(1234);
+	read_adc(0); //the first conversion after ADEN is 25 ADC clocks, on the car only the first frame has it
+
+	bench_start();
+	adc_filter_reset();
+	BENCH("read_sensor()", bench_sink = bench_read_sensor());
+	BENCH("calc_cte(0x18)", bench_sink = bench_calc_cte(0x18)); //centred
+	BENCH("calc_cte(0x06)", bench_sink = bench_calc_cte(0x06)); //off to one side
+	BENCH("calc_cte(0x00)", bench_sink = bench_calc_cte(0x00)); //line lost, last cte
+	BENCH("pid_Controller(0,40)", bench_sink = bench_pid_Controller(0, 40, &steer));
+	BENCH("pid_Controller(0,-300)", bench_sink = bench_pid_Controller(0, -300, &steer));
+	BENCH("servo(40)", bench_servo(40));
+	BENCH("servo(200)", bench_servo(200)); //clamped
+	BENCH("fwd(60,60)", bench_fwd(60, 60));
+	BENCH("fwd(100,20)", bench_fwd(100, 20));
+	led_last = 0xffff;
+	BENCH("set_led_data(1234)", bench_set_led_data(1234));
+	BENCH("set_led_data(same)", bench_set_led_data(1234)); //unchanged, skipped
+	spi_left = 0;
+	BENCH("print()", bench_print());
+	BENCH("print(busy)", bench_print()); //last frame still shifting
+	bench_interrupts(20); //20 timer ticks, each with print() and its SPI_STC_vect pair
+	bench_done();
+	return 0;
+}
@@ -0,0 +1,115 @@
+/*
+	fixed_check: the fixed-point motor path (fixed.h) against the soft-float
+	expressions it replaced, over every input the firmware can produce.
+
+	usage: fixed_check
+
+	Each line reports how many outputs differ from the float version and
+	the largest difference, in the unit the output is written to hardware.
+	The large Golden error is switch 1 with the -0.35 step: in float
+	0.35 - 0.35 leaves 3e-8, which passes the ratio <= 0 clamp and stops
+	the motors. In Q8.8 it is exactly 0 and gets clamped to 0.1.
+	This only checks the arithmetic; the cycles are avr_bench's speed(),
+	fwd() and cal_ratio() cases (make avr_bench_run).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../Common/fixed.h"
+
+struct diff {
+	const char *name;
+	long n, bad;
+	int max;
+};
+
+static void count(struct diff *d, int old, int now) {
+	int e = abs(old - now);
+	d->n++;
+	if (e) d->bad++;
+	if (e > d->max) d->max = e;
+}
+
+static void report(const struct diff *d) {
+	printf("%-34s %8ld inputs %6ld differ  max |err| %d\n", d->name, d->n, d->bad, d->max);
+}
+
+/* ITCarSS6 and Golden speed(): left * ratio, ratio from the switches +- cal_ratio() steps */
+static void check_speed(const char *name, int base_pct, int step_pct, int steps, int clamp) {
+	static const float adj_f[] = { 0.0f, 0.3f, 0.1f, -0.35f, -0.25f };
+	static const q8_8_t adj_q[] = { 0, Q8_8(0.3), Q8_8(0.1), Q8_8(-0.35), Q8_8(-0.25) };
+	struct diff d = { name, 0, 0, 0 };
+	
+	for (int sw = 0; sw < steps; sw++) {
+		for (int a = 0; a < 5; a++) {
+			float rf = base_pct / 100.0f + (float)(sw * step_pct) / 100.0f + adj_f[a];
+			q8_8_t rq = q8_8_add(q8_8_from_pct(base_pct + sw * step_pct), adj_q[a]);
+			if (clamp && rf <= 0) rf = 0.1f;
+			if (clamp && rq <= 0) rq = Q8_8(0.1);
+			for (int v = -100; v <= 100; v++) {
+				int old = (int)(v * rf);
+				count(&d, old, q8_8_scale(v, rq));
+			}
+		}
+	}
+	report(&d);
+}
+
+/* MCR fwd(): uint16_t * L_MOTOR_RATIO / R_MOTOR_RATIO */
+static void check_fwd(void) {
+	struct diff d = { "MCR fwd() 0.7 / 0.5", 0, 0, 0 };
+	
+	for (unsigned v = 0; v <= 255; v++) {
+		count(&d, (uint16_t)(v * 0.7), q8_8_scale_u(v, Q8_8(0.7)));
+		count(&d, (uint16_t)(v * 0.5), q8_8_scale_u(v, Q8_8(0.5)));
+	}
+	report(&d);
+}
+
+/* MCR calc_motor_speed(), proportional branches */
+static void check_motor_speed(void) {
+	struct diff d = { "MCR calc_motor_speed()", 0, 0, 0 };
+	
+	for (int ms = 0; ms <= 250; ms++) {
+		for (int cte = -299; cte <= 299; cte++) {
+			uint16_t old_t, lo, lq;
+			int16_t t;
+			if (cte == 0) continue;
+			if (cte > 0) {
+				old_t = (int16_t)(ms * ((300.0 - cte) / 300.0));
+				t = ((int32_t)ms * (300 - cte)) / 300;
+			} else {
+				old_t = (int16_t)(ms * ((-300.0 - cte) / -300.0));
+				t = ((int32_t)ms * (300 + cte)) / 300;
+			}
+			old_t = (int16_t)(ms - (0.3 * old_t));
+			t = q15_sub_scaled(ms, t, Q15(0.3));
+			lo = (uint16_t)(old_t - (cte / 5));
+			lq = (uint16_t)(t - (cte / 5));
+			count(&d, (int16_t)lo, (int16_t)lq);
+		}
+	}
+	report(&d);
+}
+
+/* Golden sel_mode(): timer_cnt > 200 * (1.4 - 1.125 * ratio) */
+static void check_delay(void) {
+	struct diff d = { "Golden delay threshold (ms)", 0, 0, 0 };
+	
+	for (int sw = 0; sw < 8; sw++) {
+		float r = 0.30f + sw / 20.0f;
+		float delay = 1.4f - 1.125f * r;
+		int old = (int)(200 * delay); /* timer_cnt > old, timer_cnt integer */
+		count(&d, old, 280 - q8_8_scale(225, q8_8_from_pct(30 + sw * 5)));
+	}
+	report(&d);
+}
+
+int main(void) {
+	check_speed("ITCarSS6 speed() ratio", 10, 10, 5, 0);
+	check_speed("Golden speed() ratio", 30, 5, 8, 1);
+	check_fwd();
+	check_motor_speed();
+	check_delay();
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+	fw_run: one of the firmwares built natively on hal_host, driven from
+	the command line. Linked three times by the Makefile: fw_mcr (MCR/XE),
+	fw_itcar (ITCarSS6 XE_V3) and fw_golden (MyCar Golden).
+
+	usage: fw_run [options]
+	  -t ms          simulated run time (default 3000)
+	  -p ms:b[:hold] press button b (0..2 = BTN0..BTN2) at ms for hold ms
+	                 (default 150), repeat for a sequence
+	  -s n           DIP switches on, bits 0..3
+	  -a v[,v...]    10 bit ADC reading per channel 0..7 (default 800),
+	                 the last value repeats
+	  -w us          encoder edge every us microseconds (default none)
+	  -e file        eeprom image, read at start when it exists, written
+	                 at the end
+	  -v             a line every time servo or motors change
+
+	The summary line has the simulated time, the outputs, the ISR counts
+	and the host time per simulated second.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal_host.h"
+
+#define MAX_PRESS 32
+#define F_CPU_HZ 16000000UL
+
+typedef struct Press {
+	uint32_t at, hold;
+	uint8_t bit;
+} press_t;
+
+static press_t press[MAX_PRESS];
+static int presses;
+static uint16_t adc_in[8];
+static uint32_t ms_now;
+static int verbose;
+
+static uint16_t run_adc(void *ctx, uint8_t ch)
+{
+	(void)ctx;
+	return adc_in[ch];
+}
+
+static void run_ms(void *ctx)
+{
+	static uint16_t last_a, last_b;
+	static uint8_t last_c, last_d;
+	hal_host_t *h = &hal_host;
+	uint8_t pinb = 0xff;
+	int i;
+
+	(void)ctx;
+	ms_now += 1;
+	for (i = 0; i < presses; i++)
+		if (ms_now >= press[i].at && ms_now < press[i].at + press[i].hold) pinb &= ~press[i].bit;
+	h->pinb = pinb;
+
+	if (verbose && (h->ocr1a != last_a || h->ocr1b != last_b || h->ocr2 != last_c || h->portd != last_d)) {
+		printf("%7u ms  servo %5u  left %5u  right %3u  dir %02x  leds %02x  seg %02x\n",
+			(unsigned)ms_now, h->ocr1a, h->ocr1b, h->ocr2, h->portd, (uint8_t)~h->disp[0], h->disp[1]);
+		last_a = h->ocr1a;
+		last_b = h->ocr1b;
+		last_c = h->ocr2;
+		last_d = h->portd;
+	}
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: fw_run [-t ms] [-p ms:button[:hold]]... [-s switches] [-a v[,v...]] [-w us] [-e eeprom.bin] [-v]\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	const char *ee_file = NULL;
+	uint32_t run_ms_total = 3000, wheel_us = 0;
+	uint8_t switches = 0;
+	hal_host_t *h = &hal_host;
+	clock_t c0;
+	double host_s;
+	FILE *f;
+	int i, done;
+
+	for (i = 0; i < 8; i++) adc_in[i] = 800;
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+
+		if (a[0] != '-' || !a[1]) return usage();
+		if (a[1] == 'v') { verbose = 1; continue; }
+		if (i + 1 >= argc) return usage();
+		a = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 't': run_ms_total = strtoul(a, NULL, 0); break;
+		case 's': switches = strtoul(a, NULL, 0) & 0x0f; break;
+		case 'w': wheel_us = strtoul(a, NULL, 0); break;
+		case 'e': ee_file = a; break;
+		case 'p': {
+			unsigned at, b, hold = 150;
+			if (presses == MAX_PRESS || sscanf(a, "%u:%u:%u", &at, &b, &hold) < 2 || b > 2) return usage();
+			press[presses].at = at;
+			press[presses].hold = hold;
+			press[presses].bit = 2 << b; /* BTN0..BTN2 = PB1..PB3 */
+			presses++;
+			break;
+		}
+		case 'a': {
+			char *e;
+			int ch = 0;
+			do {
+				adc_in[ch++] = strtoul(a, &e, 0);
+				a = e + (*e == ',');
+			} while (*e == ',' && ch < 8);
+			for (; ch < 8; ch++) adc_in[ch] = adc_in[ch - 1];
+			break;
+		}
+		default: return usage();
+		}
+	}
+
+	memset(h->eeprom, 0xff, HAL_EE_SIZE); /* erased */
+	if (ee_file && (f = fopen(ee_file, "rb"))) {
+		if (fread(h->eeprom, 1, HAL_EE_SIZE, f) != HAL_EE_SIZE) fprintf(stderr, "fw_run: short eeprom image %s\n", ee_file);
+		fclose(f);
+	}
+	h->adc = run_adc;
+	h->ms = run_ms;
+	h->limit = (uint64_t)run_ms_total * (F_CPU_HZ / 1000);
+	hal_host_reset();
+	h->pinc = ~switches;
+	h->int0_period = wheel_us ? (uint64_t)wheel_us * (F_CPU_HZ / 1000000) : 0;
+
+	c0 = clock();
+	done = hal_host_run();
+	host_s = (double)(clock() - c0) / CLOCKS_PER_SEC;
+
+	printf("%s at %.3f s: servo %u left %u right %u dir %02x leds %02x seg %02x\n",
+		done ? "fw_main returned" : "stopped", h->cycles / (double)F_CPU_HZ,
+		h->ocr1a, h->ocr1b, h->ocr2, h->portd, (uint8_t)~h->disp[0], h->disp[1]);
+	printf("isr int0 %u spi %u udre %u adc %u ee %u t0 %u, eeprom %u bytes EEMEM, %.1f ms host per simulated s\n",
+		h->isr_count[HAL_V_INT0], h->isr_count[HAL_V_SPI], h->isr_count[HAL_V_UDRE], h->isr_count[HAL_V_ADC],
+		h->isr_count[HAL_V_EE], h->isr_count[HAL_V_T0], hal_host_ee_used(),
+		1000.0 * host_s / (h->cycles / (double)F_CPU_HZ));
+
+	if (ee_file) {
+		if (!(f = fopen(ee_file, "wb"))) {
+			perror(ee_file);
+			return 1;
+		}
+		fwrite(h->eeprom, 1, HAL_EE_SIZE, f);
+		fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""Generate flash-resident sensor-pattern decision tables.
+
+usage: gen_pattern_tables.py patterns.tbl pattern_tables.h
+
+Each table in the description becomes a 256-entry index (one byte per
+sensor value, mask already applied) into a de-duplicated row table, both
+in PROGMEM. Row 0 is always "do nothing".
+
+Description format, one rule per line, '#' starts a comment:
+
+    define NAME value              constant usable in expressions
+    table NAME mask 0bXXXXXXXX     start a table, rules match (sensor & mask)
+    VALUE [VALUE ...] ACTIONS      sensor values (after mask) and their actions
+    default ACTIONS                every value no rule names (default: nothing)
+
+Actions, any order:
+
+    handle EXPR                    steering angle for handle()
+    speed EXPR EXPR                left and right duty for speed()
+    encoder EXPR                   set_encoder() setpoint
+    next EXPR                      switch to this pattern
+"""
+
+import re
+import sys
+
+ROW_FIELDS = ("handle", "left", "right", "encoder", "next", "flags")
+FLAGS = {"handle": 0x01, "speed": 0x02, "encoder": 0x04}
+
+
+class Error(Exception):
+    pass
+
+
+def evaluate(expr, defines, where):
+    if not re.fullmatch(r"[\w\s+\-*/()]+", expr):
+        raise Error("%s: bad expression '%s'" % (where, expr))
+    try:
+        value = eval(expr, {"__builtins__": {}}, dict(defines))
+    except Exception as exc:  # noqa: BLE001 - report any evaluation problem
+        raise Error("%s: cannot evaluate '%s': %s" % (where, expr, exc))
+    if not isinstance(value, int):
+        raise Error("%s: '%s' is not an integer" % (where, expr))
+    return value
+
+
+def split_actions(tokens):
+    """Split 'handle 9+ADD speed 100 90' into [('handle', ['9+ADD']), ...]."""
+    actions = []
+    for tok in tokens:
+        if tok in ("handle", "speed", "encoder", "next"):
+            actions.append((tok, []))
+        elif actions:
+            actions[-1][1].append(tok)
+        else:
+            raise Error("unexpected '%s'" % tok)
+    return actions
+
+
+def make_row(actions, defines, where):
+    row = dict(handle=0, left=0, right=0, encoder=0, next=0, flags=0)
+    for name, args in actions:
+        want = 2 if name == "speed" else 1
+        if len(args) != want:
+            raise Error("%s: '%s' takes %d value(s)" % (where, name, want))
+        vals = [evaluate(a, defines, where) for a in args]
+        if name == "handle":
+            if not -32768 <= vals[0] <= 32767:
+                raise Error("%s: handle out of range" % where)
+            row["handle"] = vals[0]
+        elif name == "speed":
+            for v in vals:
+                if not -128 <= v <= 127:
+                    raise Error("%s: speed out of range" % where)
+            row["left"], row["right"] = vals
+        elif name == "encoder":
+            if not -128 <= vals[0] <= 127:
+                raise Error("%s: encoder out of range" % where)
+            row["encoder"] = vals[0]
+        elif name == "next":
+            if not 1 <= vals[0] <= 255:
+                raise Error("%s: next pattern out of range" % where)
+            row["next"] = vals[0]
+        row["flags"] |= FLAGS.get(name, 0)
+    return tuple(row[f] for f in ROW_FIELDS)
+
+
+def parse(path):
+    defines = {}
+    tables = []
+    table = None
+    with open(path, encoding="utf-8") as fp:
+        for lineno, line in enumerate(fp, 1):
+            where = "%s:%d" % (path, lineno)
+            tokens = line.split("#", 1)[0].split()
+            if not tokens:
+                continue
+            if tokens[0] == "define":
+                if len(tokens) < 3:
+                    raise Error("%s: define NAME value" % where)
+                defines[tokens[1]] = evaluate(" ".join(tokens[2:]), defines, where)
+            elif tokens[0] == "table":
+                if len(tokens) != 4 or tokens[2] != "mask":
+                    raise Error("%s: table NAME mask VALUE" % where)
+                table = dict(name=tokens[1], mask=int(tokens[3], 0), rules={},
+                             default=make_row([], defines, where), where=where)
+                tables.append(table)
+            elif table is None:
+                raise Error("%s: rule outside a table" % where)
+            else:
+                values = []
+                while tokens and re.fullmatch(r"0[bBxX][0-9a-fA-F]+|\d+|default", tokens[0]):
+                    values.append(tokens.pop(0))
+                if not values:
+                    raise Error("%s: rule without sensor value" % where)
+                row = make_row(split_actions(tokens), defines, where)
+                for v in values:
+                    if v == "default":
+                        table["default"] = row
+                        continue
+                    value = int(v, 0)
+                    if value & ~table["mask"] & 0xff or value > 0xff:
+                        raise Error("%s: %s is outside mask 0x%02x" % (where, v, table["mask"]))
+                    if value in table["rules"]:
+                        raise Error("%s: %s listed twice" % (where, v))
+                    table["rules"][value] = row
+    return tables
+
+
+def emit(tables, src, out):
+    lines = [
+        "/*",
+        " * %s" % out.replace("\\", "/").split("/")[-1],
+        " *",
+        " * Generated by Host/gen_pattern_tables.py from %s, do not edit." % src.replace("\\", "/").split("/")[-1],
+        " * Index: sensor byte -> row. Row 0 does nothing.",
+        " */",
+        "",
+        "#ifndef PATTERN_TABLES_H_",
+        "#define PATTERN_TABLES_H_",
+        "",
+        "#include \"hal.h\" /* PROGMEM, pgm_read_* */",
+        "",
+        "#define PT_HANDLE  0x01",
+        "#define PT_SPEED   0x02",
+        "#define PT_ENCODER 0x04",
+        "",
+        "typedef struct Pattern_row {",
+        "\tint16_t handle;",
+        "\tint8_t  left, right;",
+        "\tint8_t  encoder;",
+        "\tuint8_t next;",
+        "\tuint8_t flags;",
+        "} pattern_row_t;",
+        "",
+    ]
+    noop = (0, 0, 0, 0, 0, 0)
+    for t in tables:
+        rows = [noop]
+        index = []
+        for s in range(256):
+            row = t["rules"].get(s & t["mask"], t["default"])
+            if row not in rows:
+                rows.append(row)
+            index.append(rows.index(row))
+        if len(rows) > 256:
+            raise Error("%s: more than 256 distinct rows" % t["where"])
+        lines.append("/* %s: mask 0b%s, %d rows */" % (t["name"], format(t["mask"], "08b"), len(rows)))
+        lines.append("const pattern_row_t %s_rows[%d] PROGMEM = {" % (t["name"], len(rows)))
+        for r in rows:
+            lines.append("\t{ %5d, %4d, %4d, %4d, %3d, 0x%02x }," % r)
+        lines.append("};")
+        lines.append("const uint8_t %s_index[256] PROGMEM = {" % t["name"])
+        for i in range(0, 256, 16):
+            lines.append("\t" + ", ".join("%2d" % x for x in index[i:i + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+    lines += [
+        "static inline void pattern_row(const uint8_t *index, const pattern_row_t *rows, uint8_t sensor, pattern_row_t *row)",
+        "{",
+        "\tmemcpy_P(row, &rows[pgm_read_byte(&index[sensor])], sizeof(pattern_row_t));",
+        "}",
+        "",
+        "#endif /* PATTERN_TABLES_H_ */",
+        "",
+    ]
+    with open(out, "w", encoding="utf-8", newline="\n") as fp:
+        fp.write("\n".join(lines))
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 2
+    try:
+        emit(parse(argv[1]), argv[1], argv[2])
+    except Error as exc:
+        sys.stderr.write("gen_pattern_tables: %s\n" % exc)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
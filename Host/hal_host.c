@@ -0,0 +1,387 @@
+/*
+	hal_host: the board behind hal_host.h, see there.
+
+	Simulated time only moves inside the hal_*() calls. Each call costs
+	HAL_IO_CYCLES, a poll of the buttons HAL_POLL_CYCLES (the menu loops
+	spin on them), and a poll that finds nothing to do (ADC not done,
+	hal_idle()) jumps to the next event. Events set the interrupt flags,
+	hal_dispatch() runs the pending ISRs in AVR priority order while the
+	I flag is set, each with HAL_ISR_CYCLES of entry and exit.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include "hal_host.h"
+
+#define HAL_IO_CYCLES 1
+#define HAL_POLL_CYCLES 64
+#define HAL_ISR_CYCLES 20
+#define HAL_SPI_CYCLES 16 /* 8 bits at Fosc/2 */
+#define HAL_EE_CYCLES 136000 /* 8.5 ms */
+#define HAL_NEVER UINT64_MAX
+
+hal_host_t hal_host;
+static jmp_buf hal_exit;
+
+/* ISRs the firmware does not have */
+__attribute__((weak)) void INT0_vect(void) {}
+__attribute__((weak)) void SPI_STC_vect(void) {}
+__attribute__((weak)) void USART_UDRE_vect(void) {}
+__attribute__((weak)) void ADC_vect(void) {}
+__attribute__((weak)) void EE_RDY_vect(void) {}
+__attribute__((weak)) void TIMER0_COMP_vect(void) {}
+
+static void (*const hal_vector[HAL_VECTORS])(void) = {
+	INT0_vect, SPI_STC_vect, USART_UDRE_vect, ADC_vect, EE_RDY_vect, TIMER0_COMP_vect
+};
+
+/* EEMEM variables, laid out by the linker from eeprom address 0 */
+extern uint8_t __start_hal_eeprom[] __attribute__((weak));
+extern uint8_t __stop_hal_eeprom[] __attribute__((weak));
+
+static int hal_pending(int v)
+{
+	hal_host_t *h = &hal_host;
+
+	switch (v) {
+	case HAL_V_INT0: return h->int0_on && h->flag[v];
+	case HAL_V_SPI: return h->spi_ie && h->flag[v];
+	case HAL_V_UDRE: return h->udr_ie && h->cycles >= h->uart_free;
+	case HAL_V_ADC: return h->adc_ie && h->flag[v];
+	case HAL_V_EE: return h->ee_ie && h->cycles >= h->ee_ready;
+	case HAL_V_T0: return h->t0_on && h->flag[v];
+	}
+	return 0;
+}
+
+static void hal_dispatch(void)
+{
+	hal_host_t *h = &hal_host;
+	int v;
+
+	while (h->sreg_i && !h->in_isr) {
+		for (v = 0; v < HAL_VECTORS && !hal_pending(v); v++);
+		if (v == HAL_VECTORS) return;
+		h->flag[v] = 0;
+		h->isr_count[v] += 1;
+		h->in_isr = 1;
+		h->sreg_i = 0;
+		h->cycles += HAL_ISR_CYCLES;
+		hal_vector[v]();
+		h->sreg_i = 1;
+		h->in_isr = 0;
+	}
+}
+
+static uint64_t hal_next_event(void)
+{
+	hal_host_t *h = &hal_host;
+	uint64_t t = HAL_NEVER;
+
+	if (h->t0_on && h->t0_next < t) t = h->t0_next;
+	if (h->adc_busy && h->adc_done < t) t = h->adc_done;
+	if (h->spi_done > h->cycles && h->spi_done < t) t = h->spi_done;
+	if (h->udr_ie && h->uart_free > h->cycles && h->uart_free < t) t = h->uart_free;
+	if (h->ee_ie && h->ee_ready > h->cycles && h->ee_ready < t) t = h->ee_ready;
+	if (h->int0_on && h->int0_period && h->int0_next < t) t = h->int0_next;
+	return t;
+}
+
+/* the peripherals at time h->cycles */
+static void hal_events(void)
+{
+	hal_host_t *h = &hal_host;
+
+	if (h->t0_on && h->cycles >= h->t0_next) {
+		h->t0_next += HAL_T0_CYCLES;
+		if (h->ms) h->ms(h->ctx);
+		h->flag[HAL_V_T0] = 1;
+	}
+	if (h->adc_busy && h->cycles >= h->adc_done) {
+		uint8_t ch = h->admux & 7;
+		uint16_t v = h->adc ? h->adc(h->ctx, ch) : 1023;
+
+		if (v > 1023) v = 1023;
+		h->adc_value = (h->admux & (1 << ADLAR)) ? v << 6 : v;
+		h->adc_busy = 0;
+		h->flag[HAL_V_ADC] = 1;
+	}
+	if (h->spi_done && h->cycles >= h->spi_done) {
+		h->spi_done = 0;
+		h->flag[HAL_V_SPI] = 1;
+	}
+	if (h->int0_on && h->int0_period) {
+		if (h->int0_next + h->int0_period < h->cycles) h->int0_next = h->cycles; /* wheel just started */
+		if (h->cycles >= h->int0_next) {
+			h->int0_next += h->int0_period;
+			h->flag[HAL_V_INT0] = 1;
+		}
+	}
+}
+
+void hal_host_advance(uint32_t n)
+{
+	hal_host_t *h = &hal_host;
+	uint64_t end = h->cycles + n, t;
+
+	while ((t = hal_next_event()) <= end) {
+		if (t > h->cycles) h->cycles = t;
+		hal_events();
+		hal_dispatch();
+		if (h->cycles >= h->limit) longjmp(hal_exit, 1);
+	}
+	if (end > h->cycles) h->cycles = end;
+	hal_dispatch();
+	if (h->cycles >= h->limit) longjmp(hal_exit, 1);
+}
+
+void hal_idle(void)
+{
+	hal_host_t *h = &hal_host;
+	uint64_t t = hal_next_event();
+
+	hal_host_advance(t > h->cycles && t - h->cycles < HAL_T0_CYCLES ? (uint32_t)(t - h->cycles) : HAL_T0_CYCLES);
+}
+
+void hal_host_cli(void) { hal_host.sreg_i = 0; }
+
+void hal_host_sei(void)
+{
+	hal_host.sreg_i = 1;
+	hal_dispatch();
+}
+
+uint8_t hal_host_atomic_begin(void)
+{
+	uint8_t s = hal_host.sreg_i;
+
+	hal_host.sreg_i = 0;
+	return s;
+}
+
+void hal_host_atomic_end(uint8_t s)
+{
+	hal_host.sreg_i = s;
+	hal_dispatch();
+}
+
+/* hal.h */
+uint8_t hal_buttons(void) { hal_host_advance(HAL_POLL_CYCLES); return hal_host.pinb; }
+uint8_t hal_switches(void) { hal_host_advance(HAL_POLL_CYCLES); return hal_host.pinc; }
+void hal_servo(uint16_t ocr) { hal_host.ocr1a = ocr; hal_host_advance(HAL_IO_CYCLES); }
+void hal_motor_l(uint16_t ocr) { hal_host.ocr1b = ocr; hal_host_advance(HAL_IO_CYCLES); }
+void hal_motor_r(uint8_t ocr) { hal_host.ocr2 = ocr; hal_host_advance(HAL_IO_CYCLES); }
+uint16_t hal_motor_l_get(void) { return hal_host.ocr1b; }
+uint8_t hal_motor_r_get(void) { return hal_host.ocr2; }
+void hal_dir_set(uint8_t bit) { hal_host.portd |= 1 << bit; hal_host_advance(HAL_IO_CYCLES); }
+void hal_dir_clr(uint8_t bit) { hal_host.portd &= ~(1 << bit); hal_host_advance(HAL_IO_CYCLES); }
+
+void hal_adc_start(uint8_t admux)
+{
+	hal_host_t *h = &hal_host;
+
+	h->admux = admux;
+	h->flag[HAL_V_ADC] = 0; /* the ADCSRA read-modify-write writes ADIF back as 1, clearing it */
+	h->adc_busy = 1;
+	h->adc_done = h->cycles + 13 * h->adc_ps;
+	hal_host_advance(HAL_IO_CYCLES);
+}
+
+uint8_t hal_adc_done(void)
+{
+	if (!hal_host.flag[HAL_V_ADC]) hal_idle();
+	return hal_host.flag[HAL_V_ADC];
+}
+
+uint16_t hal_adc10(void) { return hal_host.adc_value; }
+uint8_t hal_adc8(void) { return hal_host.adc_value >> 8; }
+void hal_adc_irq_on(void) { hal_host.adc_ie = 1; hal_dispatch(); }
+void hal_adc_irq_off(void) { hal_host.adc_ie = 0; }
+
+void hal_spi_write(uint8_t b)
+{
+	hal_host_t *h = &hal_host;
+
+	h->spi[0] = h->spi[1];
+	h->spi[1] = b;
+	h->spi_done = h->cycles + HAL_SPI_CYCLES;
+	hal_host_advance(HAL_IO_CYCLES);
+}
+
+void hal_latch_pulse(void)
+{
+	hal_host.disp[0] = hal_host.spi[0];
+	hal_host.disp[1] = hal_host.spi[1];
+	hal_host.latches += 1;
+	hal_host_advance(2 * HAL_IO_CYCLES);
+}
+
+uint8_t hal_t0_count(void)
+{
+	return (uint8_t)((hal_host.cycles - (hal_host.t0_next - HAL_T0_CYCLES)) / 256);
+}
+
+uint8_t hal_t0_pending(void) { return hal_host.flag[HAL_V_T0]; }
+uint16_t hal_t1_count(void) { return (uint16_t)((hal_host.cycles / 8) % (HAL_T1_TOP + 1)); }
+
+void hal_uart_put(uint8_t b)
+{
+	hal_host_t *h = &hal_host;
+
+	if (h->uart) h->uart(h->ctx, b);
+	h->uart_free = (h->uart_free > h->cycles ? h->uart_free : h->cycles) + h->uart_cycles;
+	hal_host_advance(HAL_IO_CYCLES);
+}
+
+void hal_uart_irq_on(void) { hal_host.udr_ie = 1; hal_dispatch(); }
+void hal_uart_irq_off(void) { hal_host.udr_ie = 0; }
+void hal_ee_irq_on(void) { hal_host.ee_ie = 1; hal_dispatch(); }
+void hal_ee_irq_off(void) { hal_host.ee_ie = 0; }
+
+void hal_init_adc(uint8_t admux, uint8_t adcsra)
+{
+	hal_host.admux = admux;
+	hal_host.adc_ie = (adcsra >> ADIE) & 1;
+	hal_host.adc_ps = (adcsra & 7) ? 1 << (adcsra & 7) : 2;
+}
+
+void hal_init_ports(uint8_t portd) { hal_host.portd = portd; }
+void hal_init_spi(void) { hal_host.spi_ie = 1; }
+
+void hal_init_timers(void)
+{
+	hal_host.t0_on = 1;
+	hal_host.t0_next = hal_host.cycles + HAL_T0_CYCLES;
+	hal_host.ocr2 = 0;
+}
+
+void hal_init_encoder(uint8_t isc) { (void)isc; hal_host.int0_on = 1; }
+void hal_init_uart(uint8_t ubrr) { hal_host.uart_cycles = 80 * (ubrr + 1); } /* 10 bits, U2X */
+
+/* eeprom */
+static uint16_t hal_ee_addr(const void *p, size_t n)
+{
+	uintptr_t a = (uintptr_t)p;
+
+	if (__start_hal_eeprom && p >= (void *)__start_hal_eeprom && p < (void *)__stop_hal_eeprom)
+		a = (uint8_t *)p - __start_hal_eeprom;
+	if (a + n > HAL_EE_SIZE) {
+		fprintf(stderr, "hal_host: eeprom access %p+%zu outside %d bytes\n", p, n, HAL_EE_SIZE);
+		exit(2);
+	}
+	return (uint16_t)a;
+}
+
+uint8_t eeprom_is_ready(void) { return hal_host.cycles >= hal_host.ee_ready; }
+
+void eeprom_busy_wait(void)
+{
+	while (!eeprom_is_ready()) hal_idle();
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	eeprom_busy_wait();
+	return hal_host.eeprom[hal_ee_addr(p, 1)];
+}
+
+uint16_t eeprom_read_word(const uint16_t *p)
+{
+	uint16_t a;
+
+	eeprom_busy_wait();
+	a = hal_ee_addr(p, 2);
+	return hal_host.eeprom[a] | hal_host.eeprom[a + 1] << 8;
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	eeprom_busy_wait();
+	memcpy(dst, &hal_host.eeprom[hal_ee_addr(src, n)], n);
+}
+
+void eeprom_write_byte(uint8_t *p, uint8_t v)
+{
+	uint16_t a = hal_ee_addr(p, 1);
+
+	eeprom_busy_wait();
+	hal_host.eeprom[a] = v;
+	hal_host.ee_ready = hal_host.cycles + HAL_EE_CYCLES;
+}
+
+void eeprom_update_byte(uint8_t *p, uint8_t v)
+{
+	if (hal_host.eeprom[hal_ee_addr(p, 1)] != v) eeprom_write_byte(p, v);
+}
+
+void eeprom_write_word(uint16_t *p, uint16_t v)
+{
+	eeprom_write_byte((uint8_t *)p, v);
+	eeprom_write_byte((uint8_t *)p + 1, v >> 8);
+}
+
+void eeprom_update_word(uint16_t *p, uint16_t v)
+{
+	eeprom_update_byte((uint8_t *)p, v);
+	eeprom_update_byte((uint8_t *)p + 1, v >> 8);
+}
+
+void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++) eeprom_write_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++) eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+}
+
+uint16_t hal_host_ee_addr(const void *p)
+{
+	return hal_ee_addr(p, 1);
+}
+
+uint16_t hal_host_ee_used(void)
+{
+	return __start_hal_eeprom ? (uint16_t)(__stop_hal_eeprom - __start_hal_eeprom) : 0;
+}
+
+/* power on: registers cleared, I flag off, eeprom and the callbacks kept */
+void hal_host_reset(void)
+{
+	hal_host_t *h = &hal_host;
+	uint8_t ee[HAL_EE_SIZE];
+
+	memcpy(ee, h->eeprom, sizeof(ee));
+	uint16_t (*adc)(void *, uint8_t) = h->adc;
+	void (*ms)(void *) = h->ms;
+	void (*uart)(void *, uint8_t) = h->uart;
+	void *ctx = h->ctx;
+	uint64_t limit = h->limit;
+
+	memset(h, 0, sizeof(*h));
+	memcpy(h->eeprom, ee, sizeof(ee));
+	h->adc = adc;
+	h->ms = ms;
+	h->uart = uart;
+	h->ctx = ctx;
+	h->limit = limit;
+	h->pinb = h->pinc = 0xff;
+}
+
+int hal_host_call(int (*entry)(void))
+{
+	if (hal_host_ee_used() > HAL_EE_SIZE) {
+		fprintf(stderr, "hal_host: EEMEM variables take %u bytes, eeprom has %d\n", hal_host_ee_used(), HAL_EE_SIZE);
+		exit(2);
+	}
+	if (setjmp(hal_exit)) return 0;
+	entry();
+	return 1;
+}
+
+int hal_host_run(void)
+{
+	return hal_host_call(fw_main);
+}
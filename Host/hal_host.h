@@ -0,0 +1,206 @@
+/*
+	hal.h backend for building the firmware as a native program.
+
+	The firmware headers include hal.h as on the car; with -DHAL_HOST it
+	lands here instead of hal_avr.h. Every hal_*() call is a function in
+	hal_host.c that acts on the simulated board in hal_host and advances
+	simulated time (hal_host.cycles, 16 MHz CPU clocks). Time moving on
+	fires the peripherals as events and runs the firmware's ISRs between
+	its own statements when interrupts are enabled:
+	  Timer0       every 63 * 256 clocks (1.008 ms), TIMER0_COMP_vect
+	  ADC          13 ADC clocks after hal_adc_start(), ADC_vect with ADIE
+	  SPI          16 clocks per byte, SPI_STC_vect
+	  USART        80 * (UBRR + 1) clocks per byte (U2X, 640 at 250 kbaud),
+	               USART_UDRE_vect
+	  eeprom       8.5 ms per written byte, EE_RDY_vect with EERIE
+	  encoder      one INT0_vect every hal_host.int0_period clocks
+	Control code between hal_*() calls takes no simulated time, so a run
+	reproduces the firmware's decisions and timing structure, not its
+	cycle counts.
+
+	The rest of what the firmware takes from avr-libc is here too: cli(),
+	sei(), ATOMIC_BLOCK, _delay_ms(), the eeprom_*() calls on
+	hal_host.eeprom (EEMEM variables live in their own section and map to
+	eeprom addresses from 0 up), PROGMEM and _crc16_update().
+
+	Build the firmware's .c/.cpp with -DHAL_HOST -Dmain=fw_main
+	-fpack-struct (AVR struct layout, the projects pack too) and link it
+	with hal_host.c, see Host/Makefile. int is 32 bit here.
+*/
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HAL_EE_SIZE 512
+#define HAL_T0_CYCLES (63UL * 256)
+
+/* interrupt sources, in AVR priority order */
+enum { HAL_V_INT0, HAL_V_SPI, HAL_V_UDRE, HAL_V_ADC, HAL_V_EE, HAL_V_T0, HAL_VECTORS };
+
+/* fields sorted by size: the same layout with and without -fpack-struct */
+typedef struct Hal_host {
+	uint64_t cycles;           /* simulated time */
+	uint64_t limit;            /* hal_host_run() stops here */
+	uint64_t int0_period;      /* input: clocks between encoder edges, 0 = wheel stopped */
+
+	/* inputs, set by the runner or the simulator */
+	uint16_t (*adc)(void *ctx, uint8_t ch); /* 10 bit reading of a channel, NULL = 1023 */
+	void (*ms)(void *ctx);     /* every Timer0 tick, before TIMER0_COMP_vect */
+	void (*uart)(void *ctx, uint8_t b); /* every byte the firmware sends */
+	void *ctx;
+
+	/* peripheral state, hal_host.c only */
+	uint64_t t0_next, adc_done, spi_done, uart_free, ee_ready, int0_next;
+
+	/* outputs */
+	uint32_t latches;
+	uint32_t isr_count[HAL_VECTORS];
+	uint16_t ocr1a, ocr1b;     /* servo, left motor */
+	uint8_t ocr2, portd;       /* right motor, direction pins */
+	uint8_t spi[2];            /* last two bytes shifted out, spi[1] newest */
+	uint8_t disp[2];           /* spi[] at the last latch pulse */
+	uint8_t eeprom[HAL_EE_SIZE];
+
+	/* inputs */
+	uint8_t pinb, pinc;        /* buttons and switches, active low */
+
+	/* peripheral state, hal_host.c only */
+	uint16_t adc_value, uart_cycles;
+	uint8_t sreg_i, in_isr;
+	uint8_t t0_on, adc_ie, spi_ie, udr_ie, ee_ie, int0_on;
+	uint8_t flag[HAL_VECTORS]; /* edge triggered flags: INT0, SPI, ADC, T0 */
+	uint8_t admux, adc_ps, adc_busy;
+} hal_host_t;
+
+extern hal_host_t hal_host;
+
+void hal_host_reset(void); /* power on, eeprom kept */
+int hal_host_run(void); /* fw_main() until hal_host.limit: 0 time up, 1 fw_main() returned */
+int hal_host_call(int (*entry)(void)); /* the same with another entry into the firmware */
+uint16_t hal_host_ee_used(void); /* bytes of EEMEM variables */
+uint16_t hal_host_ee_addr(const void *p); /* eeprom address of an EEMEM variable */
+void hal_host_advance(uint32_t cycles);
+
+int fw_main(void); /* the firmware's main(), renamed by -Dmain=fw_main */
+
+/* hal.h */
+void hal_idle(void);
+uint8_t hal_buttons(void);
+uint8_t hal_switches(void);
+void hal_servo(uint16_t ocr);
+void hal_motor_l(uint16_t ocr);
+void hal_motor_r(uint8_t ocr);
+uint16_t hal_motor_l_get(void);
+uint8_t hal_motor_r_get(void);
+void hal_dir_set(uint8_t bit);
+void hal_dir_clr(uint8_t bit);
+void hal_adc_start(uint8_t admux);
+uint8_t hal_adc_done(void);
+uint16_t hal_adc10(void);
+uint8_t hal_adc8(void);
+void hal_adc_irq_on(void);
+void hal_adc_irq_off(void);
+void hal_spi_write(uint8_t b);
+void hal_latch_pulse(void);
+uint8_t hal_t0_count(void);
+uint8_t hal_t0_pending(void);
+uint16_t hal_t1_count(void);
+#define HAL_T1_TOP 20000 /* as hal_avr.h */
+void hal_uart_put(uint8_t b);
+void hal_uart_irq_on(void);
+void hal_uart_irq_off(void);
+void hal_ee_irq_on(void);
+void hal_ee_irq_off(void);
+void hal_init_adc(uint8_t admux, uint8_t adcsra);
+void hal_init_ports(uint8_t portd);
+void hal_init_spi(void);
+void hal_init_timers(void);
+void hal_init_encoder(uint8_t isc);
+void hal_init_uart(uint8_t ubrr);
+
+/* register bits the firmware passes to the hal_init_*() calls */
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE  3
+#define ADIF  4
+#define ADSC  6
+#define ADEN  7
+#define ADLAR 5
+#define REFS0 6
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+
+/* avr/interrupt.h */
+void hal_host_cli(void);
+void hal_host_sei(void);
+#define cli() hal_host_cli()
+#define sei() hal_host_sei()
+
+void INT0_vect(void);
+void SPI_STC_vect(void);
+void USART_UDRE_vect(void);
+void ADC_vect(void);
+void EE_RDY_vect(void);
+void TIMER0_COMP_vect(void);
+
+#ifdef __cplusplus
+#define ISR(vector) extern "C" void vector(void)
+#else
+#define ISR(vector) void vector(void)
+#endif
+
+/* util/atomic.h */
+uint8_t hal_host_atomic_begin(void);
+void hal_host_atomic_end(uint8_t sreg_i);
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (uint8_t hal_sreg_ = hal_host_atomic_begin(), hal_once_ = 1; hal_once_; hal_host_atomic_end(hal_sreg_), hal_once_ = 0)
+
+/* util/delay.h */
+#define _delay_ms(ms) hal_host_advance((uint32_t)((ms) * (F_CPU / 1000)))
+#define _delay_us(us) hal_host_advance((uint32_t)((us) * (F_CPU / 1000000)))
+
+/* avr/eeprom.h */
+#define EEMEM __attribute__((section("hal_eeprom"), used, aligned(1))) /* packed like the AVR .eeprom */
+uint8_t eeprom_is_ready(void);
+void eeprom_busy_wait(void);
+uint8_t eeprom_read_byte(const uint8_t *p);
+uint16_t eeprom_read_word(const uint16_t *p);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_write_byte(uint8_t *p, uint8_t v);
+void eeprom_write_word(uint16_t *p, uint16_t v);
+void eeprom_write_block(const void *src, void *dst, size_t n);
+void eeprom_update_byte(uint8_t *p, uint8_t v);
+void eeprom_update_word(uint16_t *p, uint16_t v);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+/* avr/pgmspace.h */
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define memcpy_P memcpy
+
+/* util/crc16.h */
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+	crc ^= a;
+	for (uint8_t i = 0; i < 8; i++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	return crc;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_HOST_H_ */
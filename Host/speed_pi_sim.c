@@ -0,0 +1,110 @@
+/*
+	speed_pi_sim: step response of the Golden wheel speed loop, old
+	bang-bang cal_ratio() against the PI controller in speed_pi.h.
+
+	usage: speed_pi_sim [kv] [tau_ms] [base_pct]
+
+	Plant: first order motor, kv pulses per period at ratio 1.0 and
+	speed(100, 100), time constant tau_ms, integer encoder counts.
+	Defaults kv 40, tau 60 ms, ratio_base 30 % (switches at 0).
+	At 1.5 s the load rises (kv * 0.7, a ramp or the bridge) to check
+	the recovery.
+
+	overshoot   peak count above the setpoint, % of setpoint
+	settle      last time the count left setpoint +- max(1, 10 %), ms
+	ripple      peak to peak count in the last 0.5 s before the load step
+	recover     same as settle, measured from the load step
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../MyCar/Golden/Car1/Ver1/speed_pi.h"
+
+#define SIM_MS 3000
+#define LOAD_MS 1500
+#define CMD 100
+
+static double kv = 40.0, tau = 60.0;
+static int base_pct = 30;
+
+/* cal_ratio() before the PI controller, in Q8.8 */
+static q8_8_t old_step(q8_8_t base, int16_t velocity, int16_t pulse_ratio) {
+	q8_8_t ratio;
+	
+	if (velocity < 0) return base;
+	if      (pulse_ratio < velocity / 2)    ratio = q8_8_add(base, Q8_8(0.3));
+	else if (pulse_ratio < velocity)        ratio = q8_8_add(base, Q8_8(0.1));
+	else if (pulse_ratio > velocity)        ratio = q8_8_add(base, Q8_8(-0.35));
+	else if (pulse_ratio > velocity / 2)    ratio = q8_8_add(base, Q8_8(-0.25));
+	else ratio = base;
+	if (ratio <= 0) ratio = Q8_8(0.1);
+	return ratio;
+}
+
+struct result {
+	int overshoot, settle, ripple, recover;
+};
+
+static int outside(int count, int set) {
+	int band = set / 10 > 1 ? set / 10 : 1;
+	return abs(count - set) > band;
+}
+
+static struct result run(int use_pi, int set) {
+	struct result r = { 0, 0, 0, 0 };
+	speed_pi_t pi;
+	q8_8_t base = q8_8_from_pct(base_pct), ratio = base;
+	double w = 0, acc = 0; /* speed in pulses per period, fractional pulses */
+	int pulses = 0, cnt = 0, peak = 0, lo = 1 << 30, hi = -1;
+	
+	speed_pi_reset(&pi);
+	for (int t = 1; t <= SIM_MS; t++) {
+		double k = t < LOAD_MS ? kv : kv * 0.7;
+		w += ((k * ratio / 256.0) * CMD / 100.0 - w) / tau;
+		acc += w / SPEED_PERIOD_MS;
+		while (acc >= 1.0) { acc -= 1.0; pulses++; }
+		
+		if (++cnt < SPEED_PERIOD_MS) continue;
+		cnt = 0;
+		if (t < LOAD_MS) {
+			if (pulses > peak) peak = pulses;
+			if (outside(pulses, set)) r.settle = t;
+			if (t >= LOAD_MS - 500) {
+				if (pulses < lo) lo = pulses;
+				if (pulses > hi) hi = pulses;
+			}
+		} else if (outside(pulses, set)) {
+			r.recover = t - LOAD_MS;
+		}
+		ratio = use_pi ? speed_pi_step(&pi, base, set, pulses) : old_step(base, set, pulses);
+		pulses = 0;
+	}
+	r.overshoot = peak > set ? (peak - set) * 100 / set : 0;
+	r.ripple = hi - lo;
+	return r;
+}
+
+static void print(const char *name, struct result r) {
+	printf("  %-10s overshoot %3d %%  settle ", name, r.overshoot);
+	if (r.settle >= LOAD_MS - SPEED_PERIOD_MS) printf("  never");
+	else printf("%5d ms", r.settle);
+	printf("  ripple %2d  recover ", r.ripple);
+	if (r.recover >= SIM_MS - LOAD_MS - SPEED_PERIOD_MS) printf("  never\n");
+	else printf("%5d ms\n", r.recover);
+}
+
+int main(int argc, char **argv) {
+	static const int sets[] = { 6, 8, 10, 12, 15 };
+	
+	if (argc > 1) kv = atof(argv[1]);
+	if (argc > 2) tau = atof(argv[2]);
+	if (argc > 3) base_pct = atoi(argv[3]);
+	printf("kv %.1f pulses/period, tau %.0f ms, ratio_base %d %%, period %d ms\n",
+		kv, tau, base_pct, SPEED_PERIOD_MS);
+	for (unsigned i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+		printf("setpoint %d pulses/period\n", sets[i]);
+		print("bang-bang", run(0, sets[i]));
+		print("PI", run(1, sets[i]));
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+	telem_decode: MCR/XE/telemetry.h record stream to CSV.
+
+	usage: telem_decode [file]      (stdin when no file)
+
+	Capture from the car, for example:
+	  stty -F /dev/ttyUSB0 250000 raw -echo
+	  telem_decode /dev/ttyUSB0 > run.csv
+
+	Records are found by the 0xA5 sync byte and accepted only when the
+	checksum matches, so a stream joined mid-record or a dropped byte
+	costs one record. The CSV header is printed again whenever the field
+	set changes. Counts of good and bad records go to stderr.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TELEM_SYNC 0xA5
+#define TELEM_F_ADC 0x01
+#define TELEM_F_SERVO 0x02
+#define TELEM_F_MOTOR 0x04
+#define TELEM_F_ENC 0x08
+
+static int bits(unsigned v) {
+	int n = 0;
+	for (; v; v >>= 1) n += v & 1;
+	return n;
+}
+
+/* record length from the bytes after the sync, 0 if not known yet */
+static int record_len(const uint8_t *r, int have) {
+	int n = 2 + 2 + 1 + 1 + 1; /* sync fields tick sensor state ... sum */
+	
+	if (have < 2) return 0;
+	if (r[1] & ~0x0f) return -1;
+	if (r[1] & TELEM_F_ADC) {
+		if (have < 3) return 0;
+		n += 1 + 2 * bits(r[2]);
+	}
+	if (r[1] & TELEM_F_SERVO) n += 2;
+	if (r[1] & TELEM_F_MOTOR) n += 3;
+	if (r[1] & TELEM_F_ENC) n += 2;
+	return n;
+}
+
+static unsigned u16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static void header(uint8_t fields, uint8_t adc_mask) {
+	printf("tick,sensor,state");
+	if (fields & TELEM_F_ADC)
+		for (int i = 0; i < 8; i++) if (adc_mask & (1 << i)) printf(",adc%d", i);
+	if (fields & TELEM_F_SERVO) printf(",servo");
+	if (fields & TELEM_F_MOTOR) printf(",ocr1b,ocr2");
+	if (fields & TELEM_F_ENC) printf(",encoder");
+	printf("\n");
+}
+
+static void emit(const uint8_t *r) {
+	const uint8_t *p = r + 2;
+	uint8_t fields = r[1], adc_mask = 0;
+	
+	if (fields & TELEM_F_ADC) adc_mask = *p++;
+	printf("%u,%u,%u", u16(p), p[2], p[3]);
+	p += 4;
+	if (fields & TELEM_F_ADC)
+		for (int i = 0; i < 8; i++) if (adc_mask & (1 << i)) { printf(",%u", u16(p)); p += 2; }
+	if (fields & TELEM_F_SERVO) { printf(",%d", (int16_t)u16(p)); p += 2; }
+	if (fields & TELEM_F_MOTOR) { printf(",%u,%u", u16(p), p[2]); p += 3; }
+	if (fields & TELEM_F_ENC) { printf(",%u", u16(p)); p += 2; }
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	FILE *in = stdin;
+	uint8_t r[64];
+	int have = 0, c, last_fields = -1, last_mask = -1;
+	long good = 0, bad = 0;
+	
+	if (argc > 1 && !(in = fopen(argv[1], "rb"))) {
+		perror(argv[1]);
+		return 1;
+	}
+	while ((c = fgetc(in)) != EOF) {
+		if (have == 0 && c != TELEM_SYNC) continue;
+		r[have++] = c;
+		for (;;) {
+			int n = record_len(r, have);
+			uint8_t sum = 0;
+			if (n == 0 || (n > 0 && have < n)) break;
+			if (n > 0) {
+				for (int i = 1; i < n - 1; i++) sum += r[i];
+				if (sum == r[n - 1]) {
+					int mask = (r[1] & TELEM_F_ADC) ? r[2] : 0;
+					if (r[1] != last_fields || mask != last_mask) header(r[1], mask);
+					last_fields = r[1];
+					last_mask = mask;
+					emit(r);
+					good++;
+					memmove(r, r + n, have - n);
+					have -= n;
+					continue;
+				}
+			}
+			/* bad record: resync on the next 0xA5 after this one */
+			bad++;
+			int k = 1;
+			while (k < have && r[k] != TELEM_SYNC) k++;
+			memmove(r, r + k, have - k);
+			have -= k;
+			if (have == 0) break;
+		}
+		fflush(stdout);
+	}
+	fprintf(stderr, "%ld records, %ld bad\n", good, bad);
+	return 0;
+}
@@ -0,0 +1,328 @@
+/*
+	trace_replay: a run of the MCR car recorded with trace.h, run again
+	through the native build of its firmware and compared decision by
+	decision.
+
+	The trace holds what the car saw, the conversions of every sensor
+	frame with the encoder count, buttons and switches at that frame, and
+	what it did at the end of every control task: state, sensor frame,
+	servo command and motor duty. The replay writes the run's calibration
+	and profile from the trace header into the eeprom, loads them as the
+	car does, calls pid_start() and then control_task() once per recorded
+	decision on hal_host. Each read_sensor() takes the next frame of the
+	trace, the manoeuvre loops included. No timer runs and nothing else
+	feeds the firmware, so a replay depends on the trace and the firmware
+	alone and gives the same answer every time.
+
+	Each control task starts on the frame the car's did, so a task that
+	went another way is one difference and the next ones still compare.
+
+	usage: trace_replay [options] trace.bin
+	  -n n      differences printed per run (default 10)
+	  -c file   CSV of every control task of the last run, car and replay
+	  -r n      only run n (1 = the first header in the file)
+	  -k        go on past a gap (a record the car dropped): the task
+	            it falls in runs but is not compared, the ones after are
+	  -v        the records in the file
+	A capture can hold several runs (power cycles), each from its own
+	header; every run is replayed in its own process, a fresh power-on.
+
+	Exit status 0 when every decision replayed matched, 1 on a difference, 2 for a
+	trace this build cannot replay. For a firmware bisect:
+	  git bisect run sh -c 'make -C Host trace_replay && Host/trace_replay heat3.bin'
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "hal_host.h"
+
+#define TRACE_SYNC 0x5A
+#define CONFIG_SIZE 37 /* helper.h config_t */
+#define TUNE_SIZE 16 /* tune.h tune_t */
+#define TUNE_EE_BASE 256 /* tune.h */
+#define H_LEN (3 + 2 + CONFIG_SIZE + TUNE_SIZE + 1)
+#define D_LEN (3 + 7 + 1)
+#define F_LEN(adc8) (3 + 2 + 1 + ((adc8) ? 8 : 10) + 1)
+#define TASK_CYCLES (16000000ULL * 10) /* a control task that is still in it after 10 s is stuck */
+
+/* the firmware, fw_mcr.o */
+extern uint8_t eeprom_config[];
+extern const uint8_t trace_build;
+extern volatile uint16_t encoder;
+extern uint8_t sensor_frame;
+extern int16_t servo_cmd;
+void config_load(void);
+void tune_load(uint8_t id);
+void line_pos_init(void);
+void pid_start(void);
+uint8_t control_task(uint8_t state);
+
+typedef struct Frame {
+	uint16_t conv[8]; /* 10 bit, as hal_host.adc gives them */
+	uint16_t encoder;
+	uint8_t in;
+} frame_t;
+
+typedef struct Decision {
+	uint8_t state, sensor, right, gap; /* gap: a record of this task was dropped */
+	int16_t servo;
+	uint16_t left;
+	uint32_t frames; /* frames the car had taken by the end of this task */
+} decision_t;
+
+typedef struct Run {
+	const uint8_t *header;
+	frame_t *frame;
+	decision_t *dec;
+	uint32_t frames, decs, gaps;
+} run_t;
+
+static run_t run;
+static uint32_t cursor; /* next frame */
+static int max_print = 10, keep_going;
+static const char *csv_file;
+
+static uint16_t replay_adc(void *ctx, uint8_t ch)
+{
+	const frame_t *f;
+
+	(void)ctx;
+	if (ch == 0) { /* read_sensor() starts a frame */
+		if (cursor == run.frames) {
+			hal_host.limit = hal_host.cycles; /* out of trace: the next hal call ends the replay */
+			return 1023;
+		}
+		f = &run.frame[cursor++];
+		encoder = f->encoder;
+		hal_host.pinb = ~0x0e | (f->in & 0x0e);
+		hal_host.pinc = ~(f->in >> 4);
+	}
+	return cursor ? run.frame[cursor - 1].conv[ch] : 1023;
+}
+
+/* ---- replay, under hal_host_call() ---- */
+
+static uint32_t tasks_done, differ, skipped;
+static int stuck;
+static FILE *csv;
+
+static int replay_main(void)
+{
+	uint8_t state = 0;
+	uint32_t d;
+
+	config_load();
+	tune_load(run.header[4]);
+	line_pos_init();
+	pid_start();
+	for (d = 0; d < run.decs; d++) {
+		const decision_t *c = &run.dec[d];
+		uint32_t first = d ? run.dec[d - 1].frames : 0;
+		int same;
+
+		if (c->gap && !keep_going) break;
+		cursor = first; /* the task starts where the car's did */
+		stuck = 1;
+		hal_host.limit = hal_host.cycles + TASK_CYCLES;
+		state = control_task(state);
+		stuck = 0;
+		tasks_done += 1;
+		if (c->gap) { /* the car's frames of it are not all there, nothing to compare */
+			skipped += 1;
+			continue;
+		}
+		same = state == c->state && sensor_frame == c->sensor && servo_cmd == c->servo &&
+			hal_motor_l_get() == c->left && hal_motor_r_get() == c->right && cursor == c->frames;
+		if (!same && differ++ < (uint32_t)max_print)
+			printf("  task %u, frames %u..%u: car state %u sensor %02x servo %d left %u right %u, %u frames;"
+				" replay %u %02x %d %u %u, %u frames\n",
+				d, first, c->frames, c->state, c->sensor, c->servo, c->left, c->right, c->frames - first,
+				state, sensor_frame, servo_cmd, hal_motor_l_get(), hal_motor_r_get(), cursor - first);
+		if (csv)
+			fprintf(csv, "%u,%u,%u,%u,%u,%u,%d,%d,%u,%u,%u,%u,%u,%u\n", d, first,
+				c->state, state, c->sensor, sensor_frame, c->servo, servo_cmd,
+				c->left, hal_motor_l_get(), c->right, hal_motor_r_get(), c->frames - first, cursor - first);
+	}
+	return 0;
+}
+
+/* one run, in a child: the firmware's globals start from power-on */
+static int replay(int no)
+{
+	const uint8_t *h = run.header;
+	struct timespec t0, t1;
+	double s;
+
+	if (h[3] != trace_build) {
+		printf("run %d: recorded with adc options %02x, this build has %02x (trace.h TRACE_BUILD)\n", no, h[3], trace_build);
+		return 2;
+	}
+	memset(hal_host.eeprom, 0xff, HAL_EE_SIZE);
+	hal_host.adc = replay_adc;
+	hal_host.limit = TASK_CYCLES;
+	hal_host_reset();
+	memcpy(&hal_host.eeprom[hal_host_ee_addr(eeprom_config)], h + 5, CONFIG_SIZE);
+	memcpy(&hal_host.eeprom[TUNE_EE_BASE + (h[4] & 0x0f) * TUNE_SIZE], h + 5 + CONFIG_SIZE, TUNE_SIZE);
+	if (csv_file) {
+		if (!(csv = fopen(csv_file, "w"))) {
+			perror(csv_file);
+			return 2;
+		}
+		fprintf(csv, "task,frame,car_state,state,car_sensor,sensor,car_servo,servo,car_left,left,car_right,right,car_frames,frames\n");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	hal_host_call(replay_main);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	if (csv) fclose(csv);
+
+	printf("run %d: profile %u, %s adc, %u frames, %u control tasks", no, h[4], (h[3] & 1) ? "8 bit" : "10 bit", run.frames, run.decs);
+	if (run.gaps) printf(", %u gaps", run.gaps);
+	printf("\n  %u replayed, %u differ", tasks_done - skipped, differ);
+	if (skipped) printf(", %u not compared at gaps", skipped);
+	printf(", %.3f s (%.2f M frames/s)\n", s,
+		s > 0 ? (tasks_done ? run.dec[tasks_done - 1].frames : 0) / s / 1e6 : 0);
+	if (stuck) printf("  task %u did not return: the replay waits where the car went on\n", tasks_done);
+	else if (tasks_done < run.decs) printf("  stopped at the gap in task %u (-k goes on)\n", tasks_done);
+	return differ || stuck ? 1 : 0;
+}
+
+/* ---- the file ---- */
+
+static uint8_t sum(const uint8_t *p, int n)
+{
+	uint8_t s = 0;
+
+	for (n -= 2; n > 0; n--) s += *++p; /* every byte after the sync, the sum byte not */
+	return s;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: trace_replay [-n diffs] [-c tasks.csv] [-r run] [-k] [-v] trace.bin\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = NULL;
+	uint8_t *buf, seq = 0;
+	int i, only = 0, verbose = 0, runs = 0, worst = 0, adc8 = 0, have_seq = 0, gap = 0;
+	uint32_t junk = 0, max_frames = 0, max_decs = 0;
+	long n, p, next;
+	FILE *f;
+
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+
+		if (a[0] != '-') {
+			name = a;
+			continue;
+		}
+		if (a[1] == 'k') { keep_going = 1; continue; }
+		if (a[1] == 'v') { verbose = 1; continue; }
+		if (i + 1 >= argc) return usage();
+		a = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 'n': max_print = atoi(a); break;
+		case 'c': csv_file = a; break;
+		case 'r': only = atoi(a); break;
+		default: return usage();
+		}
+	}
+	if (!name) return usage();
+	if (!(f = fopen(name, "rb"))) {
+		perror(name);
+		return 2;
+	}
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc(n + 1);
+	if (fread(buf, 1, n, f) != (size_t)n) n = 0;
+	fclose(f);
+
+	/* records of a run, until the next header or the end */
+	for (p = 0; p <= n; p = next) {
+		int len = 0;
+
+		if (p < n && buf[p] == TRACE_SYNC && p + 2 < n) {
+			if (buf[p + 1] == 'H') len = H_LEN;
+			else if (run.header && buf[p + 1] == 'F') len = F_LEN(adc8);
+			else if (run.header && buf[p + 1] == 'D') len = D_LEN;
+			if (len && (p + len > n || sum(buf + p, len) != buf[p + len - 1])) len = 0;
+		}
+		next = p + (len ? len : 1);
+		if (p < n && !len) {
+			junk += 1; /* resync on the next sync byte */
+			continue;
+		}
+		if (p == n || buf[p + 1] == 'H') { /* a run ends */
+			if (run.header && (!only || only == runs)) {
+				pid_t pid;
+				int status;
+
+				fflush(stdout);
+				if ((pid = fork()) == 0) exit(replay(runs));
+				waitpid(pid, &status, 0);
+				status = WIFEXITED(status) ? WEXITSTATUS(status) : 2;
+				if (status > worst) worst = status;
+			}
+			if (p == n) break;
+			runs += 1;
+			run.header = buf + p;
+			run.frames = run.decs = run.gaps = 0;
+			adc8 = buf[p + 3] & 1;
+			have_seq = gap = 0;
+		}
+		if (have_seq && buf[p + 2] != seq) {
+			run.gaps += 1;
+			gap = 1;
+		}
+		seq = buf[p + 2] + 1;
+		have_seq = 1;
+		if (verbose) printf("%8ld  %c  seq %3u\n", p, buf[p + 1], buf[p + 2]);
+
+		if (buf[p + 1] == 'F') {
+			const uint8_t *r = buf + p + 3;
+			frame_t *fr;
+
+			if (run.frames == max_frames) {
+				max_frames = max_frames ? 2 * max_frames : 65536;
+				run.frame = realloc(run.frame, sizeof(frame_t) * max_frames);
+			}
+			fr = &run.frame[run.frames++];
+			fr->encoder = r[0] | r[1] << 8;
+			fr->in = r[2];
+			for (i = 0; i < 8; i++) fr->conv[i] = adc8 ? r[3 + i] << 2 : r[3 + i] | ((r[11] | r[12] << 8) >> (2 * i) & 3) << 8;
+		} else if (buf[p + 1] == 'D') {
+			const uint8_t *r = buf + p + 3;
+			decision_t *d;
+
+			if (run.decs == max_decs) {
+				max_decs = max_decs ? 2 * max_decs : 65536;
+				run.dec = realloc(run.dec, sizeof(decision_t) * max_decs);
+			}
+			d = &run.dec[run.decs++];
+			d->state = r[0];
+			d->sensor = r[1];
+			d->servo = (int16_t)(r[2] | r[3] << 8);
+			d->left = r[4] | r[5] << 8;
+			d->right = r[6];
+			d->frames = run.frames;
+			d->gap = gap;
+			gap = 0;
+		}
+	}
+	if (!runs) {
+		fprintf(stderr, "trace_replay: no trace header in %s\n", name);
+		return 2;
+	}
+	if (junk) printf("%u bytes outside records skipped\n", junk);
+	return worst;
+}
@@ -0,0 +1,268 @@
+/*
+	Track model of track_sim.c, shared with batch_sim.c: the line path as
+	SEG_MM segments built from a track description (the format is in
+	track_sim.c), the crossline and half line marks on it, and the
+	projection of a point on the path.
+*/
+
+#ifndef TRACK_H_
+#define TRACK_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SEG_MM 10.0
+#define MAX_MARKS 64
+#define MARK_HALF 150.0 /* half width of the crossline and length of a half line */
+
+#define SEG_LINE 0
+#define SEG_GAP 1 /* no line, the car is expected to hold its course */
+#define SEG_LANE 2 /* no line, the car finds its own way to the next lane */
+
+typedef struct Seg {
+	double x, y, ux, uy, len, s; /* start, unit direction, length, path position */
+	uint8_t kind;
+} seg_t;
+
+typedef struct Mark {
+	double s0, s1, n0, n1; /* path position and lateral range (left positive) */
+} mark_t;
+
+typedef struct Track {
+	seg_t *seg;
+	int nseg, cap;
+	mark_t mark[MAX_MARKS];
+	int nmark;
+	double len, line_w;
+	int closed;
+	double x, y, h; /* builder pen */
+} track_t;
+
+typedef struct Loc {
+	double s, n; /* projection on the path */
+	double d_line; /* distance to the nearest visible line */
+	uint8_t kind; /* of the nearest segment */
+} loc_t;
+
+static const char default_track[] =
+	"# built-in loop, lane changes both ways, crossline and right angle corner, gap, S bend\n"
+	"straight 600\n"
+	"halfright\n"
+	"straight 200\n"
+	"lane right 300 150\n"
+	"straight 650\n"
+	"left 400 90\n"
+	"straight 400\n"
+	"gap 100\n"
+	"straight 400\n"
+	"cross\n"
+	"straight 600\n"
+	"left 0 90\n"
+	"straight 400\n"
+	"halfleft\n"
+	"straight 200\n"
+	"lane left 300 150\n"
+	"straight 550\n"
+	"right 600 30\n"
+	"left 600 30\n"
+	"straight 150\n"
+	"left 400 90\n"
+	"straight 660.77\n"
+	"left 400 90\n"
+	"straight 50\n";
+
+static void track_seg(track_t *t, double x1, double y1, uint8_t kind)
+{
+	seg_t *g;
+	double dx = x1 - t->x, dy = y1 - t->y, l = hypot(dx, dy);
+
+	if (l < 1e-9) return;
+	if (t->nseg == t->cap) {
+		t->cap = t->cap ? 2 * t->cap : 256;
+		t->seg = realloc(t->seg, t->cap * sizeof(seg_t));
+	}
+	g = &t->seg[t->nseg++];
+	g->x = t->x;
+	g->y = t->y;
+	g->ux = dx / l;
+	g->uy = dy / l;
+	g->len = l;
+	g->s = t->len;
+	g->kind = kind;
+	t->len += l;
+	t->x = x1;
+	t->y = y1;
+}
+
+static void track_straight(track_t *t, double l, uint8_t kind)
+{
+	int n = (int)ceil(l / SEG_MM);
+
+	for (int i = 1; i <= n; i++)
+		track_seg(t, t->x + cos(t->h) * l / n, t->y + sin(t->h) * l / n, kind);
+}
+
+static void track_arc(track_t *t, double r, double deg) /* deg > 0 left */
+{
+	double a = deg * M_PI / 180;
+	int n = (int)ceil(fabs(r * a) / SEG_MM);
+
+	if (r <= 0) { /* corner */
+		t->h += a;
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		double c = 2 * r * sin(fabs(a) / n / 2); /* chord */
+		t->h += a / n / 2;
+		track_seg(t, t->x + cos(t->h) * c, t->y + sin(t->h) * c, SEG_LINE);
+		t->h += a / n / 2;
+	}
+}
+
+static void track_lane(track_t *t, double d, double l) /* d > 0 left, no line */
+{
+	int n = (int)ceil(l / SEG_MM);
+	double x0 = t->x, y0 = t->y, c = cos(t->h), s = sin(t->h);
+
+	for (int i = 1; i <= n; i++) {
+		double u = (double)i / n, f = l * u, side = d * (1 - cos(M_PI * u)) / 2;
+		track_seg(t, x0 + c * f - s * side, y0 + s * f + c * side, SEG_LANE);
+	}
+}
+
+static void track_mark(track_t *t, double l, double n0, double n1)
+{
+	mark_t *m;
+
+	if (t->nmark == MAX_MARKS) return;
+	m = &t->mark[t->nmark++];
+	m->s0 = t->len;
+	m->s1 = t->len + l;
+	m->n0 = n0;
+	m->n1 = n1;
+}
+
+static int track_parse(track_t *t, const char *text, const char *name)
+{
+	char line[256], cmd[32], arg[32];
+	double a, b;
+	int no = 0, k;
+
+	memset(t, 0, sizeof(*t));
+	t->line_w = 20;
+	while (*text) {
+		const char *e = strchr(text, '\n');
+		size_t n = e ? (size_t)(e - text) : strlen(text);
+
+		if (n >= sizeof(line)) n = sizeof(line) - 1;
+		memcpy(line, text, n);
+		line[n] = 0;
+		text += e ? n + 1 : n;
+		no++;
+		if (strchr(line, '#')) *strchr(line, '#') = 0;
+		a = b = 0;
+		arg[0] = 0;
+		k = sscanf(line, "%31s %lf %lf", cmd, &a, &b);
+		if (k <= 0) continue;
+		if (!strcmp(cmd, "line") && k == 2) t->line_w = a;
+		else if (!strcmp(cmd, "straight") && k == 2) track_straight(t, a, SEG_LINE);
+		else if (!strcmp(cmd, "gap") && k == 2) track_straight(t, a, SEG_GAP);
+		else if (!strcmp(cmd, "left") && k == 3) track_arc(t, a, b);
+		else if (!strcmp(cmd, "right") && k == 3) track_arc(t, a, -b);
+		else if (!strcmp(cmd, "cross")) track_mark(t, k == 2 ? a : 40, -MARK_HALF, MARK_HALF);
+		else if (!strcmp(cmd, "halfleft")) track_mark(t, k == 2 ? a : 40, -t->line_w / 2, MARK_HALF);
+		else if (!strcmp(cmd, "halfright")) track_mark(t, k == 2 ? a : 40, -MARK_HALF, t->line_w / 2);
+		else if (!strcmp(cmd, "lane") && sscanf(line, "%*s %31s %lf %lf", arg, &a, &b) == 3 &&
+			(!strcmp(arg, "left") || !strcmp(arg, "right")))
+			track_lane(t, !strcmp(arg, "left") ? a : -a, b);
+		else {
+			fprintf(stderr, "%s:%d: cannot read '%s'\n", name, no, line);
+			return -1;
+		}
+	}
+	if (t->nseg == 0) {
+		fprintf(stderr, "%s: empty track\n", name);
+		return -1;
+	}
+	t->closed = hypot(t->x - t->seg[0].x, t->y - t->seg[0].y) < 5 &&
+		fabs(remainder(t->h, 2 * M_PI)) < 0.02;
+	return 0;
+}
+
+/* the track in file, the built-in loop without one */
+static int track_load(track_t *t, const char *file)
+{
+	FILE *f;
+	char *buf;
+	long n;
+	int r;
+
+	if (!file) return track_parse(t, default_track, "built-in");
+	if (!(f = fopen(file, "rb"))) {
+		perror(file);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc(n + 1);
+	if (fread(buf, 1, n, f) != (size_t)n) n = 0;
+	buf[n] = 0;
+	fclose(f);
+	r = track_parse(t, buf, file);
+	free(buf);
+	return r;
+}
+
+static int track_index(const track_t *t, double s) /* segment holding path position s */
+{
+	int lo = 0, hi = t->nseg - 1;
+
+	if (t->closed) s -= floor(s / t->len) * t->len;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (t->seg[mid].s <= s) lo = mid;
+		else hi = mid - 1;
+	}
+	return lo;
+}
+
+/* project (px, py) on the path between s_hint - back and s_hint + ahead */
+static void track_locate(const track_t *t, double px, double py, double s_hint, double back, double ahead, loc_t *o)
+{
+	int i = track_index(t, s_hint - back), j = track_index(t, s_hint + ahead), k, n;
+	double best = 1e18;
+
+	if (t->closed) {
+		n = j - i;
+		if (n < 0 || (n == 0 && back + ahead > t->len / 2)) n += t->nseg;
+		if (back + ahead >= t->len) { i = 0; n = t->nseg - 1; }
+	} else {
+		n = j - i;
+	}
+	o->s = o->n = 0;
+	o->d_line = 1e18;
+	for (k = 0; k <= n; k++) {
+		const seg_t *g = &t->seg[(i + k) % t->nseg];
+		double rx = px - g->x, ry = py - g->y;
+		double f = rx * g->ux + ry * g->uy, side = g->ux * ry - g->uy * rx, d;
+
+		if (f < 0) f = 0;
+		if (f > g->len) f = g->len;
+		rx -= g->ux * f;
+		ry -= g->uy * f;
+		d = rx * rx + ry * ry; /* squared */
+		if (g->kind == SEG_LINE && d < o->d_line) o->d_line = d;
+		if (d < best) {
+			best = d;
+			o->s = g->s + f;
+			o->n = side;
+			o->kind = g->kind;
+		}
+	}
+	o->d_line = sqrt(o->d_line);
+}
+
+#endif /* TRACK_H_ */
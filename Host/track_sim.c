@@ -0,0 +1,562 @@
+/*
+	track_sim: closed-loop track simulator for the three firmwares.
+
+	The firmware source runs as it is on hal_host (hal_host.h); this file
+	is the world around it, stepped on every Timer0 tick:
+	  car      kinematic bicycle (Ackermann) on the rear axle, steering
+	           angle from OCR1A through a rate limited servo (full lock of
+	           the firmware's handle() = 45 degrees), wheel speeds from the
+	           motor PWM and direction pins, first order to duty * vmax,
+	           braking and coasting; a rear wheel speed difference turns
+	           the car a little more, pivoting when they run opposite ways
+	  sensors  8 IR reflectance sensors on an arm that turns with the
+	           steering, channel 0 on the right; each conversion samples
+	           the track under the sensor footprint at that moment: white
+	           line low, black floor high, per channel gain and noise
+	  encoder  one INT0 edge every enc_mm of wheel travel
+	  track    2-D line path built from a small description (below):
+	           straights, arcs, right angle corners, crosslines, half
+	           lines, lane changes and gaps
+
+	Built three times by the Makefile, sim_mcr, sim_itcar and sim_golden,
+	with the firmware's start sequence (button presses from power-on to
+	the run, calibration included) and state variable for the trace.
+
+	usage: sim_xxx [options]
+	  -k file     track description (default: the built-in loop)
+	  -l n        laps (default 2)
+	  -t ms       simulated time limit (default 60000)
+	  -e file     eeprom image to start from and save at the end
+	  -s n        DIP switches
+	  -S seed     sensor noise seed (default 1)
+	  -V mps      top speed at 100 % duty (default 3.0)
+	  -O mm       off track distance (default 100)
+	  -T file     trace CSV, every 10 ms and at every state change: time,
+	              path position, lap, pose, speed, steering, distance from
+	              the line, channels over the line, servo and motor
+	              registers, firmware state
+	  -P file     tuning profile blob (tune_t with its crc, tune_sweep -o)
+	              written into the profile the DIP switches pick before
+	              power-on; MCR and Golden
+	  -U file     the bytes the firmware sends on its UART: MCR telemetry
+	              (telem_decode), or with sim_mcr_trace the trace.h
+	              trace of the run (trace_replay)
+	  -R          one more line for scripts, tune_sweep reads it:
+	              result laps= want= time= off= err= progress= end= tune=
+	              sat=
+	              (time: sum of the laps, progress: part of the laps
+	              wanted that was driven, tune: eeprom address of the -P
+	              profile, sat: ms the firmware asked the motors for more
+	              than their PWM can give, below)
+	  -v          state changes, off-track events and laps on stdout
+
+	Track description, one command per line, '#' comments, mm and degrees:
+	  line W              line width (default 20)
+	  straight L          line
+	  gap L               straight without line
+	  left R A / right R A
+	                      arc of radius R through A degrees, R 0 = corner
+	  cross [L]           crossline, full width, L long (default 40)
+	  halfleft [L] / halfright [L]
+	                      half line from the centre to one side
+	  lane left|right D L the line ends and comes back D to the side
+	                      after L of road (no line)
+	The car starts standing on the first point heading along the path.
+	A path that ends where it starts is a loop, laps are counted on it.
+
+	Off track: the sensor arm centre more than -O mm from the path, lost
+	and the run ends past 400 mm. Neither counts from a lane change until
+	the car is back on a line. The run also ends when the car stops for
+	2 s after it started. Lap 1 is timed from the first movement.
+
+	Motor range (MCR): fwd() scales its inputs by L_MOTOR_RATIO and
+	R_MOTOR_RATIO and writes left * 200 into OCR1B (TOP = ICR1 20000) and
+	right * 255 / 100 into the 8 bit OCR2, so only left <= 144 and
+	right <= 201 give a duty: above, OCR1B passes TOP and the PWM stays
+	on, OCR2 wraps round. The milliseconds with a motor speed past that
+	(or below 0, wrapped in the uint16_t) are counted, and the car drives
+	on what the registers would do.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "hal_host.h"
+#include "track.h"
+
+#define SIM_MCR 1
+#define SIM_ITCAR 2
+#define SIM_GOLDEN 3
+
+#define F_HZ 16000000.0
+#define DT (HAL_T0_CYCLES / F_HZ)
+#define LOST_MM 400.0
+#define STALL_S 2.0
+#define TRACE_MS 10
+#define MAX_LAPS 64
+
+/* ---- firmware adapters ---- */
+
+typedef struct Press {
+	uint32_t at; /* ms after power-on */
+	uint8_t button; /* 0..2 */
+} press_t;
+
+#define MOTOR_DIR_INV 0 /* MCR: one direction pin, PWM inverted when set */
+#define MOTOR_HBRIDGE 1 /* two pins per motor: 10 forward, 01 reverse, 11 brake */
+
+#if SIM_FW == SIM_MCR
+/* set_line, auto_color (0.66 s servo sweep), back, pid_main, 6 pid_calibrate pages */
+static const press_t fw_start[] = {
+	{300, 0}, {700, 2}, {4500, 0}, {4900, 0},
+	{5300, 0}, {5700, 0}, {6100, 0}, {6500, 0}, {6900, 0}, {7300, 0},
+};
+#define FW_NAME "mcr"
+#define FW_PRESS_MS 100 /* get_button() waits for the release */
+#define FW_SERVO_CENTER 3250
+#define FW_SERVO_LOCK 900 /* servo(150), SERVO_STEP 6 */
+#define FW_MOTOR MOTOR_DIR_INV
+#define FW_DIR_L 3
+#define FW_DIR_R 6
+extern uint16_t rec_last_state; /* stack.h, 0x100 = nothing recorded */
+static int fw_state(void) { return rec_last_state == 0x100 ? -1 : rec_last_state; }
+static void fw_seed(uint8_t *ee) { (void)ee; }
+extern uint16_t mspeed; /* helper.h */
+extern struct { uint16_t l, r; } pid_motor_speed; /* XE.c, what calc_motor_speed() hands to fwd() */
+#define FW_FWD_L_MAX 144 /* (144 * Q8_8(0.7)) >> 8 = 100, * 200 = ICR1 */
+#define FW_FWD_R_MAX 201 /* (201 * Q8_8(0.5)) >> 8 = 100, * 255 / 100 = 255 */
+static int fw_saturated(void)
+{
+	return pid_motor_speed.l > FW_FWD_L_MAX || pid_motor_speed.r > FW_FWD_R_MAX ||
+		mspeed > FW_FWD_L_MAX || hal_host.ocr1b > 20000;
+}
+#define FW_TUNE_SIZE 16 /* tune.h TUNE_EE(), switches 1..4 */
+static int fw_tune_addr(uint8_t sw) { return 256 + (sw & 0x0f) * FW_TUNE_SIZE; }
+#elif SIM_FW == SIM_ITCAR
+/* sel_mode: auto_color (3.3 s sweep), back, start; then BTN1 leaves the
+   pulse_v screen */
+static const press_t fw_start[] = { {300, 2}, {4500, 0}, {5200, 0}, {5900, 1} };
+#define FW_NAME "itcar"
+#define FW_PRESS_MS 300 /* get_button() debounces 80 ms per button it checks */
+#define FW_SERVO_CENTER 2950
+#define FW_SERVO_LOCK 1050 /* handle(150), STEP 7 */
+#define FW_MOTOR MOTOR_HBRIDGE
+#define FW_DIR_L 0
+#define FW_DIR_R 3
+extern uint8_t pattern;
+static int fw_state(void) { return pattern; }
+static void fw_seed(uint8_t *ee) { (void)ee; }
+#define FW_TUNE_SIZE 0 /* no profiles */
+static int fw_tune_addr(uint8_t sw) { (void)sw; return -1; }
+static int fw_saturated(void) { return 0; } /* 0..100 duty through handle tables */
+#elif SIM_FW == SIM_GOLDEN
+/* sel_mode start, BTN1 leaves the encoder screen (switch 4 off) */
+static const press_t fw_start[] = { {300, 0}, {1200, 1} };
+#define FW_NAME "golden"
+#define FW_PRESS_MS 300
+#define FW_SERVO_CENTER 3000
+#define FW_SERVO_LOCK 500 /* handle(SERVO_ANGLE_MAX), tune.step 4 */
+#define FW_MOTOR MOTOR_HBRIDGE
+#define FW_DIR_L 0
+#define FW_DIR_R 3
+extern uint8_t pattern;
+static int fw_state(void) { return pattern; }
+/* no automatic calibration: the line and floor words learn_color() would
+   store at eeprom 0..31 */
+static void fw_seed(uint8_t *ee)
+{
+	for (int i = 0; i < 8; i++) {
+		ee[2 * i] = 120 & 0xff; ee[2 * i + 1] = 120 >> 8;
+		ee[16 + 2 * i] = 880 & 0xff; ee[16 + 2 * i + 1] = 880 >> 8;
+	}
+}
+#define FW_TUNE_SIZE 10 /* tune.h TUNE_EE(), switches 1..3 */
+static int fw_tune_addr(uint8_t sw) { return 32 + (sw & 0x07) * FW_TUNE_SIZE; }
+static int fw_saturated(void) { return 0; }
+#else
+#error "SIM_FW must be SIM_MCR, SIM_ITCAR or SIM_GOLDEN"
+#endif
+
+#define FW_PRESSES (sizeof(fw_start) / sizeof(fw_start[0]))
+
+/* ---- car and world ---- */
+
+typedef struct Car {
+	double wheelbase, track, arm, spacing; /* mm: axles, rear wheels, front axle to sensor line, between sensors */
+	double vmax, tau, tau_brake, tau_coast; /* m/s at 100 % duty, s */
+	double servo_max, servo_rate; /* steering at the firmware's full lock (FW_SERVO_LOCK), degrees/s */
+	double slip, pivot; /* share of the rear wheels' differential rate that turns the car: same, opposite directions */
+	double enc_mm; /* wheel travel per encoder edge */
+	double floor_adc, line_adc, noise; /* 10 bit */
+} car_t;
+
+static car_t car = {
+	180, 150, 120, 16,
+	3.0, 0.15, 0.05, 0.6,
+	45, 600,
+	0.03, 0.1,
+	1.0,
+	880, 120, 6,
+};
+
+typedef struct World {
+	track_t track;
+	double x, y, h; /* rear axle, mm, heading rad (left positive) */
+	double vl, vr, delta; /* wheel speeds m/s, steering degrees (right positive) */
+	double s, s_bar, err; /* rear axle path position (unwrapped), arm position, arm distance from path */
+	uint64_t step_cycles; /* hal_host.cycles of the last step */
+	uint32_t ms;
+	double gain[8];
+	uint8_t line; /* channels over the line at their last conversion */
+	uint32_t rng;
+
+	/* run */
+	int laps_wanted, laps;
+	double t_lap, lap_s[MAX_LAPS];
+	int started, off, lane, off_events, lost, stalled, state, state_changes;
+	uint32_t sat_ms; /* motor commands out of the PWM range */
+	double stall_t, max_err, sum_err, off_mm;
+	uint32_t err_n;
+	FILE *trace;
+	int verbose;
+} world_t;
+
+static world_t w;
+static FILE *uart_out;
+
+static void sim_uart(void *ctx, uint8_t b)
+{
+	(void)ctx;
+	putc(b, uart_out);
+}
+
+static double rnd(void) /* uniform 0..1 */
+{
+	w.rng ^= w.rng << 13;
+	w.rng ^= w.rng >> 17;
+	w.rng ^= w.rng << 5;
+	return (w.rng & 0xffffff) / (double)0x1000000;
+}
+
+static double clamp01(double v) { return v < 0 ? 0 : v > 1 ? 1 : v; }
+
+/* arm centre and direction at rear axle pose x, y, h */
+static void arm_pose(double x, double y, double h, double *ax, double *ay, double *ah)
+{
+	double fx = x + cos(h) * car.wheelbase, fy = y + sin(h) * car.wheelbase;
+
+	*ah = h - w.delta * M_PI / 180;
+	*ax = fx + cos(*ah) * car.arm;
+	*ay = fy + sin(*ah) * car.arm;
+}
+
+static uint16_t sim_adc(void *ctx, uint8_t ch)
+{
+	double dt = (hal_host.cycles - w.step_cycles) / F_HZ, v = (w.vl + w.vr) / 2 * 1000;
+	double x = w.x + cos(w.h) * v * dt, y = w.y + sin(w.h) * v * dt; /* pose now, between steps */
+	double ax, ay, ah, px, py, lat = (ch - 3.5) * car.spacing, cover, r = 4;
+	loc_t l;
+
+	(void)ctx;
+	arm_pose(x, y, w.h, &ax, &ay, &ah);
+	px = ax - sin(ah) * lat;
+	py = ay + cos(ah) * lat;
+	track_locate(&w.track, px, py, w.s_bar, 80, 80, &l); /* sensors within 60 mm of the arm centre */
+	cover = clamp01((w.track.line_w / 2 + r - l.d_line) / (2 * r));
+	for (int i = 0; i < w.track.nmark; i++) {
+		const mark_t *m = &w.track.mark[i];
+		double fs = clamp01((fmin(l.s - m->s0, m->s1 - l.s) + r) / (2 * r));
+		double fn = clamp01((fmin(l.n - m->n0, m->n1 - l.n) + r) / (2 * r));
+		cover = fmax(cover, fmin(fs, fn));
+	}
+	if (cover > 0.5) w.line |= 1 << ch;
+	else w.line &= ~(1 << ch);
+	v = (car.floor_adc - cover * (car.floor_adc - car.line_adc)) * w.gain[ch];
+	v += car.noise * (rnd() + rnd() + rnd() + rnd() - 2) * 1.73; /* ~gaussian, sigma = noise */
+	return v < 0 ? 0 : v > 1023 ? 1023 : (uint16_t)v;
+}
+
+static double motor_duty(uint16_t ocr, uint16_t top, uint8_t dir_bit, int *mode)
+{
+	uint8_t d = hal_host.portd;
+	double duty = (double)ocr / top;
+
+	*mode = 0;
+	if (duty > 1) duty = 1;
+#if FW_MOTOR == MOTOR_DIR_INV
+	return (d >> dir_bit & 1) ? -(1 - duty) : duty;
+#else
+	{
+		uint8_t a = d >> dir_bit & 1, b = d >> (dir_bit == 0 ? 1 : 6) & 1;
+		if (a && b) { *mode = 1; return 0; } /* brake */
+		if (!a && !b) { *mode = 2; return 0; } /* coast */
+		return a ? duty : -duty;
+	}
+#endif
+}
+
+static void wheel(double *v, double duty, int mode)
+{
+	if (mode == 1) *v -= *v * DT / car.tau_brake;
+	else if (mode == 2) *v -= *v * DT / car.tau_coast;
+	else *v += (duty * car.vmax - *v) * DT / car.tau;
+}
+
+static void run_end(void)
+{
+	hal_host.limit = hal_host.cycles; /* hal_host_run() returns at the next hal call */
+}
+
+static void trace_line(void)
+{
+	double t = w.ms / 1000.0;
+
+	if (!w.trace) return;
+	fprintf(w.trace, "%.3f,%.1f,%d,%.1f,%.1f,%.2f,%.3f,%.2f,%.1f,%02x,%u,%u,%u,%d\n",
+		t, w.s, w.laps, w.x, w.y, w.h * 180 / M_PI, (w.vl + w.vr) / 2, w.delta, w.err, w.line,
+		hal_host.ocr1a, hal_host.ocr1b, hal_host.ocr2, w.state);
+}
+
+/* one Timer0 tick of the world */
+static void sim_ms(void *ctx)
+{
+	double target, duty, v, wv, dh, ax, ay, ah, ds;
+	int mode, st;
+	uint8_t pinb = 0xff;
+	loc_t l;
+
+	(void)ctx;
+	w.ms += 1;
+	for (unsigned i = 0; i < FW_PRESSES; i++)
+		if (w.ms >= fw_start[i].at && w.ms < fw_start[i].at + FW_PRESS_MS) pinb &= ~(2 << fw_start[i].button);
+	hal_host.pinb = pinb;
+
+	/* servo */
+	target = ((double)hal_host.ocr1a - FW_SERVO_CENTER) * car.servo_max / FW_SERVO_LOCK;
+	if (hal_host.ocr1a == 0) target = 0; /* no pulses yet */
+	if (target > car.servo_max) target = car.servo_max;
+	if (target < -car.servo_max) target = -car.servo_max;
+	dh = target - w.delta;
+	if (dh > car.servo_rate * DT) dh = car.servo_rate * DT;
+	if (dh < -car.servo_rate * DT) dh = -car.servo_rate * DT;
+	w.delta += dh;
+
+	/* motors */
+	duty = motor_duty(hal_host.ocr1b, 20000, FW_DIR_L, &mode);
+	wheel(&w.vl, duty, mode);
+	duty = motor_duty(hal_host.ocr2, 255, FW_DIR_R, &mode);
+	wheel(&w.vr, duty, mode);
+	v = (w.vl + w.vr) / 2;
+
+	/* bicycle model on the rear axle; the rear wheel speed difference adds
+	   a share of its differential drive rate through tyre slip, a larger
+	   one when the wheels turn opposite ways (pivoting in a corner) */
+	w.x += cos(w.h) * v * 1000 * DT;
+	w.y += sin(w.h) * v * 1000 * DT;
+	w.h -= v * 1000 * tan(w.delta * M_PI / 180) / car.wheelbase * DT;
+	w.h += (w.vl * w.vr < 0 ? car.pivot : car.slip) * (w.vr - w.vl) * 1000 / car.track * DT;
+	w.step_cycles = hal_host.cycles;
+	wv = (fabs(w.vl) + fabs(w.vr)) / 2; /* encoder on the rear wheels */
+	hal_host.int0_period = wv > 0.001 ? (uint64_t)(car.enc_mm / (wv * 1000) * F_HZ) : 0;
+
+	/* where on the track */
+	track_locate(&w.track, w.x, w.y, w.s, 100, 100, &l);
+	ds = l.s - (w.track.closed ? fmod(w.s, w.track.len) + (w.s < 0 ? w.track.len : 0) : w.s);
+	if (w.track.closed) ds = remainder(ds, w.track.len);
+	w.s += ds;
+	arm_pose(w.x, w.y, w.h, &ax, &ay, &ah);
+	track_locate(&w.track, ax, ay, w.s_bar, 150, 250, &l);
+	w.s_bar = l.s;
+	w.err = fabs(l.n);
+	if (l.kind == SEG_LANE) w.lane = 1; /* the car finds the next lane its own way, no error until it is on it */
+	else if (w.lane && w.err < w.off_mm / 2) w.lane = 0;
+
+	/* run bookkeeping */
+	st = fw_state();
+	if (st != w.state) {
+		if (w.verbose && w.started) printf("%8.3f s  s %7.0f mm  state %d -> %d\n", w.ms / 1000.0, w.s, w.state, st);
+		w.state = st;
+		w.state_changes += 1;
+		trace_line();
+	} else if (w.ms % TRACE_MS == 0 && w.started) trace_line();
+
+	if (!w.started) {
+		if (fabs(v) > 0.05) {
+			w.started = 1;
+			w.t_lap = w.ms / 1000.0;
+			w.s = 0;
+		}
+		return;
+	}
+	if (fw_saturated()) w.sat_ms += 1;
+	if (!w.lane) { /* error and off track count on the line, not while the car finds the next lane */
+		if (w.err > w.max_err) w.max_err = w.err;
+		w.sum_err += w.err;
+		w.err_n += 1;
+		if (!w.off && w.err > w.off_mm) {
+			w.off = 1;
+			w.off_events += 1;
+			if (w.verbose) printf("%8.3f s  s %7.0f mm  off track, %.0f mm from the line\n", w.ms / 1000.0, w.s, w.err);
+		} else if (w.off && w.err < w.off_mm / 2) w.off = 0;
+		if (w.err > LOST_MM) {
+			w.lost = 1;
+			run_end();
+		}
+	}
+	if (fabs(v) < 0.02) {
+		if ((w.stall_t += DT) > STALL_S) {
+			w.stalled = 1;
+			run_end();
+		}
+	} else w.stall_t = 0;
+	if (w.track.closed && w.s >= (w.laps + 1) * w.track.len) {
+		double lap = w.ms / 1000.0 - w.t_lap;
+
+		if (w.laps < MAX_LAPS) w.lap_s[w.laps] = lap;
+		w.t_lap = w.ms / 1000.0;
+		w.laps += 1;
+		if (w.verbose) printf("%8.3f s  lap %d %.3f s\n", w.ms / 1000.0, w.laps, lap);
+		if (w.laps >= w.laps_wanted) run_end();
+	} else if (!w.track.closed && w.s >= w.track.len - car.wheelbase) {
+		w.lap_s[0] = w.ms / 1000.0 - w.t_lap;
+		w.laps = 1;
+		run_end();
+	}
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: sim_" FW_NAME " [-k track] [-l laps] [-t ms] [-e eeprom.bin] [-s switches] [-S seed] [-V mps] [-O mm] [-T trace.csv] [-P profile.bin] [-U uart.bin] [-R] [-v]\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	const char *track_file = NULL, *ee_file = NULL, *trace_file = NULL, *tune_file = NULL;
+	uint32_t limit_ms = 60000, seed = 1;
+	uint8_t switches = 0;
+	hal_host_t *h = &hal_host;
+	clock_t c0;
+	double host_s, sim_s;
+	FILE *f;
+	int i, result = 0;
+
+	w.laps_wanted = 2;
+	w.off_mm = 100;
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+
+		if (a[0] != '-' || !a[1]) return usage();
+		if (a[1] == 'v') { w.verbose = 1; continue; }
+		if (a[1] == 'R') { result = 1; continue; }
+		if (i + 1 >= argc) return usage();
+		a = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 'k': track_file = a; break;
+		case 'l': w.laps_wanted = atoi(a); break;
+		case 't': limit_ms = strtoul(a, NULL, 0); break;
+		case 'e': ee_file = a; break;
+		case 's': switches = strtoul(a, NULL, 0) & 0x0f; break;
+		case 'S': seed = strtoul(a, NULL, 0); break;
+		case 'V': car.vmax = atof(a); break;
+		case 'O': w.off_mm = atof(a); break;
+		case 'T': trace_file = a; break;
+		case 'P': tune_file = a; break;
+		case 'U':
+			if (!(uart_out = fopen(a, "wb"))) {
+				perror(a);
+				return 1;
+			}
+			break;
+		default: return usage();
+		}
+	}
+	if (track_load(&w.track, track_file) < 0) return 1;
+	if (trace_file) {
+		if (!(w.trace = fopen(trace_file, "w"))) {
+			perror(trace_file);
+			return 1;
+		}
+		fprintf(w.trace, "t,s,lap,x,y,heading,v,steer,err,line,servo,left,right,state\n");
+	}
+
+	/* car on the start, wheels straight; sensor gains within 5 % */
+	w.x = w.track.seg[0].x;
+	w.y = w.track.seg[0].y;
+	w.h = atan2(w.track.seg[0].uy, w.track.seg[0].ux);
+	w.rng = seed * 2654435761u | 1;
+	for (i = 0; i < 8; i++) w.gain[i] = 0.95 + 0.1 * rnd();
+	w.s_bar = car.wheelbase + car.arm;
+	w.state = fw_state();
+
+	memset(h->eeprom, 0xff, HAL_EE_SIZE);
+	fw_seed(h->eeprom);
+	if (ee_file && (f = fopen(ee_file, "rb"))) {
+		if (fread(h->eeprom, 1, HAL_EE_SIZE, f) != HAL_EE_SIZE) fprintf(stderr, "sim_" FW_NAME ": short eeprom image %s\n", ee_file);
+		fclose(f);
+	}
+	if (tune_file) {
+		if (!FW_TUNE_SIZE) {
+			fprintf(stderr, "sim_" FW_NAME ": no tuning profiles in this firmware\n");
+			return 2;
+		}
+		if (!(f = fopen(tune_file, "rb"))) {
+			perror(tune_file);
+			return 2;
+		}
+		i = fread(&h->eeprom[fw_tune_addr(switches)], 1, FW_TUNE_SIZE, f);
+		fclose(f);
+		if (i != FW_TUNE_SIZE) {
+			fprintf(stderr, "sim_" FW_NAME ": %s is not a %d byte profile\n", tune_file, FW_TUNE_SIZE);
+			return 2;
+		}
+	}
+	h->adc = sim_adc;
+	if (uart_out) h->uart = sim_uart;
+	h->ms = sim_ms;
+	h->limit = (uint64_t)limit_ms * (uint64_t)(F_HZ / 1000);
+	hal_host_reset();
+	h->pinc = ~switches;
+
+	c0 = clock();
+	hal_host_run();
+	host_s = (double)(clock() - c0) / CLOCKS_PER_SEC;
+	sim_s = h->cycles / F_HZ;
+
+	printf("%s on %s: %.0f mm, ", FW_NAME, track_file ? track_file : "built-in track", w.track.len);
+	if (w.track.closed) printf("loop, %d of %d laps\n", w.laps, w.laps_wanted);
+	else printf("open (ends %.0f, %.0f mm from the start), %s\n", w.track.x - w.track.seg[0].x, w.track.y - w.track.seg[0].y,
+		w.laps ? "finished" : "not finished");
+	for (i = 0; i < w.laps && i < MAX_LAPS; i++) printf("  lap %d  %.3f s\n", i + 1, w.lap_s[i]);
+	if (!w.started) printf("  the car never moved\n");
+	else printf("  %d off track (> %.0f mm), error max %.1f mean %.1f mm, %.2f m driven, %d state changes\n",
+		w.off_events, w.off_mm, w.max_err, w.err_n ? w.sum_err / w.err_n : 0, w.s / 1000, w.state_changes);
+	if (w.sat_ms) printf("  motors past their PWM range for %.3f s\n", w.sat_ms / 1000.0);
+	printf("  end: %s at %.3f s, %.0fx real time\n",
+		w.lost ? "lost the line" : w.stalled ? "stopped" : (w.laps >= w.laps_wanted || !w.track.closed) && w.laps ? "done" : "time limit",
+		sim_s, host_s > 0 ? sim_s / host_s : 0);
+	if (result) {
+		double t = 0, want = w.track.closed ? w.laps_wanted * w.track.len : w.track.len - car.wheelbase;
+
+		for (i = 0; i < w.laps && i < MAX_LAPS; i++) t += w.lap_s[i];
+		printf("result laps=%d want=%d time=%.3f off=%d err=%.1f progress=%.3f end=%s tune=%d sat=%u\n",
+			w.laps, w.track.closed ? w.laps_wanted : 1, t, w.off_events, w.err_n ? w.sum_err / w.err_n : 0,
+			w.s > 0 ? (w.s < want ? w.s / want : 1.0) : 0.0,
+			w.lost ? "lost" : w.stalled ? "stopped" : (w.laps >= w.laps_wanted || !w.track.closed) && w.laps ? "done" : "limit",
+			fw_tune_addr(switches), w.sat_ms);
+	}
+
+	if (w.trace) fclose(w.trace);
+	if (uart_out) fclose(uart_out);
+	if (ee_file) {
+		if (!(f = fopen(ee_file, "wb"))) {
+			perror(ee_file);
+			return 1;
+		}
+		fwrite(h->eeprom, 1, HAL_EE_SIZE, f);
+		fclose(f);
+	}
+	return w.lost || w.stalled || !w.laps;
+}
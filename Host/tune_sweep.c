@@ -0,0 +1,862 @@
+/*
+	tune_sweep: search for a tuning profile on the track simulator, runs
+	spread over all cores.
+
+	Every candidate is a tuning profile (MCR or Golden tune.h tune_t) run
+	by the simulator as a child process: sim -R -P profile.bin -s switches
+	-S seed [sim options]. The simulators keep the firmware and hal_host
+	in globals, so a process per run is what lets them run side by side.
+	The candidates of a batch (the whole grid, all random draws, one
+	CMA-ES generation) are dealt out to a deque per thread; a thread runs
+	its own from the back and steals from the front of the others when it
+	is out, so a slow run (a car that laps slowly, a time limit) does not
+	hold up a core.
+
+	usage: tune_sweep [options] [-- sim options]
+	  -f mcr|golden   profile layout and parameters (default mcr)
+	  -x sim          simulator to run (default ./sim_mcr or ./sim_golden),
+	                  repeat for a choice between builds, e.g. the
+	                  PID_SPEED_RATIO builds sim_mcr_r20 sim_mcr_r30 ...
+	  -p name=lo:hi[:step]
+	                  search a parameter over a range
+	  -p name=v       hold a parameter at v
+	  -m grid|random|cmaes
+	                  search (default cmaes)
+	  -n runs         candidates for random and cmaes (default 2000)
+	  -j threads      (default: all cores)
+	  -N seeds        sensor noise seeds per candidate, -S 1..N, the
+	                  score is the mean (default 1)
+	  -w s            seconds added per off-track event per lap (default 1.0)
+	  -s n            DIP switches: the profile slot (default 0)
+	  -r seed         search random seed (default 1)
+	  -T n            candidates in the ranking printed (default 10)
+	  -L file         CSV of every candidate
+	  -o file         best profile, the blob as it sits in eeprom (version,
+	                  fields, crc), for sim -P or the car
+	  -E file         eeprom image (avrdude -U eeprom:r:car.bin:r) to
+	                  write the best profile into, at its slot address
+	                  (below)
+	Options after -- go to every simulator run (-k track, -l laps, -t ms,
+	-V mps, -O mm).
+
+	Parameters (default range, step):
+	  mcr     speed 40:140:5  m 30:90  kp 40:250:5  ki 0:10  kd 0:40
+	          switch_lane 60:127  noline 60:127 (SWITCH_LANE_CONST and
+	          NOLINE_CONST), servo_center 3250 held
+	  golden  step 3:6  ratio_pct 10:60  addition_handle 0:20
+	          handle_pct 60:160  speed_pct 50:150 (the patterns.tbl handle
+	          and speed tables scaled), servo_center 3000 held
+	servo_center is the car's, not the strategy's: set it with -p.
+	MCR speed stops at 140: fwd() gives a duty for left <= 144 only
+	(L_MOTOR_RATIO, OCR1B up to ICR1), past it the PWM is pinned on.
+
+	Score, lower is better: mean lap time + w * off-track events per lap;
+	a run that does not finish its laps scores 1000 + 1000 * the part not
+	driven, so a car that gets further ranks first among those. A run in
+	which the firmware asked the motors for more than their PWM range
+	(the simulator's sat=, PID corrections on top of speed included)
+	scores 1000 more, end "sat": such a profile leans on register
+	overflow and is never written out as the best.
+
+	CMA-ES works on the free parameters scaled to 0..1 (and the choice of
+	simulator as one more), rounded to their steps to run: (mu/mu_w,
+	lambda) with rank-one and rank-mu covariance updates and cumulative
+	step size control, lambda = max(4 + 3 ln d, threads), start at the
+	defaults with sigma 0.3. Points outside 0..1 run clamped and score
+	10 s per unit squared outside on top.
+
+	The profile address in the eeprom image is the firmware's fixed
+	TUNE_EE_BASE + slot * size (tune.h; MCR 256 + 16 * slot, Golden
+	32 + 10 * slot). -E also checks it against the address the simulator
+	reports and writes nothing when they differ.
+*/
+
+#define _GNU_SOURCE /* pipe2() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define MAX_PARAMS 8
+#define MAX_SIMS 16
+#define MAX_DIMS (MAX_PARAMS + 1)
+#define MAX_SIM_ARGS 32
+#define MAX_GRID 1000000
+#define FAIL_S 1000.0
+#define SIGMA0 0.3
+#define OUTSIDE_S 10.0
+#define SAT_S FAIL_S
+
+extern char **environ;
+
+typedef struct Param {
+	const char *name;
+	uint8_t off, size; /* place in the blob, little endian */
+	int def, lo, hi, step;
+	int held; /* 1: not searched, def */
+} param_t;
+
+typedef struct Layout {
+	const char *name, *sim;
+	uint8_t size, version, slots;
+	int ee_base; /* eeprom address of profile 0, tune.h TUNE_EE_BASE */
+	int params;
+	param_t param[MAX_PARAMS];
+} layout_t;
+
+static layout_t layouts[] = {
+	{ "mcr", "./sim_mcr", 16, 1, 16, 256, 8, {
+		{ "speed",        1, 2,   80,  40,  140, 5, 0 },
+		{ "m",            3, 1,   50,  30,   90, 1, 0 },
+		{ "kp",           4, 2,   95,  40,  250, 5, 0 },
+		{ "ki",           6, 2,    2,   0,   10, 1, 0 },
+		{ "kd",           8, 2,    1,   0,   40, 1, 0 },
+		{ "servo_center",10, 2, 3250, 3250, 3250, 1, 1 },
+		{ "switch_lane", 12, 1,   95,  60,  127, 1, 0 },
+		{ "noline",      13, 1,  100,  60,  127, 1, 0 },
+	} },
+	{ "golden", "./sim_golden", 10, 1, 8, 32, 6, {
+		{ "servo_center",    1, 2, 3000, 3000, 3000, 1, 1 },
+		{ "step",            3, 1,    4,    3,    6, 1, 0 },
+		{ "ratio_pct",       4, 1,   30,   10,   60, 1, 0 }, /* 30 + 5 per switch step */
+		{ "addition_handle", 5, 1,    5,    0,   20, 1, 0 },
+		{ "handle_pct",      6, 1,  100,   60,  160, 1, 0 },
+		{ "speed_pct",       7, 1,  100,   50,  150, 1, 0 },
+	} },
+};
+
+typedef struct Cand {
+	int v[MAX_PARAMS]; /* parameter values */
+	int sim;
+	double x[MAX_DIMS]; /* cmaes: the point drawn, before clamping */
+	double score, time, err, progress;
+	double bound; /* cmaes: penalty for x outside 0..1, ranking only */
+	int laps, want, off, runs_ok, tune_addr;
+	unsigned sat; /* ms of motor commands past the PWM range, all seeds */
+	char end[12];
+} cand_t;
+
+/* ---- work-stealing pool ---- */
+
+typedef struct Deque {
+	pthread_mutex_t lock;
+	int *task, head, tail, size; /* owner takes task[tail - 1], thieves task[head] */
+} deque_t;
+
+typedef struct Pool {
+	int workers;
+	deque_t *q;
+	void (*run)(int worker, int task);
+	long steals;
+} pool_t;
+
+typedef struct Worker {
+	pool_t *pool;
+	int id;
+} worker_t;
+
+static int deque_pop(deque_t *d, int own)
+{
+	int t = -1;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->head < d->tail) t = own ? d->task[--d->tail] : d->task[d->head++];
+	pthread_mutex_unlock(&d->lock);
+	return t;
+}
+
+static void *pool_worker(void *arg)
+{
+	worker_t *wk = (worker_t *)arg;
+	pool_t *p = wk->pool;
+	int t, i;
+
+	for (;;) {
+		t = deque_pop(&p->q[wk->id], 1);
+		for (i = 1; t < 0 && i < p->workers; i++)
+			if ((t = deque_pop(&p->q[(wk->id + i) % p->workers], 0)) >= 0) __sync_fetch_and_add(&p->steals, 1);
+		if (t < 0) return NULL; /* no task is added during a batch: all taken */
+		p->run(wk->id, t);
+	}
+}
+
+static int pool_init(pool_t *p, int workers, void (*run)(int, int))
+{
+	int i;
+
+	p->workers = workers;
+	p->run = run;
+	p->steals = 0;
+	if (!(p->q = calloc(workers, sizeof(deque_t)))) return -1;
+	for (i = 0; i < workers; i++) pthread_mutex_init(&p->q[i].lock, NULL);
+	return 0;
+}
+
+/* tasks 0..n-1, in blocks of neighbours per worker, returns when all ran */
+static void pool_run(pool_t *p, int n)
+{
+	pthread_t th[p->workers];
+	worker_t wk[p->workers];
+	int i, k, per = n / p->workers, extra = n % p->workers, t = 0;
+
+	for (i = 0; i < p->workers; i++) {
+		p->q[i].head = p->q[i].tail = 0;
+		if (p->q[i].size < per + 1) {
+			p->q[i].size = per + 1;
+			p->q[i].task = realloc(p->q[i].task, sizeof(int) * p->q[i].size);
+		}
+		for (k = 0; k < per + (i < extra); k++) p->q[i].task[p->q[i].tail++] = t++;
+	}
+	for (i = 0; i < p->workers; i++) {
+		wk[i].pool = p;
+		wk[i].id = i;
+		pthread_create(&th[i], NULL, pool_worker, &wk[i]);
+	}
+	for (i = 0; i < p->workers; i++) pthread_join(th[i], NULL);
+}
+
+/* ---- search state ---- */
+
+static layout_t *lay;
+static const char *sims[MAX_SIMS];
+static int nsims;
+static const char *sim_args[MAX_SIM_ARGS];
+static int nsim_args;
+static int seeds = 1, switches;
+static double off_w = 1.0;
+static char tmp_dir[256];
+
+static int free_p[MAX_PARAMS], nfree, dims; /* searched parameters; dims adds the simulator choice */
+static cand_t *cand;
+static int ncand, max_cand;
+static uint64_t rng = 1;
+
+static double urand(void) /* splitmix64, 0..1 */
+{
+	uint64_t z = (rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return ((z ^ (z >> 31)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double nrand(void)
+{
+	double u = urand();
+
+	while (u <= 0) u = urand();
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * urand());
+}
+
+static int levels(int d) /* values of a dimension - 1 */
+{
+	param_t *p;
+
+	if (d == nfree) return nsims - 1;
+	p = &lay->param[free_p[d]];
+	return (p->hi - p->lo) / p->step;
+}
+
+/* dimension d at 0..1 onto its values */
+static void cand_set(cand_t *c, int d, double u)
+{
+	int k = (int)floor((u < 0 ? 0 : u > 1 ? 1 : u) * levels(d) + 0.5);
+	param_t *p;
+
+	if (d == nfree) {
+		c->sim = k;
+		return;
+	}
+	p = &lay->param[free_p[d]];
+	c->v[free_p[d]] = p->lo + k * p->step;
+}
+
+static cand_t *cand_new(void)
+{
+	cand_t *c;
+	int i;
+
+	if (ncand == max_cand) {
+		max_cand = max_cand ? 2 * max_cand : 1024;
+		cand = realloc(cand, sizeof(cand_t) * max_cand);
+	}
+	c = &cand[ncand++];
+	memset(c, 0, sizeof(*c));
+	for (i = 0; i < lay->params; i++) c->v[i] = lay->param[i].def;
+	return c;
+}
+
+/* ---- profile blob, eeblob.h ---- */
+
+static uint16_t crc16(const uint8_t *p, int n)
+{
+	uint16_t crc = 0xffff;
+	int i;
+
+	while (n--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+static void blob_make(const cand_t *c, uint8_t *b)
+{
+	uint16_t crc;
+	int i;
+
+	memset(b, 0, lay->size);
+	b[0] = lay->version;
+	for (i = 0; i < lay->params; i++) {
+		param_t *p = &lay->param[i];
+
+		b[p->off] = c->v[i] & 0xff;
+		if (p->size == 2) b[p->off + 1] = (c->v[i] >> 8) & 0xff;
+	}
+	crc = crc16(b, lay->size - 2);
+	b[lay->size - 2] = crc & 0xff;
+	b[lay->size - 1] = crc >> 8;
+}
+
+static int blob_write(const char *name, const cand_t *c)
+{
+	uint8_t b[32];
+	FILE *f = fopen(name, "wb");
+
+	if (!f) {
+		perror(name);
+		return -1;
+	}
+	blob_make(c, b);
+	fwrite(b, 1, lay->size, f);
+	fclose(f);
+	return 0;
+}
+
+/* ---- one candidate: the simulator once per seed ---- */
+
+/* the simulator's -R line into c, 0 when it has none */
+static int sim_once(const char *sim, const char *profile, int seed, cand_t *c, int first)
+{
+	char sw[8], sd[16], out[4096], end[12];
+	const char *argv[MAX_SIM_ARGS + 12];
+	posix_spawn_file_actions_t fa;
+	int fd[2], n = 0, len = 0, r, status, laps, want, off, addr;
+	unsigned sat;
+	double t, err, prog;
+	char *line;
+	pid_t pid;
+
+	snprintf(sw, sizeof(sw), "%d", switches);
+	snprintf(sd, sizeof(sd), "%d", seed);
+	argv[n++] = sim;
+	argv[n++] = "-R";
+	argv[n++] = "-P";
+	argv[n++] = profile;
+	argv[n++] = "-s";
+	argv[n++] = sw;
+	argv[n++] = "-S";
+	argv[n++] = sd;
+	for (r = 0; r < nsim_args; r++) argv[n++] = sim_args[r];
+	argv[n] = NULL;
+
+	if (pipe2(fd, O_CLOEXEC) < 0) return 0; /* no other thread's child keeps this pipe open */
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_adddup2(&fa, fd[1], 1);
+	r = posix_spawn(&pid, sim, &fa, NULL, (char **)argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	close(fd[1]);
+	if (r) {
+		close(fd[0]);
+		fprintf(stderr, "tune_sweep: %s: %s\n", sim, strerror(r));
+		return 0;
+	}
+	while ((r = read(fd[0], out + len, sizeof(out) - 1 - len)) > 0 || (r < 0 && errno == EINTR))
+		if (r > 0) len += r;
+	close(fd[0]);
+	waitpid(pid, &status, 0); /* nonzero when the car did not finish, the result line tells */
+	out[len] = 0;
+
+	if (!(line = strstr(out, "result ")) ||
+		sscanf(line, "result laps=%d want=%d time=%lf off=%d err=%lf progress=%lf end=%11s tune=%d sat=%u",
+			&laps, &want, &t, &off, &err, &prog, end, &addr, &sat) != 9) return 0;
+	if (sat && !strcmp(end, "done")) strcpy(end, "sat");
+	if (first) strcpy(c->end, end);
+	else if (strcmp(end, "done")) strcpy(c->end, end); /* the worst end of the seeds */
+	c->tune_addr = addr;
+	c->want = want;
+	c->laps += laps;
+	c->off += off;
+	c->time += t;
+	c->err += err;
+	c->progress += prog;
+	c->sat += sat;
+	c->score += laps >= want ? t / laps + off_w * off / laps : FAIL_S + FAIL_S * (1 - prog);
+	if (sat) c->score += SAT_S;
+	return 1;
+}
+
+static void run_cand(int worker, int task)
+{
+	cand_t *c = &cand[task];
+	char profile[300];
+	int s, ok = 0;
+
+	snprintf(profile, sizeof(profile), "%s/tune_sweep.%d.%d.bin", tmp_dir, (int)getpid(), worker);
+	if (blob_write(profile, c) < 0) {
+		c->score = 1e9;
+		return;
+	}
+	for (s = 1; s <= seeds; s++) ok += sim_once(sims[c->sim], profile, s, c, s == 1);
+	c->runs_ok = ok;
+	if (ok < seeds) {
+		c->score = 1e9; /* simulator failed: no result line */
+		strcpy(c->end, "failed");
+		return;
+	}
+	c->score /= seeds;
+	c->time /= seeds;
+	c->err /= seeds;
+	c->progress /= seeds;
+}
+
+/* ---- searches ---- */
+
+static pool_t pool;
+static long runs_done;
+static struct timespec t0;
+
+static double elapsed(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0.tv_sec) + (t.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static cand_t *best_of(int from, int to)
+{
+	cand_t *b = NULL;
+	int i;
+
+	for (i = from; i < to; i++)
+		if (!b || cand[i].score < b->score) b = &cand[i];
+	return b;
+}
+
+/* the pool numbers the tasks of a batch from 0 */
+static int batch_from;
+static void run_batch_cand(int worker, int task)
+{
+	run_cand(worker, batch_from + task);
+}
+
+/* cand[from..ncand-1] on all threads */
+static void run_from(int from, const char *what)
+{
+	cand_t *b;
+
+	batch_from = from;
+	pool_run(&pool, ncand - from);
+	runs_done += (long)(ncand - from) * seeds;
+	b = best_of(0, ncand);
+	fprintf(stderr, "%s: %d candidates, best %.3f, %ld runs in %.0f s (%.1f/s)\n",
+		what, ncand, b->score, runs_done, elapsed(), runs_done / elapsed());
+}
+
+static int search_grid(void)
+{
+	long total = 1, i;
+	int d;
+
+	for (d = 0; d < dims; d++) {
+		total *= levels(d) + 1;
+		if (total > MAX_GRID) {
+			fprintf(stderr, "tune_sweep: grid over %d points, narrow the ranges or raise the steps\n", MAX_GRID);
+			return -1;
+		}
+	}
+	for (i = 0; i < total; i++) {
+		cand_t *c = cand_new();
+		long k = i;
+
+		for (d = 0; d < dims; d++) {
+			int n = levels(d) + 1;
+
+			cand_set(c, d, n > 1 ? (double)(k % n) / (n - 1) : 0);
+			k /= n;
+		}
+	}
+	run_from(0, "grid");
+	return 0;
+}
+
+static int search_random(int n)
+{
+	int i, d;
+
+	for (i = 0; i < n; i++) {
+		cand_t *c = cand_new();
+
+		for (d = 0; d < dims; d++) cand_set(c, d, urand());
+	}
+	run_from(0, "random");
+	return 0;
+}
+
+/* eigen decomposition of the symmetric a (destroyed): a = v diag(e) v' */
+static void jacobi(int n, double a[MAX_DIMS][MAX_DIMS], double v[MAX_DIMS][MAX_DIMS], double *e)
+{
+	int i, j, k, sweep;
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++) v[i][j] = i == j;
+	for (sweep = 0; sweep < 50; sweep++) {
+		double off = 0;
+
+		for (i = 0; i < n; i++)
+			for (j = i + 1; j < n; j++) off += a[i][j] * a[i][j];
+		if (off < 1e-30) break;
+		for (i = 0; i < n; i++)
+			for (j = i + 1; j < n; j++) {
+				double th, t, c, s;
+
+				if (fabs(a[i][j]) < 1e-300) continue;
+				th = (a[j][j] - a[i][i]) / (2 * a[i][j]);
+				t = (th >= 0 ? 1 : -1) / (fabs(th) + sqrt(th * th + 1));
+				c = 1 / sqrt(t * t + 1);
+				s = t * c;
+				for (k = 0; k < n; k++) { /* a = J' a J */
+					double aki = a[k][i], akj = a[k][j];
+					a[k][i] = c * aki - s * akj;
+					a[k][j] = s * aki + c * akj;
+				}
+				for (k = 0; k < n; k++) {
+					double aik = a[i][k], ajk = a[j][k];
+					a[i][k] = c * aik - s * ajk;
+					a[j][k] = s * aik + c * ajk;
+				}
+				for (k = 0; k < n; k++) {
+					double vki = v[k][i], vkj = v[k][j];
+					v[k][i] = c * vki - s * vkj;
+					v[k][j] = s * vki + c * vkj;
+				}
+			}
+	}
+	for (i = 0; i < n; i++) e[i] = a[i][i];
+}
+
+static int by_score(const void *a, const void *b)
+{
+	const cand_t *x = *(cand_t *const *)a, *y = *(cand_t *const *)b;
+	double d = (x->score + x->bound) - (y->score + y->bound);
+
+	return d < 0 ? -1 : d > 0;
+}
+
+static int search_cmaes(int budget, int threads)
+{
+	int n = dims, lambda, mu, g, i, j, k;
+	double mean[MAX_DIMS], ps[MAX_DIMS], pc[MAX_DIMS], C[MAX_DIMS][MAX_DIMS], B[MAX_DIMS][MAX_DIMS], D[MAX_DIMS];
+	double wt[256], mueff = 0, sw = 0, cc, cs, c1, cmu, damps, chin, sigma = SIGMA0;
+	cand_t *gen[256];
+	char what[64];
+
+	lambda = 4 + (int)(3 * log(n));
+	if (lambda < threads) lambda = threads;
+	if (lambda > 256) lambda = 256;
+	mu = lambda / 2;
+	for (i = 0; i < mu; i++) sw += wt[i] = log(mu + 0.5) - log(i + 1);
+	for (i = 0; i < mu; i++) {
+		wt[i] /= sw;
+		mueff += wt[i] * wt[i];
+	}
+	mueff = 1 / mueff;
+	cc = (4 + mueff / n) / (n + 4 + 2 * mueff / n);
+	cs = (mueff + 2) / (n + mueff + 5);
+	c1 = 2 / ((n + 1.3) * (n + 1.3) + mueff);
+	cmu = 2 * (mueff - 2 + 1 / mueff) / ((n + 2) * (n + 2) + mueff);
+	if (cmu > 1 - c1) cmu = 1 - c1;
+	damps = 1 + 2 * fmax(0, sqrt((mueff - 1) / (n + 1)) - 1) + cs;
+	chin = sqrt(n) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+	for (i = 0; i < n; i++) { /* from the defaults */
+		if (i < nfree) {
+			param_t *p = &lay->param[free_p[i]];
+			mean[i] = p->hi > p->lo ? (double)(p->def - p->lo) / (p->hi - p->lo) : 0.5;
+			mean[i] = mean[i] < 0 ? 0 : mean[i] > 1 ? 1 : mean[i];
+		} else mean[i] = 0.5;
+		ps[i] = pc[i] = 0;
+		D[i] = 1;
+		for (j = 0; j < n; j++) C[i][j] = B[i][j] = i == j;
+	}
+	fprintf(stderr, "cmaes: %d dimensions, lambda %d, mu %d\n", n, lambda, mu);
+
+	for (g = 0; ncand + lambda <= budget; g++) {
+		int from = ncand;
+		double old[MAX_DIMS], y[MAX_DIMS], z[MAX_DIMS], ps_n = 0, hsig, a[MAX_DIMS][MAX_DIMS];
+
+		for (k = 0; k < lambda; k++) {
+			cand_t *c = cand_new();
+			double outside = 0;
+
+			for (i = 0; i < n; i++) z[i] = D[i] * nrand();
+			for (i = 0; i < n; i++) {
+				for (y[i] = 0, j = 0; j < n; j++) y[i] += B[i][j] * z[j];
+				c->x[i] = mean[i] + sigma * y[i];
+				cand_set(c, i, c->x[i]);
+				if (c->x[i] < 0) outside += c->x[i] * c->x[i];
+				if (c->x[i] > 1) outside += (c->x[i] - 1) * (c->x[i] - 1);
+			}
+			c->bound = OUTSIDE_S * outside;
+		}
+		snprintf(what, sizeof(what), "cmaes gen %d sigma %.3f", g, sigma);
+		run_from(from, what);
+		for (k = 0; k < lambda; k++) gen[k] = &cand[from + k];
+		qsort(gen, lambda, sizeof(gen[0]), by_score); /* ranked on score + boundary */
+
+		/* recombination */
+		memcpy(old, mean, sizeof(old));
+		for (i = 0; i < n; i++)
+			for (mean[i] = 0, k = 0; k < mu; k++) mean[i] += wt[k] * gen[k]->x[i];
+
+		/* step size path: C^-1/2 (mean - old) / sigma = B D^-1 B' ... */
+		for (j = 0; j < n; j++) {
+			for (z[j] = 0, i = 0; i < n; i++) z[j] += B[i][j] * (mean[i] - old[i]) / sigma;
+			z[j] /= D[j];
+		}
+		for (i = 0; i < n; i++) {
+			for (y[i] = 0, j = 0; j < n; j++) y[i] += B[i][j] * z[j];
+			ps[i] = (1 - cs) * ps[i] + sqrt(cs * (2 - cs) * mueff) * y[i];
+			ps_n += ps[i] * ps[i];
+		}
+		ps_n = sqrt(ps_n);
+		hsig = ps_n / sqrt(1 - pow(1 - cs, 2.0 * (g + 1))) / chin < 1.4 + 2.0 / (n + 1);
+		for (i = 0; i < n; i++) pc[i] = (1 - cc) * pc[i] + hsig * sqrt(cc * (2 - cc) * mueff) * (mean[i] - old[i]) / sigma;
+
+		/* covariance: rank one and rank mu */
+		for (i = 0; i < n; i++)
+			for (j = 0; j <= i; j++) {
+				double rmu = 0;
+
+				for (k = 0; k < mu; k++)
+					rmu += wt[k] * (gen[k]->x[i] - old[i]) * (gen[k]->x[j] - old[j]) / (sigma * sigma);
+				C[i][j] = (1 - c1 - cmu) * C[i][j] + c1 * (pc[i] * pc[j] + (1 - hsig) * cc * (2 - cc) * C[i][j]) + cmu * rmu;
+				C[j][i] = C[i][j];
+			}
+		sigma *= exp(cs / damps * (ps_n / chin - 1));
+		if (sigma > 1) sigma = 1;
+		if (sigma < 1e-4) {
+			fprintf(stderr, "cmaes: converged\n");
+			break;
+		}
+
+		memcpy(a, C, sizeof(a));
+		jacobi(n, a, B, D);
+		for (i = 0; i < n; i++) D[i] = sqrt(D[i] > 1e-20 ? D[i] : 1e-20);
+	}
+	return 0;
+}
+
+/* ---- output ---- */
+
+static void print_cand(FILE *f, const cand_t *c, int csv)
+{
+	int i;
+
+	if (csv) {
+		fprintf(f, "%s", sims[c->sim]);
+		for (i = 0; i < lay->params; i++) fprintf(f, ",%d", c->v[i]);
+		fprintf(f, ",%.3f,%d,%.3f,%d,%.1f,%.3f,%s,%u\n", c->score, c->laps, c->time, c->off, c->err, c->progress, c->end, c->sat);
+		return;
+	}
+	fprintf(f, "%9.3f  %-5s %d/%d laps %7.3f s  %2d off  err %5.1f ", c->score, c->end, c->laps, c->want * seeds, c->time, c->off, c->err);
+	for (i = 0; i < lay->params; i++)
+		if (!lay->param[i].held) fprintf(f, " %s %d", lay->param[i].name, c->v[i]);
+	if (nsims > 1) fprintf(f, "  %s", sims[c->sim]);
+	fprintf(f, "\n");
+}
+
+static int patch_image(const char *name, const cand_t *c)
+{
+	uint8_t img[4096], b[32];
+	FILE *f;
+	size_t n;
+	int addr = lay->ee_base + switches * lay->size;
+
+	if (c->tune_addr != addr) {
+		fprintf(stderr, "tune_sweep: %s puts profile %d at eeprom %d, tune.h at %d: nothing written\n",
+			sims[c->sim], switches, c->tune_addr, addr);
+		return -1;
+	}
+	if (!(f = fopen(name, "r+b"))) {
+		perror(name);
+		return -1;
+	}
+	n = fread(img, 1, sizeof(img), f);
+	if ((size_t)addr + lay->size > n) {
+		fprintf(stderr, "tune_sweep: profile at %d does not fit %s (%zu bytes)\n", addr, name, n);
+		fclose(f);
+		return -1;
+	}
+	blob_make(c, b);
+	fseek(f, addr, SEEK_SET);
+	fwrite(b, 1, lay->size, f);
+	fclose(f);
+	return 0;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: tune_sweep [-f mcr|golden] [-x sim]... [-p name=lo:hi[:step] | -p name=v]... [-m grid|random|cmaes]\n"
+		"                  [-n runs] [-j threads] [-N seeds] [-w s] [-s switches] [-r seed] [-T n]\n"
+		"                  [-L log.csv] [-o profile.bin] [-E eeprom.bin] [-- sim options]\n");
+	return 2;
+}
+
+static param_t *param_find(const char *name, size_t len)
+{
+	int i;
+
+	for (i = 0; i < lay->params; i++)
+		if (strlen(lay->param[i].name) == len && !strncmp(lay->param[i].name, name, len)) return &lay->param[i];
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	const char *mode = "cmaes", *log_file = NULL, *out_file = NULL, *image = NULL, *pspec[MAX_PARAMS * 2];
+	int budget = 2000, threads = (int)sysconf(_SC_NPROCESSORS_ONLN), top = 10, npspec = 0, i, ret;
+	cand_t **rank, *b;
+	FILE *f;
+
+	lay = &layouts[0];
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+
+		if (!strcmp(a, "--")) {
+			for (i++; i < argc && nsim_args < MAX_SIM_ARGS; i++) sim_args[nsim_args++] = argv[i];
+			break;
+		}
+		if (a[0] != '-' || !a[1] || a[2] || i + 1 >= argc) return usage();
+		a = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 'f':
+			if (!strcmp(a, "golden")) lay = &layouts[1];
+			else if (strcmp(a, "mcr")) return usage();
+			break;
+		case 'x':
+			if (nsims == MAX_SIMS) return usage();
+			sims[nsims++] = a;
+			break;
+		case 'p':
+			if (npspec == MAX_PARAMS * 2) return usage();
+			pspec[npspec++] = a; /* after -f */
+			break;
+		case 'm': mode = a; break;
+		case 'n': budget = atoi(a); break;
+		case 'j': threads = atoi(a); break;
+		case 'N': seeds = atoi(a); break;
+		case 'w': off_w = atof(a); break;
+		case 's': switches = atoi(a); break;
+		case 'r': rng = strtoull(a, NULL, 0); break;
+		case 'T': top = atoi(a); break;
+		case 'L': log_file = a; break;
+		case 'o': out_file = a; break;
+		case 'E': image = a; break;
+		default: return usage();
+		}
+	}
+	if (threads < 1 || seeds < 1 || budget < 1) return usage();
+	if (!nsims) sims[nsims++] = lay->sim;
+	switches &= lay->slots - 1;
+	if (lay == &layouts[1]) lay->param[2].def += 5 * switches; /* tune_defaults(id) */
+	for (i = 0; i < npspec; i++) {
+		const char *eq = strchr(pspec[i], '=');
+		param_t *p = eq ? param_find(pspec[i], eq - pspec[i]) : NULL;
+		int lo, hi, step = 1, n;
+
+		if (!p || (n = sscanf(eq + 1, "%d:%d:%d", &lo, &hi, &step)) < 1 || step < 1) {
+			fprintf(stderr, "tune_sweep: bad parameter '%s' for %s\n", pspec[i], lay->name);
+			return 2;
+		}
+		if (n == 1) {
+			p->def = p->lo = p->hi = lo;
+			p->held = 1;
+		} else {
+			p->lo = lo < hi ? lo : hi;
+			p->hi = lo < hi ? hi : lo;
+			p->step = step;
+			p->held = 0;
+		}
+	}
+	for (i = 0; i < lay->params; i++)
+		if (!lay->param[i].held) free_p[nfree++] = i;
+	dims = nfree + (nsims > 1);
+	if (!dims) {
+		fprintf(stderr, "tune_sweep: nothing to search\n");
+		return 2;
+	}
+
+	snprintf(tmp_dir, sizeof(tmp_dir), "%s", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+	if (pool_init(&pool, threads, run_batch_cand) < 0) return 1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	fprintf(stderr, "tune_sweep: %s profile %d, %d parameters", lay->name, switches, nfree);
+	if (nsims > 1) fprintf(stderr, " and %d simulators", nsims);
+	fprintf(stderr, ", %s on %d threads\n", mode, threads);
+
+	if (!strcmp(mode, "grid")) ret = search_grid();
+	else if (!strcmp(mode, "random")) ret = search_random(budget);
+	else if (!strcmp(mode, "cmaes")) ret = search_cmaes(budget, threads);
+	else return usage();
+	for (i = 0; i < threads; i++) { /* the per worker profile files */
+		char profile[300];
+
+		snprintf(profile, sizeof(profile), "%s/tune_sweep.%d.%d.bin", tmp_dir, (int)getpid(), i);
+		unlink(profile);
+	}
+	if (ret < 0 || !ncand) return 1;
+
+	rank = malloc(sizeof(cand_t *) * ncand);
+	for (i = 0; i < ncand; i++) {
+		rank[i] = &cand[i];
+		cand[i].bound = 0; /* ranked on the runs alone */
+	}
+	qsort(rank, ncand, sizeof(rank[0]), by_score);
+	b = rank[0];
+
+	printf("%d candidates, %ld simulator runs in %.1f s on %d threads (%.1f runs/s, %ld steals)\n",
+		ncand, runs_done, elapsed(), threads, runs_done / elapsed(), pool.steals);
+	for (i = 0; i < top && i < ncand; i++) print_cand(stdout, rank[i], 0);
+
+	if (log_file) {
+		if (!(f = fopen(log_file, "w"))) {
+			perror(log_file);
+			return 1;
+		}
+		fprintf(f, "sim");
+		for (i = 0; i < lay->params; i++) fprintf(f, ",%s", lay->param[i].name);
+		fprintf(f, ",score,laps,time,off,err,progress,end,sat\n");
+		for (i = 0; i < ncand; i++) print_cand(f, &cand[i], 1);
+		fclose(f);
+	}
+
+	printf("best: %s profile %d (%d B at eeprom %d):", lay->name, switches, lay->size, lay->ee_base + switches * lay->size);
+	for (i = 0; i < lay->params; i++) printf(" %s %d", lay->param[i].name, b->v[i]);
+	if (nsims > 1) printf(", built as %s", sims[b->sim]);
+	printf("\n");
+	if (b->sat) printf("best drives the motors past their PWM range, not written\n");
+	else if (b->score >= FAIL_S) printf("best does not finish the track\n");
+	if (b->sat) return 1;
+	if (out_file && blob_write(out_file, b) < 0) return 1;
+	if (image && patch_image(image, b) < 0) return 1;
+	return b->score >= FAIL_S;
+}
@@ -1,8 +1,11 @@
 ﻿#include "function.h"
+#include "pattern_tables.h"
 
-int check_crossline( void );
-int check_rightline( void );
-int check_leftline( void );
+int check_crossline( uint8_t s );
+int check_rightline( uint8_t s );
+int check_leftline( uint8_t s );
+int check_noline( uint8_t s );
+void pattern_apply( const uint8_t *index, const pattern_row_t *rows );
 
 uint16_t cnt2 = 0;
 
@@ -51,28 +54,41 @@ int main(void)
 		}
 	}
 	
+    sched_stats_reset();
     while(1)
     {
         pattern = 1;
         
         while(1)
         {
+            if (!(sched_wait() & (1 << SCHED_CONTROL))) continue;	//Chờ TIMER0 nhả vòng điều khiển
+            sched_begin();
+            PROF_BEGIN(PROF_LOOP);
+            capture_sensor();		//1 frame cho cả lần lặp
+            if ((hal_buttons() | BTN2) == BTN2)	//Dừng xe, xem thống kê chu kỳ. Không dùng get_button: chờ 80ms khi BTN1 khởi động còn giữ
+            {
+                speed(0, 0);
+                handle(0);
+                hal_adc_irq_off();
+                while ((hal_buttons() | BTN2) == BTN2) hal_idle();	//Nhả BTN2, lần bấm sau mới sang profile
+                sched_show();
+            }
             switch(pattern)
                 {
                     case 1:
-                    if( check_crossline() ) //Be 90
+                    if( check_crossline(sensor) ) //Be 90
                     {
                         pattern = 21;
                         break;
                     }
-                    if( check_rightline() ) // Chuyen lan phai
+                    if( check_rightline(sensor) ) // Chuyen lan phai
                     {
                         pulse_v = 0;
                         cnt1 = 0;
                         pattern = 51;
                         break;
                     }
-                    if( check_leftline() )  // �Chuyen lan trai
+                    if( check_leftline(sensor) )  // �Chuyen lan trai
                     {
                         pulse_v = 0;
                         cnt1 = 0;
@@ -80,209 +96,17 @@ int main(void)
                         break;
                     }
                     led7(10);
-                    switch(sensor_cmp(0b01111110))
-                    {
-                        case 0b00011000:	// Chay thang
-                        handle( 0 );
-                        speed( 100 ,100 );
-                        break;
-                        
-                        //lech phai
-                        case 0b00011100:
-                        case 0b00001000:
-                        speed(100,90);
-                        handle(14);
-                        break;
-                        
-                        case 0b00001100:
-                        speed(100,80);
-                        handle(22);
-                        break;
-                        
-                        case 0b00001110:
-                        case 0b00000100:
-                        speed(100,70);
-                        handle(35);
-                        break;
-                        
-                        case 0b00000110:
-                        speed(100,60);
-                        handle(55);
-                        break;
-                        
-                        case 0b00000010:
-                        speed(100,40);
-                        handle(80);
-                        pattern=11;	//lech phai goc lon
-                        break;
-                        //////////////////////////////////////////////////////////////////////////
-                        
-                        //lech trai
-                        case 0b00111000:
-                        case 0b00010000:
-                        speed(90,100);
-                        handle(-14);
-                        break;
-                        
-                        case 0b00110000:
-                        speed(80,100);
-                        handle(-22);
-                        break;
-                        
-                        case 0b01110000:
-                        case 0b00100000:
-                        speed(70,100);
-                        handle(-36);
-                        break;
-                        
-                        case 0b01100000:
-                        speed(60,100);
-                        handle(-55);
-                        break;
-                        
-                        case 0b01000000:
-                        speed(40,100);
-                        handle(-80);
-                        pattern=12; //lech trai goc lon
-                        cnt1 = 0;
-                        pulse_v = 0;
-                        break;
-                        
-                        default:
-                        break;
-                    }
+                    pattern_apply(trace_index, trace_rows);
                     break;
                     
                     case 11:
                     led7(11);
-                    switch (sensor_cmp(0b11111111))
-                    {
-                        case 0b00000011:
-                        handle(60);
-                        speed(90,50);
-                        break;
-                        
-                        case 0b00000110:
-                        handle(55);
-                        speed(90,50);
-                        break;
-                        
-                        case 0b00001100:
-                        handle(40);
-                        speed(90,60);
-                        break;
-                        
-                        case 0b00000001:
-                        handle(90);
-                        speed(90, 30);
-                        break;
-                        
-                        case 0b10000001:
-                        handle(90);
-                        speed(90, 20);
-                        break;
-                        
-                        case 0b10000000:
-                        handle(100);
-                        speed(90, 10);
-                        break;
-                        
-                        case 0b11000000:
-                        handle(105);
-                        speed(90, 0);
-                        break;
-                        
-                        case 0b01100000:
-                        case 0b11100000:
-                        handle(120);
-                        speed(90, 0);
-                        break;
-                        
-                        case 0b00110000:
-                        case 0b11110000:
-                        handle(130);
-                        speed(90, -10);
-                        break;
-                        
-                        case 0b00010000:
-                        case 0b00001000:
-                        case 0b00000100:
-                        case 0b00011000:
-                        pattern = 1;
-                        pulse_v = 0;
-                        cnt1 = 0;
-                        led7(10);
-                        break;
-                        
-                        default:
-                        break;
-                    }
+                    pattern_apply(right_index, right_rows);
                     break;
                     
                     case 12:
                     led7(12);
-                    switch (sensor_cmp(0b11111111))
-                    {
-                        case 0b11000000:
-                        handle(-60);
-                        speed(50,90);
-                        break;
-                        
-                        case 0b01100000:
-                        handle(-55);
-                        speed(50,90);
-                        break;
-                        
-                        case 0b00110000:
-                        handle(-40);
-                        speed(60,90);
-                        break;
-                        
-                        case 0b10000000:
-                        handle(-90);
-                        speed(30, 90);
-                        break;
-                        
-                        case 0b10000001:
-                        handle(-90);
-                        speed(20, 90);
-                        break;
-                        
-                        case 0b00000001:
-                        handle(-85);
-                        speed(10, 90);
-                        break;
-                        
-                        case 0b00000011:
-                        handle(-105);
-                        speed(0, 90);
-                        break;
-                        
-                        case 0b00000110:
-                        case 0b00000111:
-                        handle(-120);
-                        speed(0, 90);
-                        break;
-                        
-                        case 0b00001100:
-                        case 0b00001111:
-                        handle(-130);
-                        speed(-10, 90);
-                        break;
-                        
-                        case 0b00001000:
-                        case 0b00010000:
-                        case 0b00100000:
-                        case 0b00011000:
-                        pattern = 1;
-                        pulse_v = 0;
-                        cnt1 = 0;
-                        led7(10);
-                        break;
-                        
-                        default:
-                        break;
-                    }
+                    pattern_apply(left_index, left_rows);
                     break;
 
                     case 21:
@@ -291,6 +115,7 @@ int main(void)
 					if ((cnt2 % 5) == 0)
 					{
 						speed(-7, -7);
+						sched_skip();		//Chờ 2ms, chu kỳ này không tính vào thống kê
 						_delay_ms(2);
 					}
 					else
@@ -313,14 +138,14 @@ int main(void)
 					case 23:
 					led7(23);
 					//cua trai
-					if( ((pulse_v>50) || (cnt1 > 80)) && ((sensor_cmp(0b11111111)==0b11111000)  || (sensor_cmp(0b11111111)==0b11110000) || (sensor_cmp(0b11111111)==0b11100000) || (sensor_cmp(0b11111111)==0b11111100)))	// Neu gap tin hieu nay la goc cua 90 trai thi be
+					if( ((pulse_v>50) || (cnt1 > 80)) && ((sensor==0b11111000)  || (sensor==0b11110000) || (sensor==0b11100000) || (sensor==0b11111100)))	// Neu gap tin hieu nay la goc cua 90 trai thi be
 					{
 						pattern = 26;
 						cnt1=0;
 						break;
 					}
 					//cua phai
-					if(  ((pulse_v>50) || (cnt1 > 80)) &&   ((sensor_cmp(0b11111111)==0b00011111 ) ||(sensor_cmp(0b11111111)==0b00000111) || (sensor_cmp(0b11111111)==0b00001111) || (sensor_cmp(0b11111111)==0b00111111))) // Neu gap tin hieu nay la goc cua 90 phai thi be
+					if(  ((pulse_v>50) || (cnt1 > 80)) &&   ((sensor==0b00011111 ) ||(sensor==0b00000111) || (sensor==0b00001111) || (sensor==0b00111111))) // Neu gap tin hieu nay la goc cua 90 phai thi be
 					{
 						pattern = 27;
 						cnt1=0;
@@ -328,67 +153,8 @@ int main(void)
 					}
 					speed(70, 70);
 					// Nguoc lai thi chinh thang cho xe
-					switch(sensor_cmp(0b01111110))
-					{
-						case 0b01111110:
-						handle(0);
-						break;
-						
-						case 0b00011000:	// Chay thang
-						handle( 0 );
-						break;
-						
-						//lech phai
-						case 0b00011100:
-						case 0b00001000:
-						handle(14);
-						break;
-						
-						case 0b00001100:
-						handle(22);
-						break;
-						
-						case 0b00001110:
-						case 0b00000100:
-						handle(35);
-						break;
-						
-						case 0b00000110:
-						handle(55);
-						break;
-						
-						case 0b00000010:
-						handle(80);
-						break;
-						//////////////////////////////////////////////////////////////////////////
-						//lech trai
-						
-						case 0b00111000:
-						case 0b00010000:
-						handle(-14);
-						break;
-						
-						case 0b00110000:
-						handle(-22);
-						break;
-						
-						case 0b01110000:
-						case 0b00100000:
-						handle(-36);
-						break;
-						
-						case 0b01100000:
-						handle(-55);
-						break;
-						
-						case 0b01000000:
-						handle(-80);
-						break;
-						
-						default:
-						break;
-					}
-					if (sensor_cmp(0xff) == 0x00)
+					pattern_apply(center_index, center_rows);
+					if (check_noline(sensor))
 					{
 						pattern = 73;
 						handle(0);
@@ -426,7 +192,7 @@ int main(void)
 					
 					case 32:	// Cho tin hieu de ve truong hop chay thang va be cong
 					led7(32);
-					if( sensor_cmp(0b11100111) == 0b00100000 )
+					if( (sensor & 0b11100111) == 0b00100000 )
 					{
 						pattern = 1;
 						pulse_v = 0;
@@ -444,7 +210,7 @@ int main(void)
 					
 					case 42:
 					led7(42);
-					if( sensor_cmp(0b11100111) == 0b00000100 ) {
+					if( (sensor & 0b11100111) == 0b00000100 ) {
 						pattern = 1;
 						pulse_v = 0;
 						cnt1 = 0;
@@ -454,7 +220,7 @@ int main(void)
 
 					#pragma region Chuyen_Line_Nhanh
 					case 51: //PHAI
-					if ((sensor_cmp(0b11100000) == 0b11100000) || (sensor_cmp(0b11110000) == 0b11110000) || (sensor_cmp(0b11111000) == 0b11111000))
+					if ((sensor & 0b11100000) == 0b11100000)
 					{
 						pattern = 21 ;
 						break;
@@ -481,7 +247,7 @@ int main(void)
 					case 54:
 					led7(54);
 					led7(54);
-					if(((pulse_v > 100) || (cnt1 > 200)) && (sensor_cmp( 0b00110000 ) == 0b00110000))
+					if(((pulse_v > 100) || (cnt1 > 200)) && ((sensor & 0b00110000) == 0b00110000))
 					{
 						speed(80, 85);
 						handle(-20);
@@ -492,7 +258,7 @@ int main(void)
 					break;
 
 					case 61:	// Xu ly khi gap vach tin hieu chuyen lan trai dau tien
-					if ( (sensor_cmp(0b00000111) == 0b00000111) || (sensor_cmp(0b00001111) == 0b00001111) || (sensor_cmp(0b00011111) == 0b00011111))
+					if ((sensor & 0b00000111) == 0b00000111)
 					{
 						pattern = 21 ;
 						break;
@@ -517,7 +283,7 @@ int main(void)
 
 					case 64:
 					led7(64);
-					if(((pulse_v > 100) || (cnt1 > 200 * 0)) && (sensor_cmp( 0b00110000 ) == 0b00110000))
+					if(((pulse_v > 100) || (cnt1 > 200 * 0)) && ((sensor & 0b00110000) == 0b00110000))
 					{
 						speed(85, 80);
 						handle(20);
@@ -677,9 +443,9 @@ int main(void)
 					case 73:
 					led7(73);
 					speed(100,100);
-					if (sensor_cmp(0b10000000)) handle(30);
-					if (sensor_cmp(0b00000001)) handle(-30);
-					if (sensor_cmp(0b01111110) > 0)
+					if (sensor & 0b10000000) handle(30);
+					if (sensor & 0b00000001) handle(-30);
+					if ((sensor & 0b01111110) > 0)
 					{
 						pattern=1;
 					}
@@ -689,6 +455,8 @@ int main(void)
 					pattern = 1;
 					break;
                 }
+            PROF_END(PROF_LOOP);
+            sched_end();
         }
         
     }
@@ -696,32 +464,50 @@ int main(void)
 
 ISR(TIMER0_COMP_vect)
 {
+    PROF_BEGIN(PROF_TIMER0);
+    sched_isr();
     cnt1++;
 	cnt2++;
     cal_ratio();
     print();			//Quét LED7 đoạn
+    PROF_END(PROF_TIMER0);
 }
 
 ISR(INT0_vect)
 {
+	PROF_BEGIN(PROF_INT0);
 	pulse_v++;
+	PROF_END(PROF_INT0);
 }
 
-int check_crossline( void )
+void pattern_apply( const uint8_t *index, const pattern_row_t *rows )	//Tra bảng theo sensor (patterns.tbl)
+{
+    pattern_row_t row;
+    
+    pattern_row(index, rows, sensor, &row);
+    if (row.flags & PT_SPEED)  speed(row.left, row.right);
+    if (row.flags & PT_HANDLE) handle(row.handle);
+    if (row.next)
+    {
+        pattern = row.next;
+        pulse_v = 0;
+        cnt1 = 0;
+    }
+}
+
+int check_crossline( uint8_t s )
+{
+    return ((s & 0b01111110) == 0b01111110);
+}
+int check_rightline( uint8_t s )
 {
-    int ret=0;
-    if(( sensor_cmp(0b11111111)==0b11111111) || (sensor_cmp(0b01111110)==0b01111110))ret = 1;
-    return ret;
+    return ((s & 0b00001111) == 0b00001111);
 }
-int check_rightline( void )
+int check_leftline( uint8_t s )
 {
-    int ret=0;
-    if( (sensor_cmp(0b00001111) == 0b00001111) || (sensor_cmp(0b00011111)==0b00011111))  ret = 1;
-    return ret;
+    return ((s & 0b11110000) == 0b11110000);
 }
-int check_leftline( void )
+int check_noline( uint8_t s )
 {
-    int ret=0;
-    if( (sensor_cmp(0b11110000) == 0b11110000) || (sensor_cmp(0b11111000)== 0b11111000)) ret = 1;
-    return ret;
+    return (s == 0x00);
 }
\ No newline at end of file
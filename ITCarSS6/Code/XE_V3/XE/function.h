@@ -1,8 +1,8 @@
 ﻿#define F_CPU 16000000UL
-#include <avr/io.h>
-#include <util/delay.h>
-#include <avr/interrupt.h>
-#include <avr/eeprom.h>
+#include "hal.h"
+#include "fixed.h"
+#include "display.h"
+#include "eeblob.h"
 
 #ifndef sbi
 #define sbi(port,bit) port|=(1 << bit)
@@ -22,14 +22,57 @@
 #define DIR01	1
 #define DIR10	3
 #define DIR11   6
-#define SERVO_CENTER		3000 -(50)	//Sai số của cần sensor trên xe
+#define SERVO_CENTER		3000 -(50)	//Sai số của cần sensor trên xe, giá trị mặc định của servo_center
 #define STEP				7			//Bước quay của servo
 #define vach_xam			19/20			//Bằng 1 nếu đường line không có vạch xám
 
+//ADC profile
+//ADC_8BIT = 0: ADC clock /128 (125kHz), đọc ADCW 10 bit, ~104us/kênh, 1 frame ~832us
+//ADC_8BIT = 1: ADC clock /32 (500kHz), ADLAR, chỉ đọc ADCH 8 bit, ~26us/kênh, 1 frame ~208us
+//Eeprom luôn lưu theo thang 10 bit nên đổi profile không cần học lại màu
+#ifndef ADC_8BIT
+#define ADC_8BIT			0
+#endif
+#if ADC_8BIT
+typedef uint8_t adc_t;
+#define ADC_MAX				255
+#define ADC_SHIFT			2
+#define ADC_ADMUX			((1<<REFS0)|(1<<ADLAR))
+#define ADC_PRESCALER		((1<<ADPS2)|(1<<ADPS0))
+#define ADC_RESULT			hal_adc8()
+#else
+typedef uint16_t adc_t;
+#define ADC_MAX				1023
+#define ADC_SHIFT			0
+#define ADC_ADMUX			(1<<REFS0)
+#define ADC_PRESCALER		((1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0))
+#define ADC_RESULT			hal_adc10()
+#endif
+
 //Variable ADC
-uint16_t ADC_average[8];		//ADC trung bình
-uint16_t linetrang[8];			//ADC line trắng
-uint16_t lineden[8];			//ADC line đen
+adc_t ADC_average[8];			//ADC trung bình
+adc_t linetrang[8];				//ADC line trắng
+adc_t lineden[8];				//ADC line đen
+uint16_t servo_center = SERVO_CENTER;	//Tâm servo, lưu trong config
+
+//Config: toàn bộ thông số hiệu chỉnh, đọc/ghi 1 khối có CRC (eeblob.h)
+//ADC luôn lưu theo thang 10 bit. Đổi cấu trúc thì tăng CONFIG_VERSION
+#define CONFIG_VERSION		1
+typedef struct Config {
+	uint8_t  version;
+	uint16_t adc_line[8];			//linetrang
+	uint16_t adc_no_line[8];		//lineden
+	uint16_t servo_center;
+	uint16_t crc;
+} config_t;
+config_t EEMEM eeprom_config;
+
+//Variable ADC scan (ADC_vect quét vòng kênh 0->7)
+volatile adc_t    adc_frame[2][8];	//Double buffer: ISR ghi buffer sau, chương trình đọc buffer trước
+volatile uint8_t  adc_front;		//Buffer đã quét xong gần nhất
+volatile uint8_t  adc_sensor;		//Kết quả so sánh 8 sensor của frame gần nhất
+volatile uint8_t  adc_frame_cnt;	//Tăng 1 mỗi khi quét xong 1 frame
+uint8_t adc_ch, adc_mask, adc_bits;	//Trạng thái quét, chỉ dùng trong ISR
 
 //Variable LED7
 struct led7 {
@@ -42,35 +85,35 @@ struct led7 {
 } led7_data;
 
 //Variable RATIO
-#define ratio_default 0.1
+#define ratio_default 10			//% (0.1)
 uint16_t cnt_ratio, pulse_ratio;
 uint16_t velocity;
-float ratio;					//Tỉ số tốc độ
-float ratio_base;				//Tỉ số tốc độ nền	
+q8_8_t ratio;					//Tỉ số tốc độ, Q8.8
+q8_8_t ratio_base;				//Tỉ số tốc độ nền, Q8.8	
 
 //===================BUTTON + SWITCH=====================
 uint8_t get_button(uint8_t keyid)
 {
-	if ( (PINB & 0x0e) != 0x0e)
+	if ( (hal_buttons() & 0x0e) != 0x0e)
 	{
 		_delay_ms(80);
-		if ((PINB|keyid) == keyid) return 1;
+		if ((hal_buttons()|keyid) == keyid) return 1;
 	}
 	return 0;
 }
 uint8_t get_switch() // trả về từ 0->15
 {
 	uint8_t x=0;
-	x = ~PINC;
+	x = ~hal_switches();
 	x = x & 0x0f;
 	return x;
 }
-float get_switch_2() //trả về 0.1 -> 0.4
+uint8_t get_switch_2() //trả về 0 -> 40 (%), mỗi switch 10%
 {
-	float val=0;
+	uint8_t val=0;
 	for(uint8_t i=0; i<4; i++)
 	{
-		if ( (((~PINC)>>i)&0x1) == 0x1 ) val+=0.1;
+		if ( (((~hal_switches())>>i)&0x1) == 0x1 ) val+=10;
 	}
 	return val;
 }
@@ -85,10 +128,10 @@ void cal_ratio()
 	/*cnt_ratio++;
 	if (cnt_ratio == 20) //20ms
 	{
-		if      (pulse_ratio < velocity / 2)    ratio = ratio_base + 0.3;
-		else if (pulse_ratio < velocity)        ratio = ratio_base + 0.1;
-		else if (pulse_ratio > velocity)        ratio = ratio_base - 0.35;
-		else if (pulse_ratio > velocity / 2)    ratio = ratio_base - 0.25;
+		if      (pulse_ratio < velocity / 2)    ratio = q8_8_add(ratio_base, Q8_8(0.3));
+		else if (pulse_ratio < velocity)        ratio = q8_8_add(ratio_base, Q8_8(0.1));
+		else if (pulse_ratio > velocity)        ratio = q8_8_add(ratio_base, Q8_8(-0.35));
+		else if (pulse_ratio > velocity / 2)    ratio = q8_8_add(ratio_base, Q8_8(-0.25));
 		else ratio = ratio_base;
 		pulse_ratio = 0;
 		cnt_ratio = 0;
@@ -99,52 +142,52 @@ void handle(int goc)
 {
 	if (goc>150) goc=150;
 	else if(goc<-150) goc=-150;
-	OCR1A=SERVO_CENTER+goc*STEP;
+	hal_servo(servo_center+goc*STEP);
 }
 void speed(int left, int right)
 {
-	left  = left  *  ratio;
-	right = right *  ratio;
+	left  = q8_8_scale(left, ratio);
+	right = q8_8_scale(right, ratio);
 
 	if(left>=0)
 	{
-		sbi(PORTD, DIR00);
-		cbi(PORTD, DIR01);
-		OCR1B=left*200;
+		hal_dir_set(DIR00);
+		hal_dir_clr(DIR01);
+		hal_motor_l(left*200);
 	}
 	else
 	{
-		cbi(PORTD, DIR00);
-		sbi(PORTD, DIR01);
-		OCR1B=-left*200;
+		hal_dir_clr(DIR00);
+		hal_dir_set(DIR01);
+		hal_motor_l(-left*200);
 	}
 	
 	if(right>=0)
 	{
-		sbi(PORTD, DIR10);
-		cbi(PORTD, DIR11);
-		OCR2=right*255/100;
+		hal_dir_set(DIR10);
+		hal_dir_clr(DIR11);
+		hal_motor_r(right*255/100);
 	}
 	else
 	{
-		cbi(PORTD, DIR10);
-		sbi(PORTD, DIR11);
-		OCR2=-right*255/100;
+		hal_dir_clr(DIR10);
+		hal_dir_set(DIR11);
+		hal_motor_r(-right*255/100);
 	}
 }
 
 inline void fast_brake_left()
 {
-	sbi(PORTD, DIR00);
-	sbi(PORTD, DIR01);
-	OCR1B=20000;
+	hal_dir_set(DIR00);
+	hal_dir_set(DIR01);
+	hal_motor_l(20000);
 }
 
 inline void fast_brake_right()
 {
-	sbi(PORTD, DIR10);
-	sbi(PORTD, DIR11);
-	OCR2=255;
+	hal_dir_set(DIR10);
+	hal_dir_set(DIR11);
+	hal_motor_r(255);
 }
 
 void fast_brake()
@@ -154,20 +197,25 @@ void fast_brake()
 }
 
 //==========================LED7=========================
-void SPI(uint8_t data)			//Truyền dữ  liệu sang led7, sử dụng SPI
+volatile uint8_t spi_next;		//Byte thứ 2 chờ SPI_STC_vect gửi
+volatile uint8_t spi_left;		//Số byte còn đang truyền
+uint16_t led7_last = 0xffff;		//Giá trị đang hiển thị, không đổi thì bỏ qua
+uint8_t  led7_mode = 0xff;
+void led7_show(uint16_t num, uint8_t mode)	// Tính toán dữ liệu cho 4 led 7 đoạn (DISP_DEC/SIGNED)
 {
-	SPDR = data;
-	while(!(SPSR & (1<<SPIF)));	//Đợi phần cứng truyền xong data
+	uint8_t d[4];
+	if (num == led7_last && mode == led7_mode) return;
+	led7_last = num;
+	led7_mode = mode;
+	disp_digits(num, mode, d);
+	led7_data.thousand	= d[0];
+	led7_data.hundred	= d[1];
+	led7_data.ten		= d[2];
+	led7_data.unit		= d[3];
 }
-void led7(unsigned int num)		// Tính toán dữ liệu cho 4 led 7 đoạn
+void led7(unsigned int num)
 {
-	led7_data.unit		 = (1<<7) |(unsigned int)(num%10);
-	led7_data.ten		 = (unsigned int)(num%100 / 10);
-	led7_data.hundred	 = (unsigned int)(num%1000 / 100);
-	led7_data.thousand	 = (unsigned int)(num/ 1000);
-	led7_data.thousand	|= (led7_data.thousand!=0)? 1<<4 : 0;
-	led7_data.hundred	|= (led7_data.thousand!=0 || led7_data.hundred!=0)? 1<<5 : 0;
-	led7_data.ten		|= (led7_data.thousand!=0 || led7_data.hundred !=0 || led7_data.ten!=0)? 1<<6 : 0;
+	led7_show(num, DISP_DEC);
 }
 void print()					//Luôn thực thi mỗi vài ms để quét LED
 {
@@ -181,62 +229,152 @@ void print()					//Luôn thực thi mỗi vài ms để quét LED
 		case 3: value=led7_data.unit;		break;
 		default: break;
 	}
-	SPI(~led7_data.sensor_out);
-	SPI(value);
-	sbi(PORTB,LATCH);
-	cbi(PORTB,LATCH);
+	if (spi_left) return;		//Frame trước chưa xong, bỏ qua lần quét này
+	spi_next = value;
+	spi_left = 2;
+	hal_spi_write(~led7_data.sensor_out);	//SPI_STC_vect gửi tiếp byte 2 rồi chốt LATCH
 }
-
-//==========================ADC==========================
-void read_adc_eeprom()
+ISR(SPI_STC_vect)				//Không chờ SPIF trong ISR timer
 {
-	for(uint8_t j=0; j<8; j++)
+	if (--spi_left)
 	{
-		while(!eeprom_is_ready());
-		linetrang[j] = eeprom_read_word((uint16_t*)(j*2));
-		while(!eeprom_is_ready());
-		lineden[j] = eeprom_read_word((uint16_t*)((j+8)*2));
+		hal_spi_write(spi_next);
 	}
+	else
+	{
+		hal_latch_pulse();
+	}
+}
+
+//========================PROFILE========================
+#define PROF_DISPLAY(v, leds)	do { led7(v); led7_data.sensor_out = (leds); } while (0)
+#define PROF_NEXT()				get_button(BTN1)
+#include "prof.h"												//Chỉ có trong bản Debug (PROFILE)
+#define PROF_TIMER0		0										//Thân TIMER0_COMP_vect
+#define PROF_INT0		1										//Thân INT0_vect
+#define PROF_ADC		2										//Thân ADC_vect (1 kênh)
+#define PROF_LOOP		3										//1 vòng lặp pattern
+
+//=======================SCHEDULER=======================
+#define SCHED_CONTROL_TICKS	1										//Vòng pattern mỗi 1ms, cnt1/cnt2 vẫn đếm theo ms
+#define SCHED_SHOW(v, leds)	PROF_DISPLAY(v, leds)
+#define SCHED_NEXT()		get_button(BTN1)
+#define SCHED_PROF()		get_button(BTN2)
+#include "sched.h"												//TIMER0_COMP_vect nhả vòng pattern theo chu kỳ cố định
+
+//==========================ADC==========================
+void adc_average()											//Ngưỡng so sánh từng kênh từ màu đã học
+{
 	for(uint8_t i=0; i<8; i++)
 	{
 		ADC_average[i]=(linetrang[i]+lineden[i])/2;
 		ADC_average[i]=ADC_average[i]*vach_xam;
 	}
 }
-void write_adc_eeprom()
+void config_load()											//Đọc 1 khối, sai CRC/version thì dùng mặc định
 {
+	config_t c;
+	uint8_t  legacy = 1;
+	
+	if(blob_load(&c, &eeprom_config, sizeof(config_t), CONFIG_VERSION))
+	{
+		servo_center = c.servo_center;
+	}
+	else
+	{
+		eeprom_read_block(c.adc_line, (const void*)0, 32);	//Bản cũ: 16 word màu ở địa chỉ 0, chưa có CRC (adc_line, adc_no_line liền nhau)
+		for(uint8_t j=0; j<8; j++)
+			if(c.adc_line[j] > 1023 || c.adc_no_line[j] > 1023) legacy = 0;
+		if(!legacy)
+		{
+			for(uint8_t j=0; j<8; j++)
+			{
+				c.adc_line[j]    = 0;
+				c.adc_no_line[j] = 1023;
+			}
+		}
+		servo_center = SERVO_CENTER;
+	}
 	for(uint8_t j=0; j<8; j++)
 	{
-		while(!eeprom_is_ready());
-		eeprom_write_word((uint16_t*)(j*2), (uint16_t)linetrang[j]);
-		while(!eeprom_is_ready());
-		eeprom_write_word((uint16_t*)((j+8)*2), (uint16_t)lineden[j]);
+		linetrang[j] = c.adc_line[j] >> ADC_SHIFT;
+		lineden[j]   = c.adc_no_line[j] >> ADC_SHIFT;
 	}
+	adc_average();
 }
-uint16_t adc_read(uint8_t ch)
+void config_save()											//Chỉ ghi các byte đã thay đổi
 {
-	ADMUX = (1<< REFS0)|ch;									// selecting channel
-	ADCSRA|=(1<<ADSC);										// start conversion
-	while(!(ADCSRA & (1<<ADIF)));							// waiting for ADIF, conversion complete
-	return ADCW;											// Giá trị trả về từ [0 -> 1024] tương ứng [0V -> 5V]	
+	config_t c;
+	
+	c.version = CONFIG_VERSION;
+	for(uint8_t j=0; j<8; j++)
+	{
+		c.adc_line[j]    = (uint16_t)linetrang[j] << ADC_SHIFT;
+		c.adc_no_line[j] = (uint16_t)lineden[j] << ADC_SHIFT;
+	}
+	c.servo_center = servo_center;
+	blob_save(&c, &eeprom_config, sizeof(config_t));
 }
-uint8_t sensor_cmp(uint8_t mask)							//Sensor compare: đọc về và so sánh với trung bình 
-{															//Thêm tính năng che mặt nạ: mask mặc định là: 0xff (0b11111111)
-	uint8_t ADC_value=0;												
-	for(uint8_t i=0; i<8; i++)
+void adc_start()											//Bắt đầu quét, sau đó ADC_vect tự chạy liên tục
+{
+	adc_ch   = 0;
+	adc_mask = 1;
+	adc_bits = 0;
+	hal_adc_start(ADC_ADMUX);								// channel 0, start conversion
+}
+ISR(ADC_vect)												//Mỗi kênh ~104us (10 bit) hoặc ~26us (8 bit)
+{
+	PROF_BEGIN(PROF_ADC);
+	uint8_t back = adc_front ^ 1;
+	adc_t   val  = ADC_RESULT;								// Giá trị trả về từ [0 -> ADC_MAX] tương ứng [0V -> 5V]
+	
+	adc_frame[back][adc_ch] = val;
+	if(val < ADC_average[adc_ch]) adc_bits |= adc_mask;		//Nhỏ hơn trung bình -> gần về 0V -> led thu hồng ngoại dẫn -> có nhiều hồng ngoại -> vạch trắng
+	adc_mask <<= 1;
+	
+	if(++adc_ch == 8)										//Xong 1 frame: đổi buffer
 	{
-		if(adc_read(i)<ADC_average[i]) sbi(ADC_value,i);	//Nhỏ hơn trung bình -> gần về 0V -> led thu hồng ngoại dẫn -> có nhiều hồng ngoại -> vạch trắng
-		//else    cbi(ADC_value,i);
+		adc_front = back;
+		adc_sensor = adc_bits;
+		led7_data.sensor_out = adc_bits;					//Cập nhật giá trị xuất ra 8 led đơn
+		adc_frame_cnt++;
+		adc_ch   = 0;
+		adc_mask = 1;
+		adc_bits = 0;
 	}
-	led7_data.sensor_out=ADC_value;							//Cập nhật giá trị xuất ra 8 led đơn
-	return (ADC_value & mask);
+	hal_adc_start(ADC_ADMUX|adc_ch);						// chọn kênh tiếp theo + start conversion, cờ ADIF được phần cứng xóa khi vào ngắt
+	PROF_END(PROF_ADC);
+}
+void adc_wait_frame()										//Đợi ADC_vect quét xong 1 frame mới
+{
+	uint8_t cnt = adc_frame_cnt;
+	while(cnt == adc_frame_cnt) hal_idle();
+}
+adc_t adc_read(uint8_t ch)									//Giá trị kênh ch trong frame mới nhất, không đợi ADC
+{
+	adc_t val;
+	cli();
+	val = adc_frame[adc_front][ch];
+	sei();
+	return val;
+}
+uint8_t sensor_cmp(uint8_t mask)							//Sensor compare: trả về kết quả so sánh của frame mới nhất (đã tính sẵn trong ADC_vect)
+{															//Thêm tính năng che mặt nạ: mask mặc định là: 0xff (0b11111111)
+	return (adc_sensor & mask);
+}
+uint8_t sensor;												//Frame sensor của lần lặp hiện tại, dùng chung cho mọi hàm kiểm tra
+uint8_t capture_sensor()									//Chụp 1 frame cho mỗi lần lặp, các hàm kiểm tra chỉ so bit trên frame này
+{
+	hal_idle();												//adc_sensor, cnt1, pulse_v chỉ đổi trong ngắt: vòng pattern là vòng chờ
+	sensor = adc_sensor;
+	return sensor;
 }
 void learn_color()
 {
-	uint16_t ADC_temp=0;
+	adc_t ADC_temp=0;
 	for (uint8_t i=0; i<8; i++)
 	{
-		linetrang[i]=1024;
+		linetrang[i]=ADC_MAX;
 		lineden[i]=0;
 	}
 	
@@ -245,6 +383,7 @@ void learn_color()
 	{
 		if(get_button(BTN0)) return;
 		else if(get_button(BTN2)) break;
+		adc_wait_frame();
 		for (uint8_t i=0; i<8; i++)
 		{
 			ADC_temp=adc_read(i);
@@ -252,51 +391,71 @@ void learn_color()
 			if(ADC_temp>lineden[i]) lineden[i]=ADC_temp;
 		}
 	}
+	adc_average();
+	config_save();											//Ghi vào eeprom để cho các lần sau
+}
+#define SWEEP_SERVO(pos)	handle(pos)
+#define SWEEP_FRAME(v)		do { adc_wait_frame(); for (uint8_t _i=0; _i<8; _i++) (v)[_i]=adc_read(_i); } while (0)
+#if ADC_8BIT
+#define SWEEP_FRAMES_PER_STEP	4								//Frame 8 bit ~0.21ms
+#endif
+#include "sweep_cal.h"
+void auto_color()											//Đặt xe ngang qua line, servo quét cần sensor để tự học màu
+{
+	adc_t lo[8], hi[8], noise[8];
+	adc_t worst=0;
+	uint8_t bad, manual=0;
+	
+	speed(0,0);
+	led7(2018);
+	bad = sweep_cal(lo, hi, noise);							//~0.65s, trả về các kênh không đạt
 	for (uint8_t i=0; i<8; i++)
 	{
-		ADC_average[i]=(linetrang[i]+lineden[i])/2;
-		
-		ADC_average[i]=ADC_average[i] * vach_xam;
+		if (noise[i] > worst) worst=noise[i];
 	}
-	write_adc_eeprom();										//Ghi vào eeprom để cho các lần sau			
+	if (bad == 0)											//Tất cả kênh đạt thì mới lưu
+	{
+		for (uint8_t i=0; i<8; i++)
+		{
+			linetrang[i]=lo[i];
+			lineden[i]=hi[i];
+		}
+		adc_average();
+		config_save();
+	}
+	hal_adc_irq_off();										//Dừng quét để ADC_vect không ghi đè 8 led
+	led7((uint16_t)worst << ADC_SHIFT);						//LED7: nhiễu lớn nhất lúc đứng yên (10 bit)
+	led7_data.sensor_out = bad;								//8 led: kênh không đạt
+	while(1)
+	{
+		if(get_button(BTN0)) break;
+		else if(get_button(BTN1)) { manual=1; break; }		//Học màu bằng tay như cũ
+	}
+	hal_adc_irq_on();
+	adc_start();
+	if(manual) learn_color();
 }
 
 //=======================INITIAL=========================
 void INIT()
 {
 	//ADC
-	ADMUX=(1<<REFS0);										// 0b0100000000 Chọn điện áp tham chiếu từ chân AVCC, thêm tụ ở AREF
-	ADCSRA=(1<<ADEN) | (1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0);	// 0b10000111 Enable ADC and set Prescaler = 128
-	read_adc_eeprom();										// Tự động đọc Eeprom ra khi bật nguồn chip
+	hal_init_adc(ADC_ADMUX, (1<<ADEN) | (1<<ADIE) | ADC_PRESCALER);	// Tham chiếu AVCC (thêm tụ ở AREF), Enable ADC + ngắt ADC, Prescaler theo ADC profile
+	config_load();											// Tự động đọc config từ Eeprom khi bật nguồn chip
 	
 	//PORT
-	DDRB  = 0b11110001;
-	PORTB = 0b11111111;
-	DDRC  = 0b00000000;
-	PORTC = 0b11111111;
-	DDRD  = 0b11111011;
-	PORTD = (1 << DIR00) | (1 << DIR10);										// DIR00 = 1, DIR01 = 0, DIR10 = 1, DIR11 = 0
-	
-	//SPI
-	SPCR	= (1<<SPE)|(1<<MSTR);							//Enable spi, Master
-	SPSR	= (1<<SPI2X);									//SCK Mode 2X: Fosc/2
+	hal_init_ports((1 << DIR00) | (1 << DIR10));			// DIR00 = 1, DIR01 = 0, DIR10 = 1, DIR11 = 0
 	
-	//TIMER
-	TCCR0=(1<<WGM01) | (1<<CS02);							// Mode 2 CTC,  Prescaler = 256
-	OCR0=62;												// 1ms
-	TIMSK=(1<<OCIE0);
-		
-	TCCR1A = (1<<COM1A1)|(1<<COM1B1)|(1<<WGM11);			// SET OCR1A & OCR1B at BOTTOM, CLEAR at Compare Match (Non-invert), Mode 14 Fast PWM
-	TCCR1B = (1<<WGM13)|(1<<WGM12)|(1<<CS11);				// Prescaler = 8
-	ICR1 = 20000;											// Time Period = 10ms
+	//SPI: Master, Fosc/2, ngắt SPI
+	hal_init_spi();
 	
-	TCCR2=(1<<WGM20)|(1<<WGM21)|(1<<COM21)|(1<<CS22)|(1<<CS21)|(1<<CS20);  //SET OC2 at BOTTOM, CLEAR OC2 on compare match,(non-invert), Mode 3 Fast PWM,  Prescaler = 1024
-	OCR2=0;
+	//TIMER: Timer0 1ms, Timer1 servo chu kỳ 10ms, Timer2 PWM motor phải
+	hal_init_timers();
 	sei();
+	adc_start();											// Bắt đầu quét ADC bằng ngắt
 	
 	//ENCODER
-	MCUCR |= (1<<ISC11)|(1<<ISC01);
-	GICR |= (1<<INT0);
+	hal_init_encoder((1<<ISC11)|(1<<ISC01));
 	set_encoder(19);
 }
 
@@ -321,11 +480,11 @@ void sel_mode()
 	speed(0,0);
 	while(1)
 	{
-		ratio = ratio_base = ratio_default + get_switch_2();
-		led7(ratio_base*100);
+		ratio = ratio_base = q8_8_from_pct(ratio_default + get_switch_2());
+		led7(q8_8_to_pct(ratio_base));
 		sensor_cmp(0xff);
 		if(get_button(BTN0))		return;
 		else if (get_button(BTN1))	test_hardware();
-		else if (get_button(BTN2))	learn_color();
+		else if (get_button(BTN2))	auto_color();
 	}
 }
\ No newline at end of file
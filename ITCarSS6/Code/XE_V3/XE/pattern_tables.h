@@ -0,0 +1,164 @@
+/*
+ * pattern_tables.h
+ *
+ * Generated by Host/gen_pattern_tables.py from patterns.tbl, do not edit.
+ * Index: sensor byte -> row. Row 0 does nothing.
+ */
+
+#ifndef PATTERN_TABLES_H_
+#define PATTERN_TABLES_H_
+
+#include "hal.h" /* PROGMEM, pgm_read_* */
+
+#define PT_HANDLE  0x01
+#define PT_SPEED   0x02
+#define PT_ENCODER 0x04
+
+typedef struct Pattern_row {
+	int16_t handle;
+	int8_t  left, right;
+	int8_t  encoder;
+	uint8_t next;
+	uint8_t flags;
+} pattern_row_t;
+
+/* trace: mask 0b01111110, 12 rows */
+const pattern_row_t trace_rows[12] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{    80,  100,   40,    0,  11, 0x03 },
+	{    35,  100,   70,    0,   0, 0x03 },
+	{    55,  100,   60,    0,   0, 0x03 },
+	{    14,  100,   90,    0,   0, 0x03 },
+	{    22,  100,   80,    0,   0, 0x03 },
+	{   -14,   90,  100,    0,   0, 0x03 },
+	{     0,  100,  100,    0,   0, 0x03 },
+	{   -36,   70,  100,    0,   0, 0x03 },
+	{   -22,   80,  100,    0,   0, 0x03 },
+	{   -80,   40,  100,    0,  12, 0x03 },
+	{   -55,   60,  100,    0,   0, 0x03 },
+};
+const uint8_t trace_index[256] PROGMEM = {
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+/* right: mask 0b11111111, 11 rows */
+const pattern_row_t right_rows[11] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{    90,   90,   30,    0,   0, 0x03 },
+	{    60,   90,   50,    0,   0, 0x03 },
+	{     0,    0,    0,    0,   1, 0x00 },
+	{    55,   90,   50,    0,   0, 0x03 },
+	{    40,   90,   60,    0,   0, 0x03 },
+	{   130,   90,  -10,    0,   0, 0x03 },
+	{   120,   90,    0,    0,   0, 0x03 },
+	{   100,   90,   10,    0,   0, 0x03 },
+	{    90,   90,   20,    0,   0, 0x03 },
+	{   105,   90,    0,    0,   0, 0x03 },
+};
+const uint8_t right_index[256] PROGMEM = {
+	 0,  1,  0,  2,  3,  0,  4,  0,  3,  0,  0,  0,  5,  0,  0,  0,
+	 3,  0,  0,  0,  0,  0,  0,  0,  3,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 6,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 7,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  9,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 7,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 6,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+/* left: mask 0b11111111, 11 rows */
+const pattern_row_t left_rows[11] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{   -85,   10,   90,    0,   0, 0x03 },
+	{  -105,    0,   90,    0,   0, 0x03 },
+	{  -120,    0,   90,    0,   0, 0x03 },
+	{     0,    0,    0,    0,   1, 0x00 },
+	{  -130,  -10,   90,    0,   0, 0x03 },
+	{   -40,   60,   90,    0,   0, 0x03 },
+	{   -55,   50,   90,    0,   0, 0x03 },
+	{   -90,   30,   90,    0,   0, 0x03 },
+	{   -90,   20,   90,    0,   0, 0x03 },
+	{   -60,   50,   90,    0,   0, 0x03 },
+};
+const uint8_t left_index[256] PROGMEM = {
+	 0,  1,  0,  2,  0,  0,  3,  3,  4,  0,  0,  0,  5,  0,  0,  5,
+	 4,  0,  0,  0,  0,  0,  0,  0,  4,  0,  0,  0,  0,  0,  0,  0,
+	 4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 6,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 7,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  9,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+/* center: mask 0b01111110, 12 rows */
+const pattern_row_t center_rows[12] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{    80,    0,    0,    0,   0, 0x01 },
+	{    35,    0,    0,    0,   0, 0x01 },
+	{    55,    0,    0,    0,   0, 0x01 },
+	{    14,    0,    0,    0,   0, 0x01 },
+	{    22,    0,    0,    0,   0, 0x01 },
+	{   -14,    0,    0,    0,   0, 0x01 },
+	{     0,    0,    0,    0,   0, 0x01 },
+	{   -36,    0,    0,    0,   0, 0x01 },
+	{   -22,    0,    0,    0,   0, 0x01 },
+	{   -80,    0,    0,    0,   0, 0x01 },
+	{   -55,    0,    0,    0,   0, 0x01 },
+};
+const uint8_t center_index[256] PROGMEM = {
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  7,  7,
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  7,  7,
+};
+
+static inline void pattern_row(const uint8_t *index, const pattern_row_t *rows, uint8_t sensor, pattern_row_t *row)
+{
+	memcpy_P(row, &rows[pgm_read_byte(&index[sensor])], sizeof(pattern_row_t));
+}
+
+#endif /* PATTERN_TABLES_H_ */
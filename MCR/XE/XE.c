@@ -1,7 +1,26 @@
 ﻿#include "helper.h"
+
+#define PROF_DISPLAY(v, leds) do { set_led_data(v); led_data.sensor_debug_output = (leds); } while (0)
+#define PROF_NEXT() get_button(BTN1)
+#include "prof.h"
+#define PROF_TIMER0 0 //TIMER0_COMP_vect body
+#define PROF_INT0 1 //INT0_vect body
+#define PROF_SENSE 2 //capture_sensor()
+#define PROF_PID 3 //pid_Controller()
+#define PROF_CONTROL 4 //one control task pass
+
+#define SCHED_SHOW(v, leds) PROF_DISPLAY(v, leds)
+#define SCHED_NEXT() get_button(BTN1)
+#define SCHED_PROF() get_button(BTN2)
+#include "sched.h"
 #include "pid.h"
 #include "functions.h"
+#include "blackbox.h"
 #include "special_cases.h"
+#include "line_pos.h"
+#include "distance.h"
+#include "telemetry.h"
+#include "trace.h"
 
 pidData_t steer;
 void old_school_main();
@@ -9,6 +28,11 @@ void pid_main();
 
 int main() {
 	init();
+	if ((hal_buttons() & BTN0) == 0) bb_show(); //BTN0 held at power-on: last runs from eeprom
+	telem_init();
+	config_load();
+	tune_load(get_switch());
+	line_pos_init();
 	set_led_data(1337);
 	servo(0);
 	set_line();
@@ -24,6 +48,13 @@ int main() {
 			isr_ptr = isr_1;
 			old_school_main();
 		}
+		if (get_button(BTN2)) {
+			isr_ptr = dummy_0; //no conversions in the timer ISR while the calibration converts
+			auto_color();
+			isr_ptr = dummy_1;
+			line_pos_init();
+			set_led_data(1337);
+		}
 	}
 }
 
@@ -32,8 +63,8 @@ typedef struct Pid_motor_speed {
 } pms;
 
 pms pid_motor_speed;
-#define MAX_CTE 300.0
-#define speed_increase_const 1.5
+#define MAX_CTE 300
+#define speed_increase_const Q8_8(1.5)
 
 inline void dynamic_speed(uint16_t l, uint16_t r) {
 	pid_motor_speed.l = l;
@@ -46,9 +77,11 @@ void decrease_speed() {
 	pid_motor_speed.r -= DECREASE_SPEED_CONST;
 }
 
-#define PID_SPEED_RATIO 0.3
-inline void calc_motor_speed(int16_t cte) {
-	uint16_t t;
+#ifndef PID_SPEED_RATIO //host builds override it, Host/Makefile sim_mcr_rNN
+#define PID_SPEED_RATIO Q15(0.3)
+#endif
+static inline void calc_motor_speed(int16_t cte) {
+	int16_t t;
 	
 	if (_90_turn) {
 		dynamic_speed(mspeed/3, mspeed/3);
@@ -60,134 +93,202 @@ inline void calc_motor_speed(int16_t cte) {
 	} else if (cte == 0) {
 		dynamic_speed(mspeed, mspeed);
 	} else if (cte > 0) {
-		t = (int16_t)(mspeed * ((MAX_CTE - cte)/MAX_CTE));
-		t = (int16_t)(mspeed - (PID_SPEED_RATIO*t));
+		t = ((int32_t)mspeed * (MAX_CTE - cte)) / MAX_CTE;
+		t = q15_sub_scaled(mspeed, t, PID_SPEED_RATIO);
 		dynamic_speed((uint16_t)(t - (cte / 5)), (uint16_t)(t + (cte / 5)));
 	} else if(cte < 0) {
-		t = (int16_t)(mspeed * ((-MAX_CTE-cte)/-MAX_CTE));
-		t = (int16_t)(mspeed - (PID_SPEED_RATIO*t));
+		t = ((int32_t)mspeed * (MAX_CTE + cte)) / MAX_CTE;
+		t = q15_sub_scaled(mspeed, t, PID_SPEED_RATIO);
 		dynamic_speed((uint16_t)(t - (cte / 5)), (uint16_t)(t + (cte / 5)));
 	}
 }
 
 #define NORMAL_TRACE 0
 
-void loop4ever() {
-	while (1);
+void loop4ever() { //after a run: BTN0 flight recorder, BTN1 scheduler statistics
+	while (1) {
+		if (get_button(BTN0)) back_trace();
+		if (get_button(BTN1)) sched_show();
+	}
 }
 
 #define RAMP_CONST 300
+#define TRACE_EDGE_MASK 0b10000001 //outer sensors clear: the frame is plain line, safe to steer on
 
-void pid_main() {
-	/* PID variables */
-	int16_t cte = 0;
+void trace_step(uint8_t sensor_val) { //one PID steering step on the current frame
+	int16_t cte;
 	int16_t pid_output;
 	
-	/* others */
-	uint8_t state = 0;
-	uint16_t first_encoder_read = 0, next_encoder_read;
-	uint16_t delta;
-	
-	pid_calibrate();
+	calc_line_pos();
+	if (line_pos_ready && line_conf) cte = last_cte = line_pos_cte(); //analog position when calibrated, kept as calc_cte()'s history for the next digital frame
+	else cte = calc_cte(sensor_val);
+	//set_led_signed(cte);
+	PROF_BEGIN(PROF_PID);
+	pid_output = pid_Controller(0, cte, &steer);
+	PROF_END(PROF_PID);
+	calc_motor_speed(cte);
+	servo(pid_output/2);
+	fwd(pid_motor_speed.l, pid_motor_speed.r);
+}
+
+void pid_start() { //run start after pid_calibrate(): controller, motors, records from zero
 	pid_Init(K_P, K_I, K_D, &steer);
-	
+	adc_filter_reset(); //the run's frames alone decide, a replayed trace starts the same
 	set_led_data(1337);
 	dynamic_speed(mspeed, mspeed);
 	fwd(pid_motor_speed.l, pid_motor_speed.r);
-	while (1) {
-		set_led_data(state);
-		led_data.sensor_debug_output = (switch_lane) | (_90_turn << 7) | (no_line << 6);
-		switch (state) {
-			case 0: //normal trace
-				if (off_lane == 100) {
-					fwd(0, 0);
-					loop4ever();
-				}
-				if (check_crossline()) {
-					off_lane += 1;
-					state = 3;
-				} else if (check_leftline()) {
-					state = 1;
-				} else if (check_rightline()) {
-					state = 2;
-				} else if (check_noline()) {
-					state = 10;
-				} else {
-					cte = calc_cte(read_sensor());
-					/*
-					if (cte < 0) set_led_data(9000 - cte);
-					else set_led_data(cte);
-					*/
-					pid_output = pid_Controller(0, cte, &steer);
-					//next_encoder_read = encoder;
-					//delta = next_encoder_read - first_encoder_read;
-					//first_encoder_read = next_encoder_read;
-					//set_led_data(delta);
-					//if (delta > RAMP_CONST) decrease_speed;	
-					calc_motor_speed(cte);	
-					servo(pid_output/2);	
-					fwd(pid_motor_speed.l, pid_motor_speed.r);
-				}
-			break;
-			
-			case 10: //no line
-				if (switch_lane) {
-					do_switch_lane();
-				} else if (_90_turn) { //it's no line not 90 turn
-					_90_turn = 0;
-				} else if (no_line) {
-					do_noline();
-				}
-				state = NORMAL_TRACE;
-			break;	
+	sched_stats_reset();
+	rec_reset();
+	bb_start();
+#ifdef PROFILE
+	prof_reset();
+#endif
+	trace_start();
+}
+
+uint8_t control_task(uint8_t state) { //one sensor frame through the state machine, returns the next state
+	PROF_BEGIN(PROF_CONTROL);
+	PROF_BEGIN(PROF_SENSE);
+	capture_sensor();
+	PROF_END(PROF_SENSE);
+	rec_sensor(sensor_frame);
+	switch (state) {
+		case 0: //normal trace
+			if (off_lane == 100) {
+				fwd(0, 0);
+				rec_mark(REC_MARK_OFF_LANE);
+				bb_stop(BB_OFF_LANE);
+				loop4ever();
+			}
+			if (check_crossline(sensor_frame)) {
+				off_lane += 1;
+				confirm_begin(CROSSLINE_CONFIRM_PULSES);
+				state = 3;
+			} else if (check_leftline(sensor_frame)) {
+				confirm_begin(HALFLINE_CONFIRM_PULSES);
+				state = 1;
+			} else if (check_rightline(sensor_frame)) {
+				confirm_begin(HALFLINE_CONFIRM_PULSES);
+				state = 2;
+			} else if (check_noline(sensor_frame)) {
+				state = 10;
+			} else {
+				trace_step(sensor_frame);
+				//next_encoder_read = encoder;
+				//delta = next_encoder_read - first_encoder_read;
+				//first_encoder_read = next_encoder_read;
+				//set_led_data(delta);
+				//if (delta > RAMP_CONST) decrease_speed;	
+			}
+		break;
 		
-			case 1: //left switch
-				_delay_ms(100);
-				if ( (read_sensor() & MASK0_1) != 0) { //wrong detection between halfline and full line
-					state = 3;
+		case 10: //no line
+			sched_skip();
+			if (switch_lane) {
+				do_switch_lane();
+			} else if (_90_turn) { //it's no line not 90 turn
+				_90_turn = 0;
+			} else if (no_line) {
+				do_noline();
+			}
+			state = NORMAL_TRACE;
+		break;	
+	
+		case 1: //left switch, confirmed after HALFLINE_CONFIRM_PULSES
+			if (check_crossline(sensor_frame)) { //the other half reached the line too
+				confirm_begin(CROSSLINE_CONFIRM_PULSES);
+				state = 3;
+				break;
+			}
+			if ((sensor_frame & TRACE_EDGE_MASK) == 0) trace_step(sensor_frame);
+			if (!confirm_done()) break;
+			if ( (sensor_frame & MASK0_1) != 0) { //wrong detection between halfline and full line
+				confirm_begin(CROSSLINE_CONFIRM_PULSES);
+				state = 3;
+			} else {
+				if (!_90_turn) { //it's a 90 turn not switch lane
+					switch_lane = 2; //set switch lane flag
+					state = NORMAL_TRACE;
 				} else {
-					if (!_90_turn) { //it's a 90 turn not switch lane
-						switch_lane = 2; //set switch lane flag
-						state = NORMAL_TRACE;
-					} else {
-						no_line = 0;
-						do_90_left_turn();
-						state = NORMAL_TRACE;
-					}
+					no_line = 0;
+					sched_skip();
+					do_90_left_turn();
+					state = NORMAL_TRACE;
 				}
-			break;
-			
-			case 2: //right switch
-				_delay_ms(100);
-				if ( (read_sensor() & MASK1_0) != 0 ) { //wrong detection between halfline and full line
-					state = 3;
+			}
+		break;
+		
+		case 2: //right switch, confirmed after HALFLINE_CONFIRM_PULSES
+			if (check_crossline(sensor_frame)) {
+				confirm_begin(CROSSLINE_CONFIRM_PULSES);
+				state = 3;
+				break;
+			}
+			if ((sensor_frame & TRACE_EDGE_MASK) == 0) trace_step(sensor_frame);
+			if (!confirm_done()) break;
+			if ( (sensor_frame & MASK1_0) != 0 ) { //wrong detection between halfline and full line
+				confirm_begin(CROSSLINE_CONFIRM_PULSES);
+				state = 3;
+			} else {
+				if (!_90_turn) {
+					switch_lane = 1; //set switch lane flag
+					state = NORMAL_TRACE;
 				} else {
-					if (!_90_turn) {
-						switch_lane = 1; //set switch lane flag
-						state = NORMAL_TRACE;
-					} else {
-						no_line = 0;
-						do_90_right_turn();
-						state = NORMAL_TRACE;
-					}
+					no_line = 0;
+					sched_skip();
+					do_90_right_turn();
+					state = NORMAL_TRACE;
 				}
-			break;
-			
-			case 3: //crossline detected
-				_delay_ms(200);
-				_90_turn = 1;
-				no_line = 1;
-				switch_lane = 0;
-				state = NORMAL_TRACE;
-			break;
+			}
+		break;
+		
+		case 3: //crossline detected, ride over it for CROSSLINE_CONFIRM_PULSES
+			if ((sensor_frame & TRACE_EDGE_MASK) == 0) trace_step(sensor_frame);
+			if (!confirm_done()) break;
+			_90_turn = 1;
+			no_line = 1;
+			switch_lane = 0;
+			state = NORMAL_TRACE;
+		break;
+	}
+	rec_state(state);
+	bb_tick(state);
+	PROF_END(PROF_CONTROL);
+	telem_tick(state);
+	trace_decision(state);
+	return state;
+}
+
+void pid_main() {
+	/* others */
+	uint8_t state = 0;
+	
+	pid_calibrate();
+	pid_start();
+	while (1) {
+		uint8_t run = sched_wait();
+		
+		if (run & (1 << SCHED_DISPLAY)) {
+			set_led_data(state);
+			led_data.sensor_debug_output = (switch_lane) | (_90_turn << 7) | (no_line << 6);
 		}
+		if (!(run & (1 << SCHED_CONTROL))) continue;
+		
+		sched_begin();
+		state = control_task(state);
+		sched_end();
 	}	
 }
 
 ISR(TIMER0_COMP_vect) {
+	PROF_BEGIN(PROF_TIMER0);
+	sched_isr();
 	isr_ptr();
+	PROF_END(PROF_TIMER0);
 }
 
 ISR(INT0_vect) {
+	PROF_BEGIN(PROF_INT0);
 	encoder += 1;
+	PROF_END(PROF_INT0);
 } 
@@ -0,0 +1,97 @@
+/*
+	Per-channel integer filter for the sensor frame.
+
+	read_sensor() takes one conversion per channel and runs it through
+	adc_filter(). Select the filter at compile time:
+
+	ADC_FILTER_IIR     y += (x - y) / 2^ADC_FILTER_SHIFT
+	                   noise variance * 1/(2^(k+1) - 1), delay 2^k - 1 frames
+	ADC_FILTER_BOXCAR  mean of the last ADC_FILTER_TAPS frames (power of two)
+	                   noise variance * 1/N, delay (N - 1)/2 frames
+	ADC_FILTER_NONE    raw conversion
+
+	The old two-conversion average gave variance * 1/2 (at best, the two
+	conversions are back to back) for twice the conversion time.
+	Host/adc_filter_report measures both against these numbers.
+
+	No AVR headers here so the host tools can include this file.
+*/
+
+#include <stdint.h>
+
+#define ADC_FILTER_NONE 0
+#define ADC_FILTER_IIR 1
+#define ADC_FILTER_BOXCAR 2
+
+#ifndef ADC_FILTER
+#define ADC_FILTER ADC_FILTER_IIR
+#endif
+#ifndef ADC_FILTER_SHIFT
+#define ADC_FILTER_SHIFT 1 //variance * 1/3, one frame of delay
+#endif
+#ifndef ADC_FILTER_TAPS
+#define ADC_FILTER_TAPS 4
+#endif
+#define ADC_FILTER_MAX_TAPS 8
+
+typedef struct Adc_boxcar {
+	uint16_t hist[ADC_FILTER_MAX_TAPS];
+	uint16_t sum;
+	uint8_t idx;
+} adc_boxcar_t;
+
+/* state holds y << shift, shift <= 6 for 10 bit samples. state == 0xffff means empty */
+static inline uint16_t adc_iir_step(uint16_t *state, uint16_t x, uint8_t shift) {
+	if (*state == 0xffff) *state = x << shift;
+	else *state += x - (*state >> shift);
+	return *state >> shift;
+}
+
+/* taps is a power of two <= ADC_FILTER_MAX_TAPS, log2_taps its log2 */
+static inline uint16_t adc_boxcar_step(adc_boxcar_t *b, uint16_t x, uint8_t taps, uint8_t log2_taps) {
+	if (b->idx == 0xff) { //empty: fill with the first sample
+		for (uint8_t i = 0; i < taps; i++) b->hist[i] = x;
+		b->sum = x << log2_taps;
+		b->idx = 0;
+	}
+	b->sum += x - b->hist[b->idx];
+	b->hist[b->idx] = x;
+	b->idx = (b->idx + 1) & (taps - 1);
+	return b->sum >> log2_taps;
+}
+
+#if ADC_FILTER == ADC_FILTER_BOXCAR
+#if ADC_FILTER_TAPS == 2
+#define ADC_FILTER_LOG2_TAPS 1
+#elif ADC_FILTER_TAPS == 4
+#define ADC_FILTER_LOG2_TAPS 2
+#elif ADC_FILTER_TAPS == 8
+#define ADC_FILTER_LOG2_TAPS 3
+#else
+#error "ADC_FILTER_TAPS must be 2, 4 or 8"
+#endif
+adc_boxcar_t adc_box[8];
+#elif ADC_FILTER == ADC_FILTER_IIR
+uint16_t adc_iir[8];
+#endif
+
+void adc_filter_reset() {
+	for (uint8_t i = 0; i < 8; i++) {
+#if ADC_FILTER == ADC_FILTER_BOXCAR
+		adc_box[i].idx = 0xff;
+#elif ADC_FILTER == ADC_FILTER_IIR
+		adc_iir[i] = 0xffff;
+#endif
+	}
+}
+
+uint16_t adc_filter(uint8_t ch, uint16_t x) {
+#if ADC_FILTER == ADC_FILTER_BOXCAR
+	return adc_boxcar_step(&adc_box[ch], x, ADC_FILTER_TAPS, ADC_FILTER_LOG2_TAPS);
+#elif ADC_FILTER == ADC_FILTER_IIR
+	return adc_iir_step(&adc_iir[ch], x, ADC_FILTER_SHIFT);
+#else
+	(void)ch;
+	return x;
+#endif
+}
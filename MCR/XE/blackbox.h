@@ -0,0 +1,187 @@
+/*
+	Black box: the end of a run kept in eeprom across power-off.
+
+	When a run stops (f_timeout(), off_lane limit) bb_stop() copies the
+	last BB_TAIL flight recorder entries (stack.h) and the run summary
+	into one bb_record_t and hands it to EE_RDY_vect, which writes it a
+	byte at a time in the background. The motors are already off by then,
+	nothing is written while pid_main() is controlling the car.
+
+	Wear levelling: BB_SLOTS records in a ring. Every stop writes the slot
+	after the newest valid one with seq + 1, so each slot takes one write
+	in BB_SLOTS stops. eeprom_update_byte() skips bytes that did not
+	change. The sum byte is written last, a record cut short by power-off
+	fails the check and the previous one is shown instead.
+
+	Summary: lap time (ms from pid_main() start to the stop), worst
+	control task run time (sched.h run_max) and control ticks per state
+	(bins 0..3 = states 0..3, bin 4 = no line).
+
+	bb_show(), hold BTN0 while powering on, starts once it is released:
+	BTN1 next page, LEDs = 1 << page
+	  0 stop reason   1 lap time (10 ms)   2 max loop time (us)
+	  3..7 time spent in state bin 0..4 (10 ms)
+	BTN0 next older record, held for BB_EXIT_MS back to the main menu
+	BTN2 load the record's event tail and browse it with back_trace()
+*/
+
+#ifndef BB_SLOTS
+#define BB_SLOTS 3
+#endif
+#ifndef BB_TAIL
+#define BB_TAIL 24 //flight recorder entries kept per record
+#endif
+#define BB_BINS 5
+#define BB_BIN(state) ((state) < BB_BINS - 1 ? (state) : BB_BINS - 1)
+#define BB_MAGIC 0xB5
+
+#define BB_EXIT_MS 1000 //BTN0 held this long leaves bb_show()
+
+#define BB_OFF_LANE 1 //off_lane limit in pid_main()
+#define BB_TIMEOUT 2 //f_timeout()
+
+typedef struct Bb_record {
+	uint8_t magic, seq, reason, n; //n: tail entries used
+	uint32_t lap_ms;
+	uint16_t loop_max_us;
+	uint16_t hist[BB_BINS]; //control ticks per state bin
+	uint16_t tail[BB_TAIL]; //flight recorder entries, oldest first
+	uint8_t sum; //8 bit sum of the bytes above, written last
+} bb_record_t;
+
+bb_record_t EEMEM eeprom_bb[BB_SLOTS];
+//the linker places the EEMEM variables from 0, the tuning profiles sit at TUNE_EE_BASE (tune.h)
+typedef char bb_below_tune[sizeof(eeprom_config) + sizeof(eeprom_bb) <= TUNE_EE_BASE ? 1 : -1];
+
+bb_record_t bb; //live summary during a run, then the record being written or shown
+uint16_t bb_prev; //rec_now() of the last bb_tick()
+uint8_t bb_slot, bb_seq; //where and as what this run will be saved
+uint8_t *bb_wr_src, *bb_wr_dst; //ram to eeprom, written through EE_RDY_vect
+volatile uint8_t bb_wr_left = 0;
+
+ISR(EE_RDY_vect) { //level triggered: fires again as soon as the eeprom is ready
+	if (bb_wr_left == 0) {
+		hal_ee_irq_off();
+		return;
+	}
+	eeprom_update_byte(bb_wr_dst, *bb_wr_src);
+	bb_wr_dst += 1;
+	bb_wr_src += 1;
+	bb_wr_left -= 1;
+}
+
+uint8_t bb_sum(bb_record_t *r) {
+	uint8_t *p = (uint8_t *)r;
+	uint8_t s = 0;
+
+	for (uint8_t i = 0; i < sizeof(bb_record_t) - 1; i++) s += p[i];
+	return s;
+}
+
+uint8_t bb_load(uint8_t slot) { //read a slot into bb, 1 when it holds a valid record
+	read_eeprom(&bb, &eeprom_bb[slot], sizeof(bb_record_t));
+	return bb.magic == BB_MAGIC && bb.n <= BB_TAIL && bb.sum == bb_sum(&bb);
+}
+
+int8_t bb_newest() { //slot of the newest valid record, -1 when none
+	int8_t best = -1;
+	uint8_t best_seq = 0;
+
+	for (uint8_t i = 0; i < BB_SLOTS; i++) {
+		if (!bb_load(i)) continue;
+		if (best < 0 || (int8_t)(bb.seq - best_seq) > 0) {
+			best = i;
+			best_seq = bb.seq;
+		}
+	}
+	return best;
+}
+
+void bb_start() { //start of a run, picks the slot before bb is reused for the live summary
+	int8_t last = bb_newest();
+	uint8_t i;
+
+	bb_slot = bb_seq = 0;
+	if (last >= 0) {
+		bb_load(last);
+		bb_seq = bb.seq + 1;
+		bb_slot = (last + 1) % BB_SLOTS;
+	}
+	bb.lap_ms = 0;
+	for (i = 0; i < BB_BINS; i++) bb.hist[i] = 0;
+	bb_prev = rec_now();
+}
+
+inline void bb_tick(uint8_t state) { //once per control task
+	uint16_t now = rec_now();
+	uint8_t b = BB_BIN(state);
+
+	bb.lap_ms += (uint16_t)(now - bb_prev);
+	bb_prev = now;
+	if (bb.hist[b] != 0xffff) bb.hist[b] += 1;
+}
+
+void bb_stop(uint8_t reason) { //motors off first: starts the background eeprom write
+	uint8_t i;
+
+	if (bb_wr_left != 0) return; //already saving this run
+	bb.lap_ms += (uint16_t)(rec_now() - bb_prev);
+	bb.magic = BB_MAGIC;
+	bb.seq = bb_seq;
+	bb.reason = reason;
+	bb.loop_max_us = sched_us(sched_stats.run_max);
+	bb.n = rec_count < BB_TAIL ? rec_count : BB_TAIL;
+	for (i = 0; i < bb.n; i++) bb.tail[i] = rec_buf[(rec_head - bb.n + i) & REC_MASK];
+	bb.sum = bb_sum(&bb);
+
+	cli();
+	bb_wr_src = (uint8_t *)&bb;
+	bb_wr_dst = (uint8_t *)&eeprom_bb[bb_slot];
+	bb_wr_left = sizeof(bb_record_t);
+	hal_ee_irq_on();
+	sei();
+}
+
+uint8_t bb_key0() { //0 up, 1 pressed, 2 held for BB_EXIT_MS; returns after the release
+	uint16_t t;
+
+	if (hal_buttons() & BTN0) return 0;
+	t = rec_now();
+	while ((hal_buttons() & BTN0) == 0) hal_idle();
+	return (uint16_t)(rec_now() - t) >= BB_EXIT_MS ? 2 : 1;
+}
+
+void bb_show() { //returns with BTN0 up, pid_main() must not see the power-on press
+	int8_t slot = bb_newest();
+	uint8_t page = 0, tries, i, k;
+	uint16_t v;
+
+	while ((hal_buttons() & BTN0) == 0) hal_idle();
+	if (slot < 0) return;
+	bb_load(slot);
+	while (1) {
+		k = bb_key0();
+		if (k == 2) return;
+		if (k == 1) { //next older valid record
+			for (tries = 0; tries < BB_SLOTS; tries++) {
+				slot = (slot + BB_SLOTS - 1) % BB_SLOTS;
+				if (bb_load(slot)) break;
+			}
+			page = 0;
+		}
+		if (get_button(BTN1)) page = (page + 1) & 7;
+		if (get_button(BTN2)) {
+			rec_reset();
+			for (i = 0; i < bb.n; i++) rec_store(bb.tail[i]);
+			back_trace();
+		}
+		switch (page) {
+			case 0: v = bb.reason; break;
+			case 1: v = bb.lap_ms / 10 > 9999 ? 9999 : bb.lap_ms / 10; break;
+			case 2: v = bb.loop_max_us; break;
+			default: v = ((uint32_t)bb.hist[page - 3] * SCHED_CONTROL_TICKS) / 10; break;
+		}
+		set_led_data(v);
+		led_data.sensor_debug_output = 1 << page;
+	}
+}
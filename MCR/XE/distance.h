@@ -0,0 +1,45 @@
+/*
+	Distance keyed on the INT0 encoder.
+
+	A track feature (half line, crossline) is confirmed after the car has
+	rolled a fixed number of encoder pulses past it instead of after a
+	fixed delay, so the window is the same length of track at any speed
+	and pid_main() keeps steering and sensing while it runs.
+
+	The count is frame_encoder, read with the sensor frame, so a replayed
+	trace (trace.h) confirms on the same frame as the car did.
+
+	The windows are in pulses, not millimetres: the MCR car's wheel
+	circumference and pulses per revolution have never been measured.
+	60 / 120 pulses are the old 60 / 120 mm only in the host simulator,
+	whose default enc_mm is 1 mm per pulse. On the car, push it over a
+	half line and a crossline and count the pulses to the end of each
+	before trusting them.
+
+	A dead or slipping encoder never reaches the count, so every window
+	also ends after CONFIRM_MIN_PULSES_S worth of control frames, the
+	time the pulses take at a crawl. Frames, not sched_tick, so replay
+	matches.
+*/
+
+#define HALFLINE_CONFIRM_PULSES 60 //was _delay_ms(100)
+#define CROSSLINE_CONFIRM_PULSES 120 //was _delay_ms(200)
+
+#define CONFIRM_MIN_PULSES_S 200 //slower than the car ever runs, 1/3 of the old 60 pulses / 100 ms
+#define PULSES_TO_FRAMES(n) ((uint16_t)(((uint32_t)(n) * 1000UL) / CONFIRM_MIN_PULSES_S / SCHED_CONTROL_TICKS))
+
+uint16_t confirm_start = 0;
+uint16_t confirm_len = 0;
+uint16_t confirm_frames = 0; //fallback, control frames left
+
+inline void confirm_begin(uint16_t pulses) {
+	confirm_start = frame_encoder;
+	confirm_len = pulses;
+	confirm_frames = PULSES_TO_FRAMES(pulses);
+}
+
+inline uint8_t confirm_done() { //once per control frame
+	if (confirm_frames != 0) confirm_frames -= 1;
+	if (confirm_frames == 0) return 1; //encoder dead or slipping
+	return (uint16_t)(frame_encoder - confirm_start) >= confirm_len; //wraps with the counter
+}
@@ -90,30 +90,35 @@ inline int16_t calc_cte(uint8_t sensor_val) { //calculate cross track error
 	}
 }
 
-inline uint8_t check_crossline() {
-	if (read_sensor() == 0xff) return 1;
-	return 0;
-}
+uint8_t sensor_frame; //one sensor frame per control tick, shared by every check below
 
-inline uint8_t check_leftline() {
-	uint8_t sensor_val;
+inline uint8_t next_frame() { //main context only: read_sensor() plus the frame's encoder count and trace record, the dummy_1 ISR takes bare read_sensor()
+	uint8_t t = read_sensor();
 	
-	sensor_val = read_sensor();
-	if ( (sensor_val == 0b11111100) || (sensor_val == 0b11111000) || (sensor_val == 0b11110000)) return 1;
-	return 0;
+	frame_encoder = read_encoder();
+	trace_frame();
+	return t;
 }
 
-inline uint8_t check_rightline() {
-	uint8_t sensor_val;
-	
-	sensor_val = read_sensor();
-	if ( (sensor_val == 0b00111111) || (sensor_val == 0b00011111) || (sensor_val == 0b00001111)) return 1;
-	return 0;
+inline uint8_t capture_sensor() {
+	sensor_frame = next_frame();
+	return sensor_frame;
 }
 
-uint8_t check_noline() {
-	if (read_sensor() == 0) return 1;
-	return 0;
+inline uint8_t check_crossline(uint8_t sensor_val) {
+	return sensor_val == 0xff;
+}
+
+inline uint8_t check_leftline(uint8_t sensor_val) {
+	return (sensor_val == 0b11111100) || (sensor_val == 0b11111000) || (sensor_val == 0b11110000);
+}
+
+inline uint8_t check_rightline(uint8_t sensor_val) {
+	return (sensor_val == 0b00111111) || (sensor_val == 0b00011111) || (sensor_val == 0b00001111);
+}
+
+inline uint8_t check_noline(uint8_t sensor_val) {
+	return sensor_val == 0;
 }
 
 void dummy_0() {
@@ -131,19 +136,27 @@ void isr_0() {
 	print();
 }
 
-void back_trace() {
-	uint16_t idx = stack_size - 1;
-	isr_ptr = &dummy_1;
+void back_trace() { //post-run browser: BTN1 older, BTN2 newer, BTN0 toggles state / time view
+	uint16_t idx = rec_count - 1, end;
+	uint8_t view = 0;
+	rec_snap_t s;
+	
+	isr_ptr = &dummy_0;
+	if (rec_count == 0) {
+		set_led_data(0);
+		while (1) hal_idle();
+	}
+	rec_walk(idx, &s);
+	end = s.t;
 	while (1) {
-		if (get_button(BTN1)) {
-			if (stack_size > 0) idx -= 1;
-			else idx = stack_size - 1;
-		}
-		if (get_button(BTN2)) {
-			if (stack_size < stack_size-1) idx += 1;
-			else idx = 0;
-		}
-		set_led_data(get_stack(idx));
+		if (get_button(BTN0)) view ^= 1;
+		if (get_button(BTN1) && idx > 0) idx -= 1;
+		if (get_button(BTN2) && idx < rec_count - 1) idx += 1;
+		rec_walk(idx, &s);
+		if (view) set_led_data((end - s.t) / 10); //10 ms units before the last event
+		else if (s.kind == REC_MARK) set_led_data(1000 + s.data); //1xxx = REC_MARK_* id, states stay below 1000
+		else set_led_data(s.state);
+		led_data.sensor_debug_output = s.sensor;
 	}
 }
 
@@ -1,8 +1,9 @@
-﻿#include <avr/io.h>
-#define F_CPU 16000000UL
-#include <util/delay.h>
-#include <avr/interrupt.h>
-#include <avr/eeprom.h>
+﻿#define F_CPU 16000000UL
+#include "hal.h"
+#include "adc_filter.h"
+#include "fixed.h"
+#include "display.h"
+#include "eeblob.h"
 
 #define cbi(port, bit) (port) &= ~(1 << (bit))
 #define sbi(port, bit) (port) |=  (1 << (bit))
@@ -20,21 +21,42 @@
 #define SERVO_CENTER 3000 + SERVO_ERROR
 #define SERVO_PWM_PERIOD 10*2000UL
 #define SERVO_STEP 6
-#define LINE_DEFAULT 450 //lol lazy coding !!!
-#define L_MOTOR_RATIO 0.7//0.8
-#define R_MOTOR_RATIO 0.5//0.6
+#define LINE_DEFAULT 450 //lol lazy coding !!! (10 bit scale)
 
-uint16_t EEMEM eeprom_LINE;
-uint16_t LINE = LINE_DEFAULT;
+/*
+	ADC profile
+	ADC_8BIT 0: adc clock /128 (125kHz), 10 bit ADCW, ~104us per channel
+	ADC_8BIT 1: adc clock /32 (500kHz), ADLAR, 8 bit ADCH, ~26us per channel
+	LINE and the line colors are kept at the profile precision in RAM and
+	at 10 bit in eeprom, so switching profile keeps the calibration.
+*/
+#ifndef ADC_8BIT
+#define ADC_8BIT 0
+#endif
+#if ADC_8BIT
+typedef uint8_t adc_t;
+#define ADC_MAX 255
+#define ADC_SHIFT 2
+#define ADC_ADMUX ((1<<REFS0) | (1<<ADLAR))
+#define ADC_PRESCALER ((1<<ADPS2) | (1<<ADPS0))
+#define ADC_RESULT hal_adc8()
+#else
+typedef uint16_t adc_t;
+#define ADC_MAX 1023
+#define ADC_SHIFT 0
+#define ADC_ADMUX (1<<REFS0)
+#define ADC_PRESCALER ((1<<ADPS2) | (1<<ADPS1) | (1<<ADPS0))
+#define ADC_RESULT hal_adc10()
+#endif
+#define ADC_SCALE(x) ((x) >> ADC_SHIFT) //10 bit constant to profile precision
+#define L_MOTOR_RATIO Q8_8(0.7)//0.8
+#define R_MOTOR_RATIO Q8_8(0.5)//0.6
 
-uint16_t EEMEM eeprom_adc_line[8];
-uint16_t EEMEM eeprom_adc_no_line[8];
+adc_t LINE = ADC_SCALE(LINE_DEFAULT);
 
-uint8_t EEMEM eeprom_m;
-uint16_t EEMEM eeprom_speed;
-uint16_t EEMEM eeprom_KP;
-uint16_t EEMEM eeprom_KI;
-uint16_t EEMEM eeprom_KD;
+adc_t adc_raw[8]; //raw adc of the last read_sensor() frame
+adc_t linetrang[8]; //adc over the line (white), from learn_color()
+adc_t lineden[8]; //adc over the floor (black), from learn_color()
 
 uint16_t K_P;
 uint16_t K_I;
@@ -42,7 +64,36 @@ uint16_t K_D;
 
 uint8_t m;
 uint16_t	mspeed;
+uint16_t servo_center = SERVO_CENTER;
+
+/*
+	Sensor calibration, saved as one blob (eeblob.h). Speeds, gains and
+	angles are per DIP switch profile in tune.h.
+	ADC values are stored at 10 bit whatever the ADC profile.
+	Bump CONFIG_VERSION when the layout changes, old blobs then load the
+	defaults in config_defaults().
+*/
+#define CONFIG_VERSION 2
+
+typedef struct Config {
+	uint8_t version;
+	uint16_t line;
+	uint16_t adc_line[8], adc_no_line[8];
+	uint16_t crc;
+} config_t;
+
+config_t EEMEM eeprom_config;
 volatile uint16_t encoder = 0;
+uint16_t frame_encoder = 0; //encoder at the last next_frame()
+
+inline uint16_t read_encoder() { //encoder is 16 bit, INT0 must not fire between the two byte reads; keeps I as it was, dummy_1 calls it from the timer ISR
+	uint16_t t;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		t = encoder;
+	}
+	return t;
+}
 
 //led 7 data
 struct ld {
@@ -59,58 +110,73 @@ uint32_t milis() {
 }
 
 uint8_t get_button(uint8_t keyid) {
-	if ( (PINB & keyid) == 0) {
-		while ( (PINB & keyid) == 0);
+	if ( (hal_buttons() & keyid) == 0) {
+		while ( (hal_buttons() & keyid) == 0) hal_idle();
 		return 1;
 	}
 	return 0;
 }
 
 uint8_t get_switch() {
-	return ~PINC & 0xf;
+	return ~hal_switches() & 0xf;
 }
 
+int16_t servo_cmd = 0; //last servo() position, for telemetry
+
 void servo(int delta) {
 	if (delta > 150) delta = 150;
 	else if(delta < -150) delta = -150;
-	OCR1A = SERVO_CENTER + delta*SERVO_STEP;
+	servo_cmd = delta;
+	hal_servo(servo_center + delta*SERVO_STEP);
 }
 
 void fwd(uint16_t left, uint16_t right) {
-	left  = left  *  L_MOTOR_RATIO;
-	right = right *  R_MOTOR_RATIO;
+	left  = q8_8_scale_u(left, L_MOTOR_RATIO);
+	right = q8_8_scale_u(right, R_MOTOR_RATIO);
 	if (left >= 0 ) {
-		cbi(PORTD,DIR0);
-		OCR1B=left*200;
+		hal_dir_clr(DIR0);
+		hal_motor_l(left*200);
 	}
 	else {
-		sbi(PORTD,DIR0);
-		OCR1B=(100+left)*200;
+		hal_dir_set(DIR0);
+		hal_motor_l((100+left)*200);
 	}
 	
 	if(right >= 0) {
-		cbi(PORTD,DIR1);
-		OCR2=right*255/100;
+		hal_dir_clr(DIR1);
+		hal_motor_r(right*255/100);
 	}
 	else {
-		sbi(PORTD,DIR1);
-		OCR2=(100+right)*255/100;
+		hal_dir_set(DIR1);
+		hal_motor_r((100+right)*255/100);
 	}
 }
 
-void SPI(uint8_t data) { //transfer data using SPI
-	SPDR = data;
-	while(!(SPSR & (1<<SPIF)));	//wait for it to complete
+volatile uint8_t spi_next; //second byte, sent from SPI_STC_vect
+volatile uint8_t spi_left; //bytes still on the wire
+
+uint16_t led_last = 0xffff; //value on the display, unchanged values are skipped
+uint8_t led_mode = 0xff;
+
+void set_led_mode(uint16_t num, uint8_t mode) { //DISP_DEC or DISP_SIGNED
+	uint8_t d[4];
+	
+	if (num == led_last && mode == led_mode) return;
+	led_last = num;
+	led_mode = mode;
+	disp_digits(num, mode, d);
+	led_data.p_1000 = d[0];
+	led_data.p_100 = d[1];
+	led_data.p_10 = d[2];
+	led_data.p_1 = d[3];
 }
 
 void set_led_data(uint32_t num) {
-	led_data.p_1 = (8<<4) | (num % 10);
-	led_data.p_10 = num % 100 / 10;
-	led_data.p_100 = num % 1000 / 100;
-	led_data.p_1000 = num / 1000;
-	led_data.p_1000 |= (led_data.p_1000 != 0) ? 1<<4 : 0;
-	led_data.p_100 |= (led_data.p_1000 != 0 || led_data.p_100 != 0) ? 2<<4 : 0;
-	led_data.p_10 |= (led_data.p_1000 != 0 || led_data.p_100 != 0 || led_data.p_10 != 0) ? 4<<4 : 0;
+	set_led_mode(num > 9999 ? 9999 : (uint16_t)num, DISP_DEC);
+}
+
+inline void set_led_signed(int16_t num) {
+	set_led_mode((uint16_t)num, DISP_SIGNED);
 }
 
 void print() {
@@ -125,35 +191,49 @@ void print() {
 		default: break;
 	}
 
-	SPI(~led_data.sensor_debug_output);
-	SPI(value);
-	sbi(PORTB,LATCH);
-	cbi(PORTB,LATCH);
+	if (spi_left) return; //last frame still shifting, skip this refresh
+	spi_next = value;
+	spi_left = 2;
+	hal_spi_write(~led_data.sensor_debug_output); //SPI_STC_vect sends the second byte and latches
+}
+
+ISR(SPI_STC_vect) {
+	if (--spi_left) hal_spi_write(spi_next);
+	else hal_latch_pulse();
 }
 
 
 void write_eeprom(void* src, void* pointer_eeprom, size_t n) {
-	while (!eeprom_is_ready());
+	while (!eeprom_is_ready()) hal_idle();
 	eeprom_write_block(src, pointer_eeprom, n);
 }
 
 void read_eeprom(void* dst, void* pointer_eeprom, size_t n) {
-	while (!eeprom_is_ready());
+	while (!eeprom_is_ready()) hal_idle();
 	eeprom_read_block(dst, pointer_eeprom, n);
 }
-inline uint16_t read_adc(uint8_t channel) {
-	ADMUX= (1<<REFS0) | channel; //selecting channel
-	ADCSRA |= (1<<ADSC); //start conversion
-	loop_until_bit_is_set(ADCSRA, ADIF);
-	return ADCW;
+inline adc_t read_adc(uint8_t channel) {
+	hal_adc_start(ADC_ADMUX | channel); //selecting channel, start conversion
+	while (!hal_adc_done());
+	return ADC_RESULT;
 }
 
+#ifdef TRACE
+adc_t trace_conv[8]; //the frame's conversions before adc_filter(), trace.h
+void trace_frame();
+#define TRACE_CONV(i, v) (trace_conv[i] = (v))
+#else
+#define TRACE_CONV(i, v) (v)
+#define trace_frame()
+#endif
+
 inline uint8_t read_sensor() {
 	uint8_t adc_value = 0;
 	uint16_t t = 0;
 	
 	for(uint8_t i=0; i<8; i++) {
-		t = (read_adc(i) + read_adc(i)) / 2;
+		t = adc_filter(i, TRACE_CONV(i, read_adc(i))); //one conversion per channel, filtered per channel
+		adc_raw[i] = t;
 		if(t < LINE) sbi(adc_value, i);
 		else cbi(adc_value, i);
 	}
@@ -161,52 +241,124 @@ inline uint8_t read_sensor() {
 	return (adc_value);
 }
 
+void config_defaults() {
+	LINE = ADC_SCALE(LINE_DEFAULT);
+	for (uint8_t i = 0; i < 8; i++) linetrang[i] = lineden[i] = 0;
+}
+
+void config_load() { //one block read at boot, defaults when the blob is missing or stale
+	config_t c;
+	
+	if (!blob_load(&c, &eeprom_config, sizeof(config_t), CONFIG_VERSION)) {
+		config_defaults();
+		return;
+	}
+	LINE = ADC_SCALE(c.line);
+	for (uint8_t i = 0; i < 8; i++) {
+		linetrang[i] = ADC_SCALE(c.adc_line[i]);
+		lineden[i] = ADC_SCALE(c.adc_no_line[i]);
+	}
+}
+
+void config_pack(config_t *c) { //the calibration in RAM as its blob, crc left to blob_save()
+	c->version = CONFIG_VERSION;
+	c->line = (uint16_t)LINE << ADC_SHIFT;
+	for (uint8_t i = 0; i < 8; i++) {
+		c->adc_line[i] = (uint16_t)linetrang[i] << ADC_SHIFT;
+		c->adc_no_line[i] = (uint16_t)lineden[i] << ADC_SHIFT;
+	}
+}
+
+void config_save() { //only the bytes that changed are written
+	config_t c;
+	
+	config_pack(&c);
+	blob_save(&c, &eeprom_config, sizeof(config_t));
+}
+
+#include "tune.h"
+
 void set_line() {
-	LINE = eeprom_read_word(&eeprom_LINE);
-	if (LINE == 0xffff) { //if LINE is not set then set it to LINE_DEFAULT = 450
-		LINE = LINE_DEFAULT;
+	while (1) {
+		if (get_button(BTN0)) break;
+		if (get_button(BTN1)) LINE -= ADC_SCALE(10);
+		if (get_button(BTN2)) LINE += ADC_SCALE(10);
+		set_led_data((uint16_t)LINE << ADC_SHIFT);
+	}
+	config_save();
+}
+
+void learn_color() { //move the sensor bar over the line and the floor, BTN0 to save; only with the timer ISR on dummy_0, dummy_1 converts too
+	adc_t t;
+	
+	for (uint8_t i = 0; i < 8; i++) {
+		linetrang[i] = ADC_MAX;
+		lineden[i] = 0;
 	}
+	set_led_data(2017);
 	while (1) {
 		if (get_button(BTN0)) break;
-		if (get_button(BTN1)) LINE -= 10;
-		if (get_button(BTN2)) LINE += 10;
-		set_led_data(LINE);
+		for (uint8_t i = 0; i < 8; i++) {
+			t = read_adc(i);
+			if (t < linetrang[i]) linetrang[i] = t;
+			if (t > lineden[i]) lineden[i] = t;
+		}
+	}
+	config_save();
+}
+
+#define SWEEP_SERVO(pos) servo(pos)
+#define SWEEP_FRAME(v) do { for (uint8_t _i = 0; _i < 8; _i++) (v)[_i] = read_adc(_i); } while (0)
+#if ADC_8BIT
+#define SWEEP_FRAMES_PER_STEP 4 //~0.21 ms frames
+#endif
+#include "sweep_cal.h"
+
+void auto_color() { //park across the line: servo sweep calibration, saved when every channel passes; only with the timer ISR on dummy_0
+	adc_t lo[8], hi[8], noise[8];
+	adc_t worst = 0;
+	uint16_t sum = 0;
+	uint8_t bad;
+	
+	fwd(0, 0);
+	set_led_data(2018);
+	bad = sweep_cal(lo, hi, noise);
+	for (uint8_t i = 0; i < 8; i++) {
+		if (noise[i] > worst) worst = noise[i];
+		sum += (lo[i] + hi[i]) / 2;
+	}
+	if (bad == 0) {
+		for (uint8_t i = 0; i < 8; i++) {
+			linetrang[i] = lo[i];
+			lineden[i] = hi[i];
+		}
+		LINE = sum / 8; //threshold between the mean line and floor levels
+		config_save();
+	}
+	while (1) { //LED7 = worst rest noise (10 bit), LEDs = channels that failed; BTN0 back, BTN1 manual learn_color()
+		set_led_data((uint16_t)worst << ADC_SHIFT);
+		led_data.sensor_debug_output = bad;
+		if (get_button(BTN0)) return;
+		if (get_button(BTN1)) {
+			learn_color();
+			return;
+		}
 	}
-	eeprom_write_word(&eeprom_LINE, LINE); //save LINE to eeprom
 }
 
 void init() {
-	//ADC
-	ADMUX = (1<<REFS0);	//reference voltage form avcc
-	ADCSRA = (1<<ADEN) | (1<<ADPS2) | (1<<ADPS1) | (1<<ADPS0); //enable ADC and set prescaler = 8
-
-	//PORT
-	DDRB  = 0b11110001;
-	PORTB = 0b11111111;
-	DDRC  = 0b00000000;
-	PORTC = 0b11111111;
-	DDRD  = 0b11111011;
-	PORTD = 0b00000000;
-
-	//SPI
-	SPCR	= (1<<SPE) | (1<<MSTR); //enable SPI, master
-	SPSR	= (1<<SPI2X); //SCK mode 2X: Fosc/2
-
-	//timer
-	TCCR0 = (1<<WGM01) | (1<<CS02); //mode 2 CTC,  prescaler = 256
-	OCR0 = 62; //1ms
-	TIMSK = (1<<OCIE0);
-	TCCR1A |= (1<<COM1A1)|(1<<COM1B1)|(1<<WGM11); // set OCR1A & OCR1B at bottom, clear at compare match (non-invert), mode 14 fast pwm
-	TCCR1B |= (1<<WGM13)|(1<<WGM12)|(1<<CS11); //prescaler = 8
-	ICR1 = SERVO_PWM_PERIOD; //time period = 10ms
-	TCCR2 = (1<<WGM20)|(1<<WGM21)|(1<<COM21)|(1<<CS22)|(1<<CS21)|(1<<CS20); //sest OC2 at bottom, clear OC2 on compare match, (non-invert), mode 3 fast pwm, prescaler = 1024
-	OCR2 = 0;
+	//ADC: reference voltage from avcc, prescaler from the ADC profile
+	hal_init_adc(ADC_ADMUX, (1<<ADEN) | ADC_PRESCALER);
+	adc_filter_reset();
+
+	hal_init_ports(0b00000000);
+	hal_init_spi(); //master, Fosc/2, transfer complete interrupt
+	hal_init_timers(); //1ms tick, servo 10ms period, motor pwm
 	//enable interrupts
 	sei();
 
 	//encoder
-	MCUCR |= (1<<ISC11)|(1<<ISC01);
-	GICR |= (1<<INT0);
+	hal_init_encoder((1<<ISC11)|(1<<ISC01));
 }
 
 void pid_calibrate() {
@@ -221,74 +373,40 @@ void pid_calibrate() {
 		led_data.sensor_debug_output = 1 << idx;
 	}
 	
-	mspeed = eeprom_read_word(&eeprom_speed);
-	if (mspeed == 0xffff) {
-		mspeed = 80;
-	}
 	while (1) {
-		if (get_button(BTN0)) {
-			eeprom_write_word(&eeprom_speed, mspeed);
-			break;
-		}
+		if (get_button(BTN0)) break;
 		if (get_button(BTN1)) mspeed -= 10;
 		if (get_button(BTN2)) mspeed += 10;
 		set_led_data(mspeed);
 	}
 	
-	m = eeprom_read_byte(&eeprom_m);
-	if (m == 255) {
-		m = 50;
-	}
 	while (1) {
-		if (get_button(BTN0)) {
-			eeprom_write_byte(&eeprom_m, m);
-			break;
-		}
+		if (get_button(BTN0)) break;
 		if (get_button(BTN1)) m -= 1;
 		if (get_button(BTN2)) m += 1;
 		set_led_data(m);
 	}
 	
-	K_P = eeprom_read_word(&eeprom_KP);
-	if (K_P == 65535UL) {
-		K_P = 95;
-	}
 	while (1) {
 		servo(0);
-		if (get_button(BTN0)) {
-			eeprom_write_word(&eeprom_KP, K_P);
-			break;
-		}
+		if (get_button(BTN0)) break;
 		if (get_button(BTN1)) K_P -= 10;
 		if (get_button(BTN2)) K_P += 10;
 		set_led_data(K_P);
 	}
 	
-	K_I = eeprom_read_word(&eeprom_KI);
-	if (K_I == 65535UL) {
-		K_I = 2;
-	}
 	while (1) {
-		if (get_button(BTN0)) {
-			eeprom_write_word(&eeprom_KI, K_I);
-			break;
-		}
+		if (get_button(BTN0)) break;
 		if (get_button(BTN1)) K_I -= 1;
 		if (get_button(BTN2)) K_I += 1;
 		set_led_data(K_I);
 	}
 	
-	K_D = eeprom_read_word(&eeprom_KD);
-	if (K_D == 65535UL) {
-		K_D = 1;
-	}
 	while (1) {
-		if (get_button(BTN0)) {
-			eeprom_write_word(&eeprom_KD, K_D);
-			break;
-		}
+		if (get_button(BTN0)) break;
 		if (get_button(BTN1)) K_D -= 10;
 		if (get_button(BTN2)) K_D += 10;
 		set_led_data(K_D);
 	}
+	tune_save(); //one update for speed, m and the gains, into the DIP switch profile
 }
\ No newline at end of file
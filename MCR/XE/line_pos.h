@@ -0,0 +1,74 @@
+/*
+	Analog line position estimator.
+
+	Each channel is normalised with the learn_color() calibration to a line
+	weight 0..255 (255 = over the line, 0 = floor), then the position is the
+	weighted centroid of the channel positions:
+
+	channel     7     6     5     4     3     2     1     0
+	position  +448  +320  +192   +64   -64  -192  -320  -448
+
+	LINE_POS_PITCH units per sensor pitch, same sign as calc_cte().
+	Integer only: one 32/16 division per frame.
+*/
+
+#define LINE_POS_PITCH 128
+#define LINE_POS_MIN_SPAN ADC_SCALE(40) //channels with a smaller line/floor span are not calibrated
+#define LINE_POS_FLOOR 32 //weights below this are treated as floor noise
+#define LINE_POS_MIN_WEIGHT 128 //less total weight than this means no line in the frame
+#define LINE_POS_CTE_DIV 149 //448 / 3: outermost sensor = 3*m like calc_cte()
+
+uint16_t line_gain[8]; //Q8.8, 255 / (lineden - linetrang)
+uint8_t line_pos_ready = 0;
+int16_t line_pos = 0;
+uint8_t line_conf = 0; //peak line weight of the last frame, 0 = no line
+
+void line_pos_init() { //call after the calibration changes
+	uint16_t span;
+	
+	line_pos_ready = 1;
+	for (uint8_t i = 0; i < 8; i++) {
+		if (lineden[i] > linetrang[i] + LINE_POS_MIN_SPAN && lineden[i] <= ADC_MAX) {
+			span = lineden[i] - linetrang[i];
+			line_gain[i] = (255UL << 8) / span;
+		} else {
+			line_gain[i] = 0;
+			line_pos_ready = 0;
+		}
+	}
+}
+
+inline uint8_t line_weight(uint8_t i, adc_t raw) {
+	uint16_t w;
+	
+	if (raw >= lineden[i]) return 0;
+	if (raw <= linetrang[i]) return 255;
+	w = ((uint32_t)(lineden[i] - raw) * line_gain[i]) >> 8;
+	if (w > 255) w = 255;
+	if (w < LINE_POS_FLOOR) return 0;
+	return (uint8_t)w;
+}
+
+int16_t calc_line_pos() { //uses adc_raw from the last read_sensor(), holds the last position when the line is lost
+	int16_t num = 0;
+	uint16_t den = 0;
+	uint8_t w, peak = 0;
+	
+	for (uint8_t i = 0; i < 8; i++) {
+		w = line_weight(i, adc_raw[i]);
+		num += (int16_t)w * (2*i - 7);
+		den += w;
+		if (w > peak) peak = w;
+	}
+	if (den < LINE_POS_MIN_WEIGHT) {
+		line_conf = 0;
+		return line_pos;
+	}
+	line_pos = ((int32_t)num * (LINE_POS_PITCH / 2)) / den;
+	line_conf = peak;
+	return line_pos;
+}
+
+inline int16_t line_pos_cte() { //line_pos scaled to the calc_cte() range
+	return ((int32_t)line_pos * m) / LINE_POS_CTE_DIV;
+}
@@ -2,14 +2,15 @@ uint8_t switch_lane = 0;
 uint8_t _90_turn = 0;
 uint8_t no_line = 0;
 
-#define  SWITCH_LANE_CONST 95
+#define  SWITCH_LANE_CONST switch_lane_angle //per profile, tune.h
 #define TIMEOUT_CONST 1000
 
 void f_timeout() {
 	set_led_data(1338);
 	fwd(0, 0);
+	bb_stop(BB_TIMEOUT);
 	while (1) {
-		;
+		hal_idle(); //parked for good
 	}
 }
 
@@ -19,16 +20,16 @@ inline void do_switch_lane() {
 	
 	set_led_data(5555);
 	if (switch_lane == 1) { //right switch
-		fwd(motor_speed, motor_speed/2);
+		fwd(mspeed, mspeed/2);
 		servo_pos = SWITCH_LANE_CONST;
 	}
 	else { //left switch
 		servo_pos = -SWITCH_LANE_CONST;
-		fwd(motor_speed/2, motor_speed);
+		fwd(mspeed/2, mspeed);
 	}
 	servo(servo_pos);
 	if (switch_lane == 1) {
-		while ( (read_sensor() & 0b01111000) == 0) {
+		while ( (next_frame() & 0b01111000) == 0) {
 			timeout += 1;
 			if (timeout == TIMEOUT_CONST) {
 				f_timeout();
@@ -36,7 +37,7 @@ inline void do_switch_lane() {
 		}
 	}
 	else {
-		while ( (read_sensor() & 0b00011110) == 0) {
+		while ( (next_frame() & 0b00011110) == 0) {
 			timeout += 1;
 			if (timeout == TIMEOUT_CONST) {
 				f_timeout();
@@ -46,18 +47,18 @@ inline void do_switch_lane() {
 	switch_lane = 0;
 }
 
-#define NOLINE_CONST 100
+#define NOLINE_CONST noline_angle //per profile, tune.h
 
 void do_noline() {
 	uint8_t loop = 1;
 	uint16_t timeout = 0;
 	
 	last_cte = 0;
-	fwd(motor_speed/2, motor_speed/2);
+	fwd(mspeed/2, mspeed/2);
 	while (loop) {
 		timeout += 1;
 		if (timeout == TIMEOUT_CONST) f_timeout();
-		switch(read_sensor()) {
+		switch(next_frame()) {
 			case 0:
 				servo(0);
 			break;
@@ -86,30 +87,30 @@ void do_90_right_turn() {
 	uint16_t timeout = 0;
 	
 	set_led_data(7777);
-	while (read_sensor() != 0);
-	fwd(motor_speed, 0);
+	while (next_frame() != 0);
+	fwd(mspeed, 0);
 	servo(150);
-	while (read_sensor() != 0b00011000) {
+	while (next_frame() != 0b00011000) {
 		timeout += 1;
 		if (timeout == TIMEOUT_CONST) f_timeout();
 	}
 	last_cte = 0;
 	_90_turn = 0;
-	fwd(motor_speed, motor_speed);
+	fwd(mspeed, mspeed);
 }
 
 void do_90_left_turn() {
 	uint16_t timeout = 0;
 	
 	set_led_data(6666);
-	while (read_sensor() != 0);
-	fwd(0, motor_speed);
+	while (next_frame() != 0);
+	fwd(0, mspeed);
 	servo(-150);
-	while (read_sensor() != 0b00011000) {
+	while (next_frame() != 0b00011000) {
 		timeout += 1;
 		if (timeout == TIMEOUT_CONST) f_timeout();
 	}
 	last_cte = 0;
 	_90_turn = 0;
-	fwd(motor_speed, motor_speed);
+	fwd(mspeed, mspeed);
 }
\ No newline at end of file
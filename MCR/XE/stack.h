@@ -1,21 +1,111 @@
-#define max_size 512
-
-uint8_t stack[max_size];
-uint16_t stack_size = 0;
-
-void push_stack(uint8_t val) {
-	if (stack_size <= max_size - 1) {
-		stack[stack_size] = val;
-		stack_size += 1;
-	} else {
-		for(uint16_t i = 0; i < stack_size-1; i++) {
-			stack[i] = stack[i+1];
-		}
+/*
+	Flight recorder: the last REC_DEPTH events of a run, for back_trace().
+
+	Ring buffer of 16 bit entries, constant time per event, overwriting the
+	oldest one when full. REC_DEPTH is a power of two, 128 entries = 256 B.
+
+	entry  bits 15..14  kind
+	       bits 13..8   ms since the previous entry (0..63)
+	       bits  7..0   data
+	REC_STATE   data = pid_main() state
+	REC_SENSOR  data = sensor frame
+	REC_MARK    data = REC_MARK_* event id
+	REC_TIME    gap longer than 63 ms, the gap is data << 6 | bits 13..8
+	            (saturates at 16.3 s); the next entry carries 0 ms
+
+	Time comes from sched_tick (1 ms). Recording is done from the main
+	loop only.
+*/
+
+#ifndef REC_DEPTH
+#define REC_DEPTH 128
+#endif
+#define REC_MASK (REC_DEPTH - 1)
+
+#define REC_STATE 0
+#define REC_SENSOR 1
+#define REC_MARK 2
+#define REC_TIME 3
+
+#define REC_MARK_OFF_LANE 1 //off_lane limit reached, car stopped
+
+#define REC_DT_MAX 63
+#define REC_GAP_MAX 0x3fff
+
+uint16_t rec_buf[REC_DEPTH];
+uint16_t rec_head = 0; //next slot
+uint16_t rec_count = 0;
+uint16_t rec_last; //sched_tick of the last entry
+uint16_t rec_last_state = 0x100, rec_last_sensor = 0x100; //recorded on change only, 0x100 = nothing yet
+
+inline uint16_t rec_now() {
+	uint16_t t;
+
+	cli();
+	t = sched_tick;
+	sei();
+	return t;
+}
+
+inline void rec_store(uint16_t e) {
+	rec_buf[rec_head] = e;
+	rec_head = (rec_head + 1) & REC_MASK;
+	if (rec_count < REC_DEPTH) rec_count += 1;
+}
+
+void rec_put(uint8_t kind, uint8_t data) {
+	uint16_t now = rec_now();
+	uint16_t dt = now - rec_last;
+
+	rec_last = now;
+	if (rec_count == 0) dt = 0;
+	if (dt > REC_DT_MAX) {
+		if (dt > REC_GAP_MAX) dt = REC_GAP_MAX;
+		rec_store(((uint16_t)REC_TIME << 14) | ((dt & REC_DT_MAX) << 8) | (dt >> 6));
+		dt = 0;
 	}
-	stack[stack_size-1] = val;
+	rec_store(((uint16_t)kind << 14) | (dt << 8) | data);
+}
+
+void rec_reset() {
+	rec_head = rec_count = 0;
+	rec_last_state = rec_last_sensor = 0x100;
+}
+
+inline void rec_state(uint8_t state) {
+	if (state == rec_last_state) return;
+	rec_last_state = state;
+	rec_put(REC_STATE, state);
+}
+
+inline void rec_sensor(uint8_t frame) {
+	if (frame == rec_last_sensor) return;
+	rec_last_sensor = frame;
+	rec_put(REC_SENSOR, frame);
 }
 
-uint8_t get_stack(uint16_t idx) {
-	if (idx < stack_size) return stack[idx];
-	else return 0;
-}
\ No newline at end of file
+inline void rec_mark(uint8_t id) {
+	rec_put(REC_MARK, id);
+}
+
+typedef struct Rec_snap {
+	uint16_t t; //ms after the oldest entry
+	uint8_t kind, data; //the entry itself
+	uint8_t state, sensor; //in effect at that entry
+} rec_snap_t;
+
+void rec_walk(uint16_t idx, rec_snap_t *s) { //replay entries 0 (oldest) .. idx into s
+	uint16_t i, e;
+
+	s->t = 0;
+	s->state = s->sensor = 0;
+	for (i = 0; i <= idx && i < rec_count; i++) {
+		e = rec_buf[(rec_head - rec_count + i) & REC_MASK];
+		s->kind = e >> 14;
+		s->data = e & 0xff;
+		s->t += (e >> 8) & REC_DT_MAX;
+		if (s->kind == REC_TIME) s->t += (uint16_t)s->data << 6;
+		else if (s->kind == REC_STATE) s->state = s->data;
+		else if (s->kind == REC_SENSOR) s->sensor = s->data;
+	}
+}
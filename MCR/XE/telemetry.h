@@ -0,0 +1,151 @@
+/*
+	Binary telemetry on the USART (TXD = PD1), 250000 baud 8N1.
+
+	telem_tick() runs once per control task. Every TELEM_DIV calls it packs
+	one record into a ring buffer that USART_UDRE_vect drains. When the
+	buffer has no room the record is dropped and counted in telem_drops,
+	the control loop never waits on the UART. TELEM_DIV 0 compiles
+	everything out.
+
+	Record, little endian:
+	0xA5  fields  [adc_mask]  tick:u16  sensor:u8  state:u8
+	[adc:u16 per bit of adc_mask]  [servo:i16]  [ocr1b:u16 ocr2:u8]
+	[encoder:u16]  sum:u8
+	adc_mask is only sent with TELEM_F_ADC. sum is the 8 bit sum of every
+	byte after 0xA5. Host/telem_decode turns the stream into CSV.
+
+	The ring buffer and the UART are shared with trace.h: a TRACE build
+	sends trace records instead, at 1 Mbaud, and no telemetry records
+	unless TELEM_DIV is set too.
+*/
+
+#ifndef TELEM_DIV
+#ifdef TRACE
+#define TELEM_DIV 0
+#else
+#define TELEM_DIV 5 //every 5th control task: 100 records/s at 2 ms
+#endif
+#endif
+
+#define TELEM_F_ADC 0x01 //raw adc of the channels in TELEM_ADC_MASK
+#define TELEM_F_SERVO 0x02 //last servo() command
+#define TELEM_F_MOTOR 0x04 //OCR1B / OCR2 duty
+#define TELEM_F_ENC 0x08 //encoder count
+
+#ifndef TELEM_FIELDS
+#define TELEM_FIELDS (TELEM_F_ADC | TELEM_F_SERVO | TELEM_F_MOTOR | TELEM_F_ENC)
+#endif
+#ifndef TELEM_ADC_MASK
+#define TELEM_ADC_MASK 0b00111100 //the four middle channels
+#endif
+
+#define TELEM_SYNC 0xA5
+#define TELEM_BUF 128 //power of two <= 256
+#ifdef TRACE
+#define TELEM_UBRR 1 //16 MHz, U2X: 1 Mbaud, 0 % error
+#else
+#define TELEM_UBRR 7 //16 MHz, U2X: 250000 baud, 0 % error
+#endif
+#define TELEM_MAX_RECORD 32
+
+#if TELEM_DIV || defined(TRACE)
+
+uint8_t telem_buf[TELEM_BUF];
+volatile uint8_t telem_head = 0; //written by telem_send()
+volatile uint8_t telem_tail = 0; //written by USART_UDRE_vect
+uint16_t telem_drops = 0;
+uint8_t telem_div = 0;
+
+void telem_init() {
+	hal_init_uart(TELEM_UBRR); //8N1, U2X, transmit only
+}
+
+ISR(USART_UDRE_vect) {
+	uint8_t t = telem_tail;
+	
+	if (t == telem_head) {
+		hal_uart_irq_off();
+		return;
+	}
+	hal_uart_put(telem_buf[t]);
+	telem_tail = (t + 1) & (TELEM_BUF - 1);
+}
+
+inline uint8_t *telem_put16(uint8_t *p, uint16_t v) {
+	*p++ = v;
+	*p++ = v >> 8;
+	return p;
+}
+
+void telem_send(uint8_t *rec, uint8_t n) { //a whole record into the ring or, when it does not fit, dropped
+	uint8_t head = telem_head;
+	uint8_t room = (telem_tail - head - 1) & (TELEM_BUF - 1);
+	
+	if (room < n) {
+		if (telem_drops != 0xffff) telem_drops += 1;
+		return;
+	}
+	for (uint8_t i = 0; i < n; i++) {
+		telem_buf[head] = rec[i];
+		head = (head + 1) & (TELEM_BUF - 1);
+	}
+	telem_head = head;
+	hal_uart_irq_on();
+}
+
+#else
+
+#define telem_init()
+
+#endif
+
+#if TELEM_DIV
+
+void telem_record(uint8_t state) {
+	uint8_t rec[TELEM_MAX_RECORD];
+	uint8_t *p = rec;
+	uint8_t sum = 0;
+	uint16_t tick;
+	
+	cli();
+	tick = sched_tick;
+	sei();
+	*p++ = TELEM_SYNC;
+	*p++ = TELEM_FIELDS;
+#if TELEM_FIELDS & TELEM_F_ADC
+	*p++ = TELEM_ADC_MASK;
+#endif
+	p = telem_put16(p, tick);
+	*p++ = sensor_frame;
+	*p++ = state;
+#if TELEM_FIELDS & TELEM_F_ADC
+	for (uint8_t i = 0; i < 8; i++) {
+		if (TELEM_ADC_MASK & (1 << i)) p = telem_put16(p, adc_raw[i]);
+	}
+#endif
+#if TELEM_FIELDS & TELEM_F_SERVO
+	p = telem_put16(p, servo_cmd);
+#endif
+#if TELEM_FIELDS & TELEM_F_MOTOR
+	p = telem_put16(p, hal_motor_l_get());
+	*p++ = hal_motor_r_get();
+#endif
+#if TELEM_FIELDS & TELEM_F_ENC
+	p = telem_put16(p, read_encoder());
+#endif
+	for (uint8_t *q = rec + 1; q < p; q++) sum += *q;
+	*p++ = sum;
+	telem_send(rec, p - rec);
+}
+
+inline void telem_tick(uint8_t state) { //once per control task
+	if (++telem_div < TELEM_DIV) return;
+	telem_div = 0;
+	telem_record(state);
+}
+
+#else
+
+#define telem_tick(state)
+
+#endif
@@ -0,0 +1,114 @@
+/*
+	Input trace: every sensor frame of a run and every decision, sent on
+	the telemetry UART (telemetry.h) for Host/trace_replay.
+
+	Build with TRACE defined. From pid_start() on, next_frame() sends
+	each frame it takes, in the control task and in the blocking
+	manoeuvres alike, and every control task ends with the decision it
+	made. The frames dummy_1 takes in the timer ISR before a run are not
+	sent. trace_replay feeds the frames to the native build of this
+	firmware and compares its decisions with the car's.
+
+	Link budget at 1 Mbaud (100 kB/s): a control task is 28 bytes,
+	14 kB/s; the manoeuvre loops take a frame every 0.83 ms with the
+	10 bit ADC (20 kB/s), every 0.21 ms with ADC_8BIT (72 kB/s). A record
+	that does not fit the ring is dropped and counted in telem_drops,
+	the replay stops comparing at the gap.
+
+	Records, little endian, sum = 8 bit sum of every byte after 0x5A,
+	seq counts every record so a drop shows:
+	H  0x5A 'H' seq build tune_id config_t tune_t sum    run start
+	F  0x5A 'F' seq encoder:u16 in:u8 conv sum           one frame
+	D  0x5A 'D' seq state sensor servo:i16 left:u16 right:u8 sum
+	build    TRACE_BUILD, the ADC options the replay has to share
+	config_t, tune_t
+	         the calibration and the profile in RAM as eeprom blobs
+	in       buttons (PINB bits 1..3) | DIP switches << 4
+	conv     the 8 conversions before adc_filter(): ADC_8BIT one byte
+	         each; 10 bit the 8 low bytes, then a u16 of the high bits,
+	         2 per channel, channel 0 lowest
+	servo    servo_cmd, left/right OCR1B and OCR2
+*/
+
+#define TRACE_SYNC 0x5A
+#define TRACE_BUILD (ADC_8BIT | (ADC_FILTER << 1) | (ADC_FILTER_SHIFT << 3) | \
+	((ADC_FILTER_TAPS == 8 ? 3 : ADC_FILTER_TAPS == 4 ? 2 : ADC_FILTER_TAPS == 2) << 6))
+
+#ifdef HAL_HOST
+const uint8_t trace_build = TRACE_BUILD; //for the replay to check a trace against
+#endif
+
+#ifdef TRACE
+
+#define TRACE_MAX_RECORD (3 + 2 + sizeof(config_t) + sizeof(tune_t) + 1)
+
+uint8_t trace_on = 0;
+uint8_t trace_seq = 0;
+
+void trace_send(uint8_t *rec, uint8_t *end) { //rec[0..2] filled in here, then the sum
+	uint8_t sum = 0;
+	
+	rec[0] = TRACE_SYNC;
+	rec[2] = trace_seq++;
+	for (uint8_t *q = rec + 1; q < end; q++) sum += *q;
+	*end++ = sum;
+	telem_send(rec, end - rec);
+}
+
+void trace_start() { //run start: the header, then frames and decisions
+	uint8_t rec[TRACE_MAX_RECORD];
+	uint8_t *p = rec + 3;
+	
+	rec[1] = 'H';
+	*p++ = TRACE_BUILD;
+	*p++ = tune_id;
+	config_pack((config_t *)p);
+	*(uint16_t *)(p + sizeof(config_t) - 2) = blob_crc(p, sizeof(config_t) - 2);
+	p += sizeof(config_t);
+	tune_pack((tune_t *)p);
+	*(uint16_t *)(p + sizeof(tune_t) - 2) = blob_crc(p, sizeof(tune_t) - 2);
+	p += sizeof(tune_t);
+	trace_send(rec, p);
+	trace_on = 1;
+}
+
+void trace_frame() { //from next_frame(), main context only
+	uint8_t rec[3 + 2 + 1 + 10 + 1];
+	uint8_t *p = rec + 3;
+	uint16_t hi = 0;
+	
+	if (!trace_on) return;
+	rec[1] = 'F';
+	p = telem_put16(p, frame_encoder);
+	*p++ = (hal_buttons() & (BTN0 | BTN1 | BTN2)) | (get_switch() << 4);
+	for (uint8_t i = 0; i < 8; i++) {
+		*p++ = trace_conv[i];
+#if !ADC_8BIT
+		hi |= (trace_conv[i] >> 8) << (2 * i);
+#endif
+	}
+#if !ADC_8BIT
+	p = telem_put16(p, hi);
+#endif
+	trace_send(rec, p);
+}
+
+void trace_decision(uint8_t state) { //end of a control task
+	uint8_t rec[3 + 7 + 1];
+	uint8_t *p = rec + 3;
+	
+	rec[1] = 'D';
+	*p++ = state;
+	*p++ = sensor_frame;
+	p = telem_put16(p, servo_cmd);
+	p = telem_put16(p, hal_motor_l_get());
+	*p++ = hal_motor_r_get();
+	trace_send(rec, p);
+}
+
+#else
+
+#define trace_start()
+#define trace_decision(state)
+
+#endif
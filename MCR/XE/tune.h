@@ -0,0 +1,84 @@
+/*
+	Tuning profiles, picked at boot by the 4 DIP switches (get_switch()).
+
+	A profile is what pid_calibrate() edits plus the servo centre and the
+	fixed manoeuvre angles of special_cases.h. Each one is its own blob
+	(eeblob.h), so an empty or damaged profile falls back to
+	tune_defaults() alone. The line and colour calibration belongs to the
+	car, not the strategy, and stays in config_t. pid_calibrate() saves
+	into the active profile.
+
+	eeprom: 16 profiles x 16 B = 256 B at a fixed address, the top half
+	(TUNE_EE_BASE), so tools can write a profile into an eeprom image
+	(Host/tune_sweep -E) without the linker map. The EEMEM variables
+	(config, black box) are placed by the linker from 0 and must stay
+	below it, blackbox.h checks.
+*/
+
+#define TUNE_PROFILES 16
+#define TUNE_VERSION 1
+#define TUNE_EE_BASE 256 //eeprom 256..511
+
+typedef struct Tune {
+	uint8_t version;
+	uint16_t speed;
+	uint8_t m;
+	uint16_t kp, ki, kd;
+	uint16_t servo_center;
+	int8_t switch_lane; //do_switch_lane() servo angle
+	int8_t noline; //do_noline() servo angle
+	uint16_t crc;
+} tune_t;
+
+#define TUNE_EE(id) ((tune_t *)(TUNE_EE_BASE + (id) * sizeof(tune_t)))
+uint8_t tune_id = 0;
+int8_t switch_lane_angle = 95;
+int8_t noline_angle = 100;
+
+void tune_defaults() {
+	mspeed = 80;
+	m = 50;
+	K_P = 95;
+	K_I = 2;
+	K_D = 1;
+	servo_center = SERVO_CENTER;
+	switch_lane_angle = 95;
+	noline_angle = 100;
+}
+
+void tune_load(uint8_t id) {
+	tune_t t;
+	
+	tune_id = id & (TUNE_PROFILES - 1);
+	if (!blob_load(&t, TUNE_EE(tune_id), sizeof(tune_t), TUNE_VERSION)) {
+		tune_defaults();
+		return;
+	}
+	mspeed = t.speed;
+	m = t.m;
+	K_P = t.kp;
+	K_I = t.ki;
+	K_D = t.kd;
+	servo_center = t.servo_center;
+	switch_lane_angle = t.switch_lane;
+	noline_angle = t.noline;
+}
+
+void tune_pack(tune_t *t) { //the profile in RAM as its blob, crc left to blob_save()
+	t->version = TUNE_VERSION;
+	t->speed = mspeed;
+	t->m = m;
+	t->kp = K_P;
+	t->ki = K_I;
+	t->kd = K_D;
+	t->servo_center = servo_center;
+	t->switch_lane = switch_lane_angle;
+	t->noline = noline_angle;
+}
+
+void tune_save() { //into the active profile, only changed bytes are written
+	tune_t t;
+	
+	tune_pack(&t);
+	blob_save(&t, TUNE_EE(tune_id), sizeof(tune_t));
+}
@@ -12,11 +12,11 @@
 #define F_CPU 16000000UL
 
 /* -------------------- Libraries -------------------- */
-#include <avr/io.h>
-#include <util/delay.h>
-#include <avr/interrupt.h>
-#include <avr/eeprom.h>
+#include "hal.h"
 #include <stdbool.h>
+#include "fixed.h"
+#include "speed_pi.h"
+#include "display.h"
 
 /* -------------------- Macros -------------------- */
 #define cbi(port, bit) (port) &= ~(1 << (bit))
@@ -39,8 +39,7 @@
 
 /* -------------------- Constants define -------------------- */
 //#define  SERVO_CENTER      3100
-uint16_t SERVO_CENTER   =  3000;
-#define  STEP			   4
+/* servo centre and step: per profile, tune.h */
 #define  SERVO_ANGLE_MAX   125
 
 /* -------------------- ADC variable -------------------- */
@@ -59,23 +58,26 @@ struct led7 {
 } led7_data;
 
 /* -------------------- Ratio variable -------------------- */
-#define ratio_default 0.30
-int16_t velocity;
+#define ratio_default 30 /* % */
+int16_t velocity; /* setpoint, encoder pulses per SPEED_PERIOD_MS, < 0 = open loop */
 uint8_t cnt_ratio;
+speed_pi_t speed_pi;
 int16_t pulse_ratio;
-float ratio_base, ratio;
-float delay = 0;
+q8_8_t ratio_base, ratio; /* Q8.8 */
+uint16_t delay_cnt = 0; /* ms, 200 * (1.4 - 1.125 * ratio) */
 
 uint8_t cSpeed = 0xff, incCounter = 0;
 int16_t cSpeedDiff = 0;
 
+#include "tune.h"
+
 /* -------------------- BUTTON + SWITCH -------------------- */
 uint8_t get_button(uint8_t keyid)
 {
-	if ((PINB & 0x0e) != 0x0e)
+	if ((hal_buttons() & 0x0e) != 0x0e)
 	{
 		_delay_ms(80);
-		if ((PINB|keyid) == keyid) return 1;
+		if ((hal_buttons()|keyid) == keyid) return 1;
 	}
 	return 0;
 }
@@ -83,7 +85,7 @@ uint8_t get_button(uint8_t keyid)
 uint8_t get_switch()
 {
 	uint8_t x=0;
-	x = ~PINC;
+	x = ~hal_switches();
 	x = x & 0x07;
 	return x;
 }
@@ -91,12 +93,13 @@ uint8_t get_switch()
 uint8_t get_switch2()
 {
 	uint8_t x=0;
-	x = ~PINC;
+	x = ~hal_switches();
 	x = x & 0x08;
 	return x;
 }
 
 /* -------------------- RATIO + SERVO + MOTOR -------------------- */
+/* Speed setpoint in encoder pulses per SPEED_PERIOD_MS, -1 = open loop (ratio_base) */
 void set_encoder(int8_t veloc)
 {
 	velocity = veloc;
@@ -105,21 +108,16 @@ void set_encoder(int8_t veloc)
 void cal_ratio( void )
 {
 	cnt_ratio++;
-	if (cnt_ratio >= 20) /* 20ms */
+	if (cnt_ratio >= SPEED_PERIOD_MS)
 	{
 		if (velocity < 0)
 		{
 			ratio = ratio_base;
+			speed_pi_reset(&speed_pi);
 		}
 		else
 		{
-			if      (pulse_ratio < velocity / 2)    ratio = ratio_base + 0.3;
-			else if (pulse_ratio < velocity)        ratio = ratio_base + 0.1;
-			else if (pulse_ratio > velocity)        ratio = ratio_base - 0.35;
-			else if (pulse_ratio > velocity / 2)    ratio = ratio_base - 0.25;
-			else ratio = ratio_base;
-			
-			if (ratio <= 0) ratio = 0.1;
+			ratio = speed_pi_step(&speed_pi, ratio_base, velocity, pulse_ratio);
 		}
 		
 		cSpeedDiff = pulse_ratio - cSpeed;
@@ -164,38 +162,38 @@ void handle(int goc)
 	if      (goc > SERVO_ANGLE_MAX)  goc =  SERVO_ANGLE_MAX;
 	else if (goc < -SERVO_ANGLE_MAX) goc = -SERVO_ANGLE_MAX;
 	
-	OCR1A = SERVO_CENTER + (goc * STEP);
+	hal_servo(tune.servo_center + (goc * tune.step));
 }
 
 void speed(int left, int right)
 {
-	left  = left  *  ratio;
-	right = right *  ratio;
+	left  = q8_8_scale(left, ratio);
+	right = q8_8_scale(right, ratio);
 	
 	if (left >= 0)
 	{
-		sbi(PORTD, DIR00);
-		cbi(PORTD, DIR01);
-		OCR1B = left * 200;
+		hal_dir_set(DIR00);
+		hal_dir_clr(DIR01);
+		hal_motor_l(left * 200);
 	}
 	else
 	{
-		cbi(PORTD, DIR00);
-		sbi(PORTD, DIR01);
-		OCR1B = (-left) * 200;
+		hal_dir_clr(DIR00);
+		hal_dir_set(DIR01);
+		hal_motor_l((-left) * 200);
 	}
 	
 	if (right >= 0)
 	{
-		sbi(PORTD, DIR10);
-		cbi(PORTD, DIR11);
-		OCR2 = right * 255/100;
+		hal_dir_set(DIR10);
+		hal_dir_clr(DIR11);
+		hal_motor_r(right * 255/100);
 	}
 	else
 	{
-		cbi(PORTD, DIR10);
-		sbi(PORTD, DIR11);
-		OCR2 = (-right) * 255/100;
+		hal_dir_clr(DIR10);
+		hal_dir_set(DIR11);
+		hal_motor_r((-right) * 255/100);
 	}
 }
 
@@ -207,21 +205,29 @@ void stop(void)
 }
 
 /* -------------------- LED7 -------------------- */
-void SPI(uint8_t data)
+volatile uint8_t spi_next; /* second byte, sent from SPI_STC_vect */
+volatile uint8_t spi_left; /* bytes still on the wire */
+
+uint16_t led7_last = 0xffff; /* value on the display, unchanged values are skipped */
+uint8_t led7_mode = 0xff;
+
+void led7_show(uint16_t num, uint8_t mode) /* DISP_DEC or DISP_SIGNED */
 {
-	SPDR = data;
-	while(!(SPSR & (1<<SPIF)));
+	uint8_t d[4];
+	
+	if ((num == led7_last) && (mode == led7_mode)) return;
+	led7_last = num;
+	led7_mode = mode;
+	disp_digits(num, mode, d);
+	led7_data.thousand = d[0];
+	led7_data.hundred  = d[1];
+	led7_data.ten      = d[2];
+	led7_data.unit     = d[3];
 }
 
 void led7(unsigned int num)
 {
-	led7_data.unit		 = (1<<7) |(unsigned int)(num%10);
-	led7_data.ten		 = (unsigned int)(num%100 / 10);
-	led7_data.hundred	 = (unsigned int)(num%1000 / 100);
-	led7_data.thousand	 = (unsigned int)(num/ 1000);
-	led7_data.thousand	|= (led7_data.thousand!=0)? 1<<4 : 0;
-	led7_data.hundred	|= (led7_data.thousand!=0 || led7_data.hundred!=0)? 1<<5 : 0;
-	led7_data.ten		|= (led7_data.thousand!=0 || led7_data.hundred !=0 || led7_data.ten!=0)? 1<<6 : 0;
+	led7_show(num, DISP_DEC);
 }
 
 void print( void )
@@ -236,20 +242,48 @@ void print( void )
 		case 3: value=led7_data.unit;		break;
 		default: break;
 	}
-	SPI(~led7_data.sensor_out);
-	SPI(value);
-	sbi(PORTB,LATCH);
-	cbi(PORTB,LATCH);
+	if (spi_left) return; /* last frame still shifting, skip this refresh */
+	spi_next = value;
+	spi_left = 2;
+	hal_spi_write(~led7_data.sensor_out); /* SPI_STC_vect sends the second byte and latches */
+}
+
+ISR(SPI_STC_vect)
+{
+	if (--spi_left)
+	{
+		hal_spi_write(spi_next);
+	}
+	else
+	{
+		hal_latch_pulse();
+	}
 }
 
+/* -------------------- PROFILE -------------------- */
+#define PROF_DISPLAY(v, leds) do { led7(v); led7_data.sensor_out = (leds); } while (0)
+#define PROF_NEXT()           get_button(BTN1)
+#include "prof.h" /* Debug builds only (PROFILE) */
+#define PROF_TIMER0 0 /* TIMER0_COMP_vect body */
+#define PROF_INT0   1 /* INT0_vect body */
+#define PROF_SENSOR 2 /* sensor_cmp(), 8 blocking conversions */
+#define PROF_LOOP   3 /* one pattern loop pass */
+
+/* -------------------- Scheduler -------------------- */
+#define SCHED_CONTROL_TICKS 6 /* case 10 runs sensor_cmp() 4 times, 4.3 ms in Host/sim_golden at ADC clock /128 */
+#define SCHED_SHOW(v, leds) PROF_DISPLAY(v, leds)
+#define SCHED_NEXT()        get_button(BTN1)
+#define SCHED_PROF()        get_button(BTN2)
+#include "sched.h" /* pattern loop released from TIMER0_COMP_vect */
+
 /* -------------------- ADC -------------------- */
 void read_adc_eeprom( void )
 {
 	for(uint8_t j=0; j<8; j++)
 	{
-		while(!eeprom_is_ready());
+		while(!eeprom_is_ready()) hal_idle();
 		lineTrang[j] = eeprom_read_word((uint16_t*)(j*2));
-		while(!eeprom_is_ready());
+		while(!eeprom_is_ready()) hal_idle();
 		lineDen[j] = eeprom_read_word((uint16_t*)((j+8)*2));
 	}
 	for(uint8_t i=0; i<8; i++)
@@ -262,29 +296,30 @@ void write_adc_eeprom( void )
 {
 	for(uint8_t j=0; j<8; j++)
 	{
-		while(!eeprom_is_ready());
+		while(!eeprom_is_ready()) hal_idle();
 		eeprom_write_word((uint16_t*)(j*2), (uint16_t)lineTrang[j]);
-		while(!eeprom_is_ready());
+		while(!eeprom_is_ready()) hal_idle();
 		eeprom_write_word((uint16_t*)((j+8)*2), (uint16_t)lineDen[j]);
 	}
 }
 
 uint16_t adc_read( uint8_t ch )
 {
-	ADMUX = (1<< REFS0)|ch;
-	ADCSRA|=(1<<ADSC);
-	while(!(ADCSRA & (1<<ADIF)));
-	return ADCW;
+	hal_adc_start((1<< REFS0)|ch);
+	while(!hal_adc_done());
+	return hal_adc10();
 }
 
 uint8_t sensor_cmp( void )
 {
 	uint8_t ADC_value=0;
+	PROF_BEGIN(PROF_SENSOR);
 	for(uint8_t i=0; i<8; i++)
 	{
 		if(adc_read(i)<ADC_average[i]) sbi(ADC_value,i);
 	}
 	led7_data.sensor_out=ADC_value;
+	PROF_END(PROF_SENSOR);
 	return (ADC_value);
 }
 
@@ -342,41 +377,22 @@ void learn_color( void )
 void INIT( void )
 {
 	/* ADC */
-	ADMUX=(1<<REFS0);
-	ADCSRA=(1<<ADEN) | (1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0);
+	hal_init_adc((1<<REFS0), (1<<ADEN) | (1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0));
 	read_adc_eeprom();
 	
 	/* PORT */
-	DDRB  = 0b11110001;
-	PORTB = 0b11111111;
-	
-	DDRC  = 0b00000000;
-	PORTC = 0b11111111;
-	
-	DDRD  = 0b11111011;
-	PORTD = 0b00000000;
+	hal_init_ports(0b00000000);
 	
 	/* SPI */
-	SPCR = (1<<SPE)|(1<<MSTR);
-	SPSR = (1<<SPI2X);
+	hal_init_spi();
 	
 	/* TIMER */
-	TCCR0=(1<<WGM01) | (1<<CS02);
-	OCR0=62;
-	TIMSK=(1<<OCIE0);
-	
-	TCCR1A = (1<<COM1A1)|(1<<COM1B1)|(1<<WGM11);
-	TCCR1B = (1<<WGM13)|(1<<WGM12)|(1<<CS11);
-	ICR1 = 20000;
-	OCR1B = 0;
-	
-	TCCR2=(1<<WGM20)|(1<<WGM21)|(1<<COM21)|(1<<CS22)|(1<<CS21)|(1<<CS20);
-	OCR2=0;
+	hal_init_timers();
+	hal_motor_l(0);
 	sei();
 	
 	/* ENCODER */
-	MCUCR |= (1<<ISC00)|(1<<ISC01);
-	GICR |= (1<<INT0);
+	hal_init_encoder((1<<ISC00)|(1<<ISC01));
 	set_encoder(19);
 }
 
@@ -413,6 +429,9 @@ void test_servo( void )
 void servo_calibrate( void )
 {
 	int16_t angle = 0;
+	uint8_t page;
+	uint8_t *field[4] = { &tune.ratio_pct, &tune.addition_handle, &tune.handle_pct, &tune.speed_pct };
+	
 	while (true)
 	{
 		led7((angle>=0)?angle:(-angle));
@@ -423,22 +442,41 @@ void servo_calibrate( void )
 		if (get_button(BTN2)) angle++;
 	}
 	
-	SERVO_CENTER = SERVO_CENTER + (angle * STEP);
+	tune.servo_center = tune.servo_center + (angle * tune.step);
+	handle(0);
+	
+	/* rest of the profile: ratio %, addition_handle, table angle %, table speed % */
+	for (page = 0; page < 4; page++)
+	{
+		while (true)
+		{
+			led7(*field[page]);
+			led7_data.sensor_out = 1 << page;
+			if (get_button(BTN0)) (*field[page])--;
+			if (get_button(BTN1)) break;
+			if (get_button(BTN2)) (*field[page])++;
+		}
+	}
+	tune_save();
+	ratio_base = ratio = q8_8_from_pct(tune.ratio_pct);
+	delay_cnt = 280 - q8_8_scale(225, ratio);
 }
 
 /* -------------------- START -------------------- */
 void sel_mode()
 {
+	tune_load(get_switch());
 	handle(0);
 	speed(0,0);
 	set_encoder(-1);
 	
 	while(1)
 	{
-		ratio_base = ratio_default + (get_switch() / 20.0);
+		if (get_switch() != tune_id) tune_load(get_switch()); /* profile follows the switches */
+		ratio_base = q8_8_from_pct(tune.ratio_pct);
 		ratio = ratio_base;
-		led7(ratio_base * 100);
-		delay = (1.4 - 1.125 * ratio);
+		led7(q8_8_to_pct(ratio_base));
+		delay_cnt = 280 - q8_8_scale(225, ratio);
 		sensor_cmp();
 		if(get_button(BTN0))		return;
 		else if (get_button(BTN1))	test_hardware(); /*test_servo();*/
@@ -6,13 +6,15 @@
 */
 
 #include "function.h"
+#include "pattern_tables.h"
 
-#define addition_handle 5
+#define addition_handle tune.addition_handle /* per profile, tune.h */
 
 bool check_crossline( void );
 bool check_rightline( void );
 bool check_leftline( void );
 inline void center_no_speed( void );
+void pattern_apply( const uint8_t *index, const pattern_row_t *rows, uint8_t s );
 
 uint8_t pattern = 10;
 uint8_t sensor = 0x00;
@@ -40,9 +42,20 @@ int main(void)
 	}
 	
 	pattern = 10; /* Chay thang */
+	sched_stats_reset();
 	
     while (true)
     {
+		if (!(sched_wait() & (1 << SCHED_CONTROL))) continue;
+		sched_begin();
+		PROF_BEGIN(PROF_LOOP);
+		if ((hal_buttons() | BTN2) == BTN2) /* stop, show the loop statistics, then the profile (PROFILE); get_button() would wait 80 ms while the start key is still held */
+		{
+			speed(0, 0);
+			handle(0);
+			while ((hal_buttons() | BTN2) == BTN2) hal_idle(); /* the next BTN2 is for prof_show() */
+			sched_show();
+		}
         switch (pattern)
 		{
 			/* Chay thang */
@@ -74,159 +87,19 @@ int main(void)
 					pattern = 99;
 				}
 				
-				switch (sensor_cmp() & 0b01111110)
-				{
-					case 0b01111110:
-					break;
-					
-					case 0b00011000: /* Chay thang */
-						handle(0);
-						speed( 100 ,100 );
-					break;
-					
-					case 0b00011100:
-					case 0b00001000:
-						speed(100,100);
-						handle(9 + addition_handle);
-					break;
-					case 0b00001100:
-						speed(100,100);
-						handle(20 + addition_handle);
-					break;
-					case 0b00001110:
-					case 0b00000100:
-						speed(100,85);
-						handle(31 + addition_handle);
-					break;
-					case 0b00000110:
-						speed(100,80);
-						handle(50 + addition_handle);
-					break;
-					case 0b00000010:
-						speed(100,70);
-						handle(75 + addition_handle);
-						pattern=11;	/* Lech phai goc lon */ /*Moi sua*/
-					break;		
-					
-					case 0b00111000:
-					case 0b00010000:
-						speed(100,100);
-						handle(-9 - addition_handle);
-					break;
-					case 0b00110000:
-						speed(100,100);
-						handle(-20- addition_handle);
-					break;
-					case 0b01110000:
-					case 0b00100000:
-						speed(85,100);
-						handle(-31 - addition_handle);
-					break;
-					case 0b01100000:
-						speed(80,100);
-						handle(-50 - addition_handle);
-					break;
-					case 0b01000000:
-						speed(70,100);
-						handle(-75 - addition_handle);
-						pattern=12; /* Lech trai goc lon */ /*Moi sua*/
-					break;
-					
-					default:
-					break;
-				}
+				pattern_apply(trace_index, trace_rows, sensor_cmp());
 			break; /* case 10 */
 			
 			/* Lech phai goc lon */
 			case 11:
 				led7(11);
-				switch (sensor_cmp() & 0b11001100)
-				{
-					case 0b11000000:
-						set_encoder(6/*5*/);
-						speed(80, /*0*/-10);
-						handle(145/*95*/ + addition_handle);/* sua 95 */
-					break;
-					
-					case 0b10000000:
-						set_encoder(6/*5*/);
-						speed(80, /*15*/5);
-						handle(125/*80*/ + addition_handle);/* sua 80*/
-					break;
-					
-					case 0b00000000:
-						set_encoder(8/*7*/);
-						speed(80, /*20*/10);
-						handle(90/*68*/ + addition_handle);
-					break;
-					
-					case 0b00000100:
-						set_encoder(10/*9*/);
-						speed(80, /*25*/15);
-						handle(65/*50*/ + addition_handle);
-					break;
-					
-					case 0b00001100:
-						speed(80, /*30*/20);
-						handle(55/*42*/ + addition_handle);
-						pattern = 10;
-						set_encoder(-1);
-					break;
-					
-					case 0b01100000:
-						pattern=12;
-					break;
-					
-					default:
-						pattern=11;
-					break;
-				}
+				pattern_apply(big_right_index, big_right_rows, sensor_cmp());
 			break; /* case 11 */
 			
 			/* Lech trai goc lon */
 			case 12:
 				led7(12);
-				switch(sensor_cmp() & 0b00110011)
-				{
-					case 0b00000011:
-						set_encoder(6);
-						speed(/*0*/-10,80);
-						handle(-145/*-95*/ - addition_handle);/*sua -95*/
-					break;
-					
-					case 0b00000001:
-						set_encoder(6);
-						speed(/*15*/5,80);
-						handle(/*-80*/-125 - addition_handle);/*sua -80*/
-					break;
-					
-					case 0b00000000:
-						set_encoder(8/*7*/);
-						speed(/*20*/10,80);
-						handle(/*-68*/-90 - addition_handle);
-					break;
-					
-					case 0b00100000:
-						set_encoder(10/*9*/);
-						speed(/*25*/15,80);
-						handle(/*-50*/-65 - addition_handle);
-					break;
-					
-					case 0b00110000:
-						speed(/*30*/20,80);
-						handle(-55/*-42*/ - addition_handle);
-						pattern = 10;
-						set_encoder(-1);
-					break;
-					
-					case 0b00000110:
-						pattern=11;
-					break;
-					
-					default:
-						pattern=12;
-					break;
-				}
+				pattern_apply(big_left_index, big_left_rows, sensor_cmp());
 			break; /* case 12 */
 			
 			/* Cua vuong */
@@ -312,6 +185,7 @@ int main(void)
 			
 			case 31:
 				led7(31);
+				hal_idle(); /* timer_cnt only moves in the Timer0 ISR */
 				
 				if( timer_cnt > 200 )
 				{
@@ -332,6 +206,7 @@ int main(void)
 			
 			case 41:
 				led7(41);
+				hal_idle();
 				
 				if( timer_cnt > 200 )
 				{
@@ -387,7 +262,7 @@ int main(void)
 				led7(53);
 				
 				sensor = sensor_cmp();
-				if(((encoder_pulse > 100) || (timer_cnt > 200 * delay)) && ((sensor & 0b00110000 ) == 0b00110000))
+				if(((encoder_pulse > 100) || (timer_cnt > delay_cnt)) && ((sensor & 0b00110000 ) == 0b00110000))
 				{
 					pattern = 10;
 					set_encoder(-1);
@@ -435,7 +310,7 @@ int main(void)
 				led7(63);
 				
 				sensor = sensor_cmp();
-				if(((encoder_pulse > 100) || (timer_cnt > 200 * delay)) && ((sensor & 0b00110000 ) == 0b00110000))
+				if(((encoder_pulse > 100) || (timer_cnt > delay_cnt)) && ((sensor & 0b00110000 ) == 0b00110000))
 				{
 					pattern = 10;
 					set_encoder(-1);
@@ -481,22 +356,29 @@ int main(void)
 				pattern = 10;
 			break; /* default */
 		}
+		PROF_END(PROF_LOOP);
+		sched_end();
     }
 }
 
 ISR(TIMER0_COMP_vect) /* 1ms */
 {
+	PROF_BEGIN(PROF_TIMER0);
+	sched_isr();
 	print();
 	cal_ratio();
 	timer_cnt++;
+	PROF_END(PROF_TIMER0);
 }
 
 ISR(INT0_vect)
 {
+	PROF_BEGIN(PROF_INT0);
 	encoder_pulse++;
 	pulse_ratio++;
 	if (pattern == 10) bridgeCounter++;
 	else bridgeCounter = 0;
+	PROF_END(PROF_INT0);
 }
 
 bool check_crossline( void )
@@ -517,52 +399,23 @@ bool check_leftline( void )
 
 inline void center_no_speed( void )
 {
-	switch (sensor_cmp() & 0b01111110)
+	pattern_apply(center_index, center_rows, sensor_cmp());
+}
+
+/* Tra bang patterns.tbl theo sensor, goc/toc do nhan ti le cua profile, goc lai cong them addition_handle */
+void pattern_apply( const uint8_t *index, const pattern_row_t *rows, uint8_t s )
+{
+	pattern_row_t row;
+	
+	pattern_row(index, rows, s, &row);
+	if (row.flags & PT_ENCODER) set_encoder(row.encoder);
+	if (row.flags & PT_SPEED)   speed(tune_scale(row.left, tune.speed_pct), tune_scale(row.right, tune.speed_pct));
+	if (row.flags & PT_HANDLE)
 	{
-		case 0b01111110:
-		break;
-		
-		case 0b00011000: /* Chay thang */
-		handle( 0 );
-		break;
-		
-		case 0b00011100:
-		case 0b00001000:
-		handle(9 + addition_handle);
-		break;
-		case 0b00001100:
-		handle(17 + addition_handle);
-		break;
-		case 0b00001110:
-		case 0b00000100:
-		handle(31 + addition_handle);
-		break;
-		case 0b00000110:
-		handle(50 + addition_handle);
-		break;
-		case 0b00000010:
-		handle(75 + addition_handle);
-		break;
-		
-		case 0b00111000:
-		case 0b00010000:
-		handle(-9 - addition_handle);
-		break;
-		case 0b00110000:
-		handle(-17 - addition_handle);
-		break;
-		case 0b01110000:
-		case 0b00100000:
-		handle(-31 - addition_handle);
-		break;
-		case 0b01100000:
-		handle(-50 - addition_handle);
-		break;
-		case 0b01000000:
-		handle(-75 - addition_handle);
-		break;
-		
-		default:
-		break;
+		int16_t goc = tune_scale(row.handle, tune.handle_pct);
+		if (goc > 0)      handle(goc + addition_handle);
+		else if (goc < 0) handle(goc - addition_handle);
+		else              handle(0);
 	}
-}
\ No newline at end of file
+	if (row.next) pattern = row.next;
+}
@@ -0,0 +1,154 @@
+/*
+ * pattern_tables.h
+ *
+ * Generated by Host/gen_pattern_tables.py from patterns.tbl, do not edit.
+ * Index: sensor byte -> row. Row 0 does nothing.
+ */
+
+#ifndef PATTERN_TABLES_H_
+#define PATTERN_TABLES_H_
+
+#include "hal.h" /* PROGMEM, pgm_read_* */
+
+#define PT_HANDLE  0x01
+#define PT_SPEED   0x02
+#define PT_ENCODER 0x04
+
+typedef struct Pattern_row {
+	int16_t handle;
+	int8_t  left, right;
+	int8_t  encoder;
+	uint8_t next;
+	uint8_t flags;
+} pattern_row_t;
+
+/* trace: mask 0b01111110, 12 rows */
+const pattern_row_t trace_rows[12] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{    75,  100,   70,    0,  11, 0x03 },
+	{    31,  100,   85,    0,   0, 0x03 },
+	{    50,  100,   80,    0,   0, 0x03 },
+	{     9,  100,  100,    0,   0, 0x03 },
+	{    20,  100,  100,    0,   0, 0x03 },
+	{    -9,  100,  100,    0,   0, 0x03 },
+	{     0,  100,  100,    0,   0, 0x03 },
+	{   -31,   85,  100,    0,   0, 0x03 },
+	{   -20,  100,  100,    0,   0, 0x03 },
+	{   -75,   70,  100,    0,  12, 0x03 },
+	{   -50,   80,  100,    0,   0, 0x03 },
+};
+const uint8_t trace_index[256] PROGMEM = {
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+/* big_right: mask 0b11001100, 6 rows */
+const pattern_row_t big_right_rows[6] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{    90,   80,   10,    8,   0, 0x07 },
+	{    65,   80,   15,   10,   0, 0x07 },
+	{    55,   80,   20,   -1,  10, 0x07 },
+	{   125,   80,    5,    6,   0, 0x07 },
+	{   145,   80,  -10,    6,   0, 0x07 },
+};
+const uint8_t big_right_index[256] PROGMEM = {
+	 1,  1,  1,  1,  2,  2,  2,  2,  0,  0,  0,  0,  3,  3,  3,  3,
+	 1,  1,  1,  1,  2,  2,  2,  2,  0,  0,  0,  0,  3,  3,  3,  3,
+	 1,  1,  1,  1,  2,  2,  2,  2,  0,  0,  0,  0,  3,  3,  3,  3,
+	 1,  1,  1,  1,  2,  2,  2,  2,  0,  0,  0,  0,  3,  3,  3,  3,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  4,  4,  4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  4,  4,  4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  4,  4,  4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  4,  4,  4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 5,  5,  5,  5,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 5,  5,  5,  5,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 5,  5,  5,  5,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 5,  5,  5,  5,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+/* big_left: mask 0b00110011, 6 rows */
+const pattern_row_t big_left_rows[6] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{   -90,   10,   80,    8,   0, 0x07 },
+	{  -125,    5,   80,    6,   0, 0x07 },
+	{  -145,  -10,   80,    6,   0, 0x07 },
+	{   -65,   15,   80,   10,   0, 0x07 },
+	{   -55,   20,   80,   -1,  10, 0x07 },
+};
+const uint8_t big_left_index[256] PROGMEM = {
+	 1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,
+	 5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,
+	 1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,
+	 5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,
+	 1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,
+	 5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,
+	 1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,  1,  2,  0,  3,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,  4,  0,  0,  0,
+	 5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,  5,  0,  0,  0,
+};
+
+/* center: mask 0b01111110, 12 rows */
+const pattern_row_t center_rows[12] PROGMEM = {
+	{     0,    0,    0,    0,   0, 0x00 },
+	{    75,    0,    0,    0,   0, 0x01 },
+	{    31,    0,    0,    0,   0, 0x01 },
+	{    50,    0,    0,    0,   0, 0x01 },
+	{     9,    0,    0,    0,   0, 0x01 },
+	{    17,    0,    0,    0,   0, 0x01 },
+	{    -9,    0,    0,    0,   0, 0x01 },
+	{     0,    0,    0,    0,   0, 0x01 },
+	{   -31,    0,    0,    0,   0, 0x01 },
+	{   -17,    0,    0,    0,   0, 0x01 },
+	{   -75,    0,    0,    0,   0, 0x01 },
+	{   -50,    0,    0,    0,   0, 0x01 },
+};
+const uint8_t center_index[256] PROGMEM = {
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  0,  0,  5,  5,  2,  2,
+	 6,  6,  0,  0,  0,  0,  0,  0,  7,  7,  0,  0,  4,  4,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  9,  0,  0,  0,  0,  0,  0,  6,  6,  0,  0,  0,  0,  0,  0,
+	10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	11, 11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static inline void pattern_row(const uint8_t *index, const pattern_row_t *rows, uint8_t sensor, pattern_row_t *row)
+{
+	memcpy_P(row, &rows[pgm_read_byte(&index[sensor])], sizeof(pattern_row_t));
+}
+
+#endif /* PATTERN_TABLES_H_ */
@@ -0,0 +1,63 @@
+/*
+ * speed_pi.h
+ *
+ * Wheel speed PI controller on the encoder, run by cal_ratio().
+ *
+ * Every SPEED_PERIOD_MS the encoder count of the period is compared with
+ * the set_encoder() setpoint (pulses per period) and ratio is set to
+ *
+ *     ratio = ratio_base + Kp * e + sum(Ki * e)      e = setpoint - pulses
+ *
+ * ratio_base is the feed-forward from the switches, ratio is clamped to
+ * [SPEED_RATIO_MIN, SPEED_RATIO_MAX]. The integral only moves when that
+ * does not push ratio further into the clamp (anti-windup).
+ * Integer only, the host simulation (Host/speed_pi_sim.c) uses this file.
+ */
+
+#ifndef SPEED_PI_H_
+#define SPEED_PI_H_
+
+#include "fixed.h"
+
+/* -------------------- Tuning -------------------- */
+#ifndef SPEED_PERIOD_MS
+#define SPEED_PERIOD_MS 20
+#endif
+#ifndef SPEED_KP
+#define SPEED_KP Q8_8(0.04)  /* ratio per pulse of error */
+#endif
+#ifndef SPEED_KI
+#define SPEED_KI Q8_8(0.008) /* ratio per pulse of error per period */
+#endif
+#define SPEED_RATIO_MIN Q8_8(0.1)
+#define SPEED_RATIO_MAX Q8_8(1.0)
+
+typedef struct Speed_pi
+{
+	q8_8_t integ;
+} speed_pi_t;
+
+static inline void speed_pi_reset(speed_pi_t *pi)
+{
+	pi->integ = 0;
+}
+
+static inline q8_8_t speed_pi_step(speed_pi_t *pi, q8_8_t base, int16_t setpoint, int16_t pulses)
+{
+	int16_t e  = setpoint - pulses;
+	q8_8_t  p  = sat16((int32_t)e * SPEED_KP);
+	q8_8_t  di = sat16((int32_t)e * SPEED_KI);
+	int32_t u  = (int32_t)base + p + pi->integ + di;
+	
+	if (!((u > SPEED_RATIO_MAX && di > 0) || (u < SPEED_RATIO_MIN && di < 0)))
+	{
+		pi->integ = q8_8_add(pi->integ, di);
+	}
+	
+	u = (int32_t)base + p + pi->integ;
+	if (u > SPEED_RATIO_MAX) return SPEED_RATIO_MAX;
+	if (u < SPEED_RATIO_MIN) return SPEED_RATIO_MIN;
+	return (q8_8_t)u;
+}
+
+#endif /* SPEED_PI_H_ */
@@ -0,0 +1,70 @@
+/*
+ * tune.h
+ *
+ * Tuning profiles in eeprom, one per setting of DIP switches 1..3
+ * (get_switch(), switch 4 stays the servo calibrate switch).
+ *
+ * A profile holds what used to be compile-time: servo centre and step,
+ * open loop ratio, addition_handle and a scale for the angles and speeds
+ * of the patterns.tbl decision tables. Each one is a checksummed blob
+ * (eeblob.h) after the 16 colour words at eeprom 0..31. An empty or bad
+ * profile loads tune_defaults(), the old constants with ratio 30% + 5%
+ * per switch step, so an unprogrammed car runs as before.
+ *
+ * Edited and saved by servo_calibrate() (switch 4 on at power-up).
+ */
+
+#ifndef TUNE_H_
+#define TUNE_H_
+
+#include "eeblob.h"
+
+#define TUNE_PROFILES 8
+#define TUNE_VERSION  1
+#define TUNE_EE_BASE  32 /* after lineTrang/lineDen */
+
+typedef struct Tune {
+	uint8_t  version;
+	uint16_t servo_center;
+	uint8_t  step;            /* OCR1A counts per handle() unit */
+	uint8_t  ratio_pct;       /* open loop ratio_base, % */
+	uint8_t  addition_handle; /* added to the table angles */
+	uint8_t  handle_pct;      /* table angles, 100 = as in patterns.tbl */
+	uint8_t  speed_pct;       /* table speeds, 100 = as in patterns.tbl */
+	uint16_t crc;
+} tune_t;
+
+tune_t  tune;
+uint8_t tune_id = 0xff;
+
+#define TUNE_EE(id) ((tune_t *)(TUNE_EE_BASE + (id) * sizeof(tune_t)))
+
+void tune_defaults( uint8_t id )
+{
+	tune.servo_center    = 3000;
+	tune.step            = 4;
+	tune.ratio_pct       = ratio_default + id * 5;
+	tune.addition_handle = 5;
+	tune.handle_pct      = 100;
+	tune.speed_pct       = 100;
+}
+
+void tune_load( uint8_t id )
+{
+	tune_id = id;
+	if (!blob_load(&tune, TUNE_EE(id), sizeof(tune_t), TUNE_VERSION)) tune_defaults(id);
+}
+
+void tune_save( void )
+{
+	tune.version = TUNE_VERSION;
+	blob_save(&tune, TUNE_EE(tune_id), sizeof(tune_t));
+}
+
+/* table value scaled by the profile, 100% returns it unchanged */
+inline int16_t tune_scale( int16_t v, uint8_t pct )
+{
+	return (pct == 100) ? v : (int16_t)(((int32_t)v * pct) / 100);
+}
+
+#endif /* TUNE_H_ */